@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef APP_LOG_H
+#define APP_LOG_H
+
+/** @file app_log.h
+ * @brief Rate-limited logging and ZBOSS trace stripping.
+ * @defgroup app_log Application logging
+ * @{
+ *
+ * Messages that can repeat at bus or radio rate, such as failed transactions
+ * or a full queue, are logged through @ref APP_LOG_RATELIMIT: each call site
+ * logs at most once per APP_LOG_RATELIMIT_MS, and the next message it logs
+ * is preceded by the number of messages suppressed in between. A module sets
+ * its own interval by defining APP_LOG_RATELIMIT_MS before including this
+ * header, CONFIG_APP_LOG_RATELIMIT_MS otherwise; 0 disables the limit.
+ *
+ * With CONFIG_APP_ZBOSS_TRACE_STRIP, TRACE_MSG calls of the files including
+ * this header after zboss_api.h are not compiled in, whatever the trace
+ * level of the stack.
+ */
+
+#include <stdbool.h>
+#include <zephyr/kernel.h>
+
+#ifndef APP_LOG_RATELIMIT_MS
+#define APP_LOG_RATELIMIT_MS CONFIG_APP_LOG_RATELIMIT_MS
+#endif
+
+/** @brief Log a message at most once per APP_LOG_RATELIMIT_MS from this call site.
+ *
+ *  The state of a call site is not locked: calls from several threads at
+ *  once may log one message too many, or count one too few.
+ *
+ *  @param log  LOG_ERR, LOG_WRN, LOG_INF or LOG_DBG.
+ *  @param ...  Format string and arguments.
+ */
+#define APP_LOG_RATELIMIT(log, ...)                                                                                                                                                                                                                      \
+    do {                                                                                                                                                                                                                                                 \
+        static uint32_t app_log_last;                                                                                                                                                                                                                    \
+        static uint16_t app_log_suppressed;                                                                                                                                                                                                              \
+        static bool     app_log_started;                                                                                                                                                                                                                 \
+        uint32_t        app_log_now = k_uptime_get_32();                                                                                                                                                                                                 \
+                                                                                                                                                                                                                                                         \
+        if (APP_LOG_RATELIMIT_MS == 0 || !app_log_started || app_log_now - app_log_last >= APP_LOG_RATELIMIT_MS) {                                                                                                                                       \
+            if (app_log_suppressed > 0) {                                                                                                                                                                                                                \
+                log("%u messages suppressed", app_log_suppressed);                                                                                                                                                                                       \
+            }                                                                                                                                                                                                                                            \
+            log(__VA_ARGS__);                                                                                                                                                                                                                            \
+            app_log_last       = app_log_now;                                                                                                                                                                                                            \
+            app_log_suppressed = 0;                                                                                                                                                                                                                      \
+            app_log_started    = true;                                                                                                                                                                                                                   \
+        } else if (app_log_suppressed < UINT16_MAX) {                                                                                                                                                                                                    \
+            app_log_suppressed++;                                                                                                                                                                                                                        \
+        }                                                                                                                                                                                                                                                \
+    } while (0)
+
+#ifdef CONFIG_APP_ZBOSS_TRACE_STRIP
+#undef TRACE_MSG
+#define TRACE_MSG(...)
+#endif /* CONFIG_APP_ZBOSS_TRACE_STRIP */
+
+/** @} */
+
+#endif /* APP_LOG_H */
@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef BOOT_TIMING_H
+#define BOOT_TIMING_H
+
+/** @file boot_timing.h
+ * @brief Timestamps of the boot phases.
+ * @defgroup boot_timing Boot timing
+ * @{
+ */
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Boot phases, in the order they are normally reached */
+enum boot_phase
+{
+    BOOT_PHASE_MAIN = 0,       /**< main() entered */
+    BOOT_PHASE_STACK_ENABLED,  /**< Zigbee thread started */
+    BOOT_PHASE_STACK_STARTED,  /**< First signal from the Zigbee stack */
+    BOOT_PHASE_JOINED,         /**< Joined or rejoined a network */
+    BOOT_PHASE_FIRST_RESPONSE, /**< First Modbus cluster response sent */
+    BOOT_PHASE_COUNT,
+};
+
+/** @brief Record the time a phase is reached. Calls after the first one for a phase have no effect.
+ *
+ *  Can be called from any context.
+ *
+ *  @param phase  Boot phase.
+ */
+void boot_timing_mark(enum boot_phase phase);
+
+/** @brief Get the time a phase was reached.
+ *
+ *  @param phase  Boot phase.
+ *
+ *  @return Milliseconds since reset, or 0 if the phase has not been reached.
+ */
+uint32_t boot_timing_get(enum boot_phase phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* BOOT_TIMING_H */
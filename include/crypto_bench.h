@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CRYPTO_BENCH_H
+#define CRYPTO_BENCH_H
+
+/** @file crypto_bench.h
+ * @brief AES backend benchmark.
+ * @defgroup crypto_bench Crypto benchmark
+ * @{
+ *
+ * Zigbee frames are secured with AES-CCM*, which the stack computes from
+ * AES-128 block encryptions. The benchmark times these block encryptions
+ * with the ECB peripheral, when the SoC has one, and logs the result as
+ * secured frames per second. TinyCrypt is timed as a software reference;
+ * the software AES of the stack is built into its library and is not
+ * measured, so no frame rate is derived from it.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Run the benchmark. Blocks the calling thread for a few hundred milliseconds. */
+void crypto_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* CRYPTO_BENCH_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef DELTA_OTA_H
+#define DELTA_OTA_H
+
+/** @file delta_ota.h
+ * @brief Delta firmware update patch format.
+ * @defgroup delta_ota Delta firmware update
+ * @{
+ *
+ * A delta image is downloaded like a full image, and rebuilds the new
+ * signed image in the mcuboot_secondary partition from the image running
+ * in mcuboot_primary while it is received. It is produced on the host by
+ * scripts/delta_ota.py.
+ *
+ * All values are little endian. The patch starts with a header:
+ *
+ *     uint32  magic: DELTA_OTA_MAGIC
+ *     uint8   version: DELTA_OTA_VERSION
+ *     uint8   reserved[3]: 0
+ *     uint32  size of the signed image the patch applies to
+ *     uint32  CRC-32 (IEEE) of that image
+ *     uint32  size of the signed image produced
+ *     uint32  CRC-32 (IEEE) of that image
+ *
+ * followed by records, which produce the target image in order:
+ *
+ *     uint8   DELTA_OTA_OP_COPY, uint32 offset, uint32 length: bytes of the source image
+ *     uint8   DELTA_OTA_OP_DATA, uint16 length, uint8[length]: new bytes
+ *     uint8   DELTA_OTA_OP_ADD, uint32 offset, uint32 length, uint16 count,
+ *             count x (uint8 gap, uint8 delta): length bytes of the source
+ *             image, where each pair skips gap bytes and adds delta modulo
+ *             256 to the next one
+ *
+ * An add record, like the difference of bsdiff, rebuilds code where only
+ * shifted pointers and branch offsets changed at two bytes per changed byte,
+ * without compression.
+ *
+ * The image is checked against the target CRC before it is scheduled, and
+ * its signature is verified by MCUboot before it is booted.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DELTA_OTA_MAGIC   0x544c445a /* "ZDLT" */
+#define DELTA_OTA_VERSION 1
+
+#define DELTA_OTA_HDR_LEN 24
+
+/** @brief Patch record types */
+enum delta_ota_op
+{
+    DELTA_OTA_OP_COPY = 0x01, /**< Copy bytes of the running image */
+    DELTA_OTA_OP_DATA = 0x02, /**< Write the bytes that follow */
+    DELTA_OTA_OP_ADD  = 0x03, /**< Copy bytes of the running image with a sparse difference */
+};
+
+#define DELTA_OTA_COPY_LEN     9  /* Record type, offset and length */
+#define DELTA_OTA_DATA_LEN     3  /* Record type and length, without the data */
+#define DELTA_OTA_ADD_LEN      11 /* Record type, offset, length and pair count, without the pairs */
+#define DELTA_OTA_ADD_PAIR_LEN 2  /* Gap and delta */
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* DELTA_OTA_H */
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef LOG_BENCH_H
+#define LOG_BENCH_H
+
+/** @file log_bench.h
+ * @brief Logging cost benchmark.
+ * @defgroup log_bench Logging benchmark
+ * @{
+ *
+ * Times the log calls found on the hot paths of the application, in CPU
+ * cycles per call: a message with two arguments at the warning and info
+ * levels, a debug message, a rate-limited message that is suppressed and a
+ * ZBOSS trace call. Build once with prj.conf and once with
+ * overlay-release.conf to compare the logging profiles. The results are
+ * printed with printk, outside of the logger being measured.
+ *
+ * tests/log_bench runs the benchmark on native_sim, where the time stamp
+ * counter of the host replaces the timing functions and the ZBOSS trace
+ * call is left out.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Run the benchmark. Blocks the calling thread for about a second. */
+void log_bench_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* LOG_BENCH_H */
@@ -0,0 +1,102 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_AGGREGATE_H
+#define MODBUS_AGGREGATE_H
+
+/** @file modbus_aggregate.h
+ * @brief Windowed statistics of polled registers.
+ * @defgroup modbus_aggregate Modbus aggregation
+ * @{
+ *
+ * Every register listed in MODBUS_AGGREGATE_LIST is aggregated over tumbling
+ * windows of its configured length. When a window closes, its statistics
+ * replace the ones of the previous window and are marked for reporting, so
+ * that a collector only receives a few values per window instead of every
+ * sample.
+ *
+ * The statistics of aggregate @c index are manufacturer-specific attributes
+ * of the Modbus cluster server, see @ref MODBUS_AGGREGATE_ATTR_ID.
+ */
+
+#include <zephyr/types.h>
+
+#include "modbus_regmap_defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief First attribute identifier of the statistics attributes */
+#define MODBUS_AGGREGATE_ATTR_BASE 0x0100
+
+/** @brief Attribute identifier of a statistic of an aggregate */
+#define MODBUS_AGGREGATE_ATTR_ID(index, field) (MODBUS_AGGREGATE_ATTR_BASE + ((index) << 4) + (field))
+
+/** @brief Statistics of a window, offset of their attribute identifier */
+enum modbus_aggregate_field
+{
+    MODBUS_AGGREGATE_FIELD_MIN = 0, /**< Minimum value, int32 */
+    MODBUS_AGGREGATE_FIELD_MAX,     /**< Maximum value, int32 */
+    MODBUS_AGGREGATE_FIELD_MEAN,    /**< Mean value x100, int32 */
+    MODBUS_AGGREGATE_FIELD_SAMPLES, /**< Number of samples, uint16 */
+    MODBUS_AGGREGATE_FIELD_RATE,    /**< Change from first to last sample per minute x100, int32 */
+    MODBUS_AGGREGATE_FIELD_COUNT,
+};
+
+/** @brief Statistics of the last complete window of an aggregate */
+struct modbus_aggregate_result {
+    int32_t  min;
+    int32_t  max;
+    int32_t  mean;
+    uint16_t count;
+    int32_t  rate;
+};
+
+#define MODBUS_AGGREGATE_ONE(index, entry, reg, window_s, type) +1
+
+/** @brief Number of aggregates */
+#define MODBUS_AGGREGATE_COUNT (0 MODBUS_AGGREGATE_LIST(MODBUS_AGGREGATE_ONE))
+
+/** @brief Number of reportable statistics attributes */
+#define MODBUS_AGGREGATE_REPORT_ATTR_COUNT (MODBUS_AGGREGATE_COUNT * MODBUS_AGGREGATE_FIELD_COUNT)
+
+/** @brief Attribute storage, indexed by aggregate index */
+extern struct modbus_aggregate_result modbus_aggregate_results[MODBUS_AGGREGATE_COUNT];
+
+#define MODBUS_AGGREGATE_ATTR_ACCESS (ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_ACCESS_REPORTING | ZB_ZCL_ATTR_MANUF_SPEC)
+
+#define MODBUS_AGGREGATE_ATTR_DESC(index, entry, reg, window_s, type)                                                                                                                                                                                    \
+    { MODBUS_AGGREGATE_ATTR_ID(index, MODBUS_AGGREGATE_FIELD_MIN), ZB_ZCL_ATTR_TYPE_S32, MODBUS_AGGREGATE_ATTR_ACCESS, (void*)&modbus_aggregate_results[index].min },                                                                                    \
+        { MODBUS_AGGREGATE_ATTR_ID(index, MODBUS_AGGREGATE_FIELD_MAX), ZB_ZCL_ATTR_TYPE_S32, MODBUS_AGGREGATE_ATTR_ACCESS, (void*)&modbus_aggregate_results[index].max },                                                                                \
+        { MODBUS_AGGREGATE_ATTR_ID(index, MODBUS_AGGREGATE_FIELD_MEAN), ZB_ZCL_ATTR_TYPE_S32, MODBUS_AGGREGATE_ATTR_ACCESS, (void*)&modbus_aggregate_results[index].mean },                                                                              \
+        { MODBUS_AGGREGATE_ATTR_ID(index, MODBUS_AGGREGATE_FIELD_SAMPLES), ZB_ZCL_ATTR_TYPE_U16, MODBUS_AGGREGATE_ATTR_ACCESS, (void*)&modbus_aggregate_results[index].count },                                                                          \
+        { MODBUS_AGGREGATE_ATTR_ID(index, MODBUS_AGGREGATE_FIELD_RATE), ZB_ZCL_ATTR_TYPE_S32, MODBUS_AGGREGATE_ATTR_ACCESS, (void*)&modbus_aggregate_results[index].rate },
+
+/** @brief Attribute descriptors of all statistics, for @ref ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT */
+#define MODBUS_AGGREGATE_ATTR_DESC_LIST MODBUS_AGGREGATE_LIST(MODBUS_AGGREGATE_ATTR_DESC)
+
+/** @brief Start the first windows.
+ *
+ *  @param endpoint  Endpoint of the Modbus cluster server holding the attributes.
+ */
+void modbus_aggregate_init(uint8_t endpoint);
+
+/** @brief Add a poll result. Must be called from the Zigbee stack context.
+ *
+ *  @param entry    Poll list index.
+ *  @param values   Register values.
+ *  @param nb_regs  Number of registers.
+ */
+void modbus_aggregate_add(uint8_t entry, const uint16_t* values, uint8_t nb_regs);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_AGGREGATE_H */
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_CLIENT_H
+#define MODBUS_CLIENT_H
+
+/** @file modbus_client.h
+ * @brief Modbus client (master) transaction queue.
+ * @defgroup modbus_client Modbus client
+ * @{
+ *
+ * Transactions are queued from the Zigbee stack context and executed on the
+ * bus by a dedicated thread. When a transaction is finished, the callback
+ * stored in the queue item is scheduled in the Zigbee stack context with the
+ * index of the item as parameter.
+ *
+ * The bus timeout follows the response times measured for each slave. A
+ * transaction whose deadline passed while it was queued, or that was
+ * cancelled, is finished without touching the bus.
+ *
+ * A slave that misses CONFIG_APP_MODBUS_SLAVE_OFFLINE_TIMEOUTS answers in a
+ * row is offline: its transactions fail at once with a gateway target
+ * exception, except for one probe every CONFIG_APP_MODBUS_SLAVE_PROBE_INTERVAL_S
+ * seconds, until it answers again. The statistics of the slaves are
+ * manufacturer-specific attributes of the Modbus cluster server, see
+ * @ref MODBUS_CLIENT_SLAVE_ATTR_ID.
+ */
+
+#include <stdbool.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/types.h>
+
+#include "zb_zcl_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Number of slaves whose response times are tracked, the least recently used one is replaced */
+#define MODBUS_CLIENT_SLAVE_COUNT 8
+
+/** @brief First attribute identifier of the slave statistics attributes */
+#define MODBUS_CLIENT_SLAVE_ATTR_BASE 0x0200
+
+/** @brief Attribute identifier of a statistic of a tracked slave */
+#define MODBUS_CLIENT_SLAVE_ATTR_ID(index, field) (MODBUS_CLIENT_SLAVE_ATTR_BASE + ((index) << 4) + (field))
+
+/** @brief Statistics of a slave, offset of their attribute identifier */
+enum modbus_client_slave_field
+{
+    MODBUS_CLIENT_SLAVE_FIELD_ID = 0,   /**< Slave ID, uint8, 0 if the entry is unused */
+    MODBUS_CLIENT_SLAVE_FIELD_STATE,    /**< @ref modbus_client_slave_state, enum8 */
+    MODBUS_CLIENT_SLAVE_FIELD_SRTT,     /**< Smoothed response time [ms], uint16 */
+    MODBUS_CLIENT_SLAVE_FIELD_RTTVAR,   /**< Mean deviation of the response time [ms], uint16 */
+    MODBUS_CLIENT_SLAVE_FIELD_TIMEOUT,  /**< Bus timeout of the next transaction, without the line time of its frames [ms], uint16 */
+    MODBUS_CLIENT_SLAVE_FIELD_ANSWERS,  /**< Answers received, uint32 */
+    MODBUS_CLIENT_SLAVE_FIELD_TIMEOUTS, /**< Timeouts, uint32 */
+};
+
+/** @brief Slave state */
+enum modbus_client_slave_state
+{
+    MODBUS_CLIENT_SLAVE_UNKNOWN = 0, /**< Has not answered yet */
+    MODBUS_CLIENT_SLAVE_ONLINE,      /**< Answered the last transaction */
+    MODBUS_CLIENT_SLAVE_OFFLINE,     /**< Missed too many answers in a row */
+};
+
+/** @brief Response time statistics of a slave */
+struct modbus_client_slave_stats {
+    uint8_t  slave_id;
+    uint8_t  state;
+    uint16_t srtt_ms;
+    uint16_t rttvar_ms;
+    uint16_t timeout_ms;
+    uint32_t answers;
+    uint32_t timeouts;
+};
+
+/** @brief Attribute storage */
+extern struct modbus_client_slave_stats modbus_client_slave_stats[MODBUS_CLIENT_SLAVE_COUNT];
+
+#define MODBUS_CLIENT_SLAVE_ATTR_ACCESS (ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_MANUF_SPEC)
+
+#define MODBUS_CLIENT_SLAVE_ATTR_DESC(index, _)                                                                                                                                                                                                          \
+    { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_ID), ZB_ZCL_ATTR_TYPE_U8, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].slave_id },                                                                       \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_STATE), ZB_ZCL_ATTR_TYPE_8BIT_ENUM, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].state },                                                            \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_SRTT), ZB_ZCL_ATTR_TYPE_U16, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].srtt_ms },                                                                 \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_RTTVAR), ZB_ZCL_ATTR_TYPE_U16, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].rttvar_ms },                                                             \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_TIMEOUT), ZB_ZCL_ATTR_TYPE_U16, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].timeout_ms },                                                           \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_ANSWERS), ZB_ZCL_ATTR_TYPE_U32, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].answers },                                                              \
+        { MODBUS_CLIENT_SLAVE_ATTR_ID(index, MODBUS_CLIENT_SLAVE_FIELD_TIMEOUTS), ZB_ZCL_ATTR_TYPE_U32, MODBUS_CLIENT_SLAVE_ATTR_ACCESS, (void*)&modbus_client_slave_stats[index].timeouts },
+
+/** @brief Attribute descriptors of the statistics of all tracked slaves, for @ref ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT */
+#define MODBUS_CLIENT_SLAVE_ATTR_DESC_LIST LISTIFY(MODBUS_CLIENT_SLAVE_COUNT, MODBUS_CLIENT_SLAVE_ATTR_DESC, ())
+
+/** @brief Initialize the Modbus client on the configured interface.
+ *
+ *  @param baudrate  Baudrate attribute value of the Modbus cluster.
+ *
+ *  @retval 0           If the operation was successful.
+ *                      Otherwise, a (negative) error code is returned.
+ */
+int modbus_client_init(zb_zcl_modbus_baudrate_t baudrate);
+
+/** @brief Change the baudrate of the bus.
+ *
+ *  The change is applied by the client thread before the next transaction,
+ *  so a transaction in progress completes at the previous baudrate.
+ *
+ *  @param baudrate  Baudrate attribute value of the Modbus cluster.
+ *
+ *  @retval 0        If the change was scheduled.
+ *  @retval -ENODEV  If the client has not been initialized.
+ */
+int modbus_client_set_baudrate(zb_zcl_modbus_baudrate_t baudrate);
+
+/** @brief Allocate a queue item.
+ *
+ *  @return Queue item, or NULL if all items are in use.
+ */
+modbus_cmd_resp_queue_data_t* modbus_client_alloc(void);
+
+/** @brief Release a queue item. */
+void modbus_client_free(modbus_cmd_resp_queue_data_t* item);
+
+/** @brief Get a queue item from the index passed to its callback. */
+modbus_cmd_resp_queue_data_t* modbus_client_get(zb_uint8_t idx);
+
+/** @brief Queue a transaction for execution on the bus.
+ *
+ *  The request is taken from @p item->resp, and its registers from
+ *  @p item->regs if set. When it has been executed, @p item->resp holds the
+ *  result and @p item->cb is scheduled in the Zigbee stack context. If @p item->deadline passes before the transaction is
+ *  executed, it is finished with err -ETIME.
+ *
+ *  @retval 0           If the operation was successful.
+ *                      Otherwise, a (negative) error code is returned.
+ */
+int modbus_client_submit(modbus_cmd_resp_queue_data_t* item);
+
+/** @brief Get the number of times the interface was reconfigured for a new baudrate or bus timeout. */
+uint32_t modbus_client_get_reconfigs(void);
+
+/** @brief Select the transactions to cancel, see @ref modbus_client_cancel. */
+typedef bool (*modbus_client_match_t)(const modbus_cmd_resp_queue_data_t* item, const void* ctx);
+
+/** @brief Cancel queued transactions.
+ *
+ *  Transactions selected by @p match that are not yet executed are finished
+ *  without touching the bus: @p item->resp.err is set to -ECANCELED and
+ *  @p item->cb is scheduled as for any other transaction.
+ *
+ *  @param match  Called for every queued transaction.
+ *  @param ctx    Passed to @p match.
+ *
+ *  @return Number of transactions cancelled.
+ */
+int modbus_client_cancel(modbus_client_match_t match, const void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_CLIENT_H */
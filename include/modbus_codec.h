@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_CODEC_H
+#define MODBUS_CODEC_H
+
+/** @file modbus_codec.h
+ * @brief Compressed encoding of register values against a baseline.
+ * @defgroup modbus_codec Modbus register codec
+ * @{
+ *
+ * Encoded values are a bitmap of the registers that differ from the
+ * baseline, one bit per register starting with the least significant bit of
+ * the first byte, followed by the zigzag varint of the 16-bit difference to
+ * the baseline of every register set in the bitmap. Without a baseline, the
+ * values are encoded against zero.
+ *
+ * The codec has no dependencies on the Zigbee stack or the kernel.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "modbus_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Size of the changed register bitmap */
+#define MODBUS_CODEC_BITMAP_LEN(nb_regs) (((nb_regs) + 7) / 8)
+
+/** @brief Maximum encoded size */
+#define MODBUS_CODEC_MAX_LEN(nb_regs) (MODBUS_CODEC_BITMAP_LEN(nb_regs) + 3 * (nb_regs))
+
+/** @brief Room for the encoded values in a read compressed response: the command string, less the data packet header and the baseline tags (zb_zcl_modbus.h) */
+#define MODBUS_CODEC_FRAME_LEN (MODBUS_FRAME_STRING_MAX_LEN - MODBUS_FRAME_RESP_HDR_LEN - 2)
+
+/** @brief Maximum number of registers in a read compressed response, so that the worst case encoding fits in MODBUS_CODEC_FRAME_LEN */
+#define MODBUS_CODEC_FRAME_MAX_REGS ((MODBUS_CODEC_FRAME_LEN - 5) / 3)
+
+/** @brief Encode register values.
+ *
+ *  @param values    Register values.
+ *  @param baseline  Values known to the receiver, or NULL.
+ *  @param nb_regs   Number of registers.
+ *  @param out       Output buffer.
+ *  @param size      Size of @p out.
+ *
+ *  @return Encoded length, or -ENOSPC if @p out is too small.
+ */
+int modbus_codec_encode(const uint16_t* values, const uint16_t* baseline, uint8_t nb_regs, uint8_t* out, size_t size);
+
+/** @brief Decode register values.
+ *
+ *  @param in        Encoded values.
+ *  @param len       Length of @p in.
+ *  @param baseline  Baseline the values were encoded against, or NULL.
+ *  @param nb_regs   Number of registers.
+ *  @param values    Decoded register values.
+ *
+ *  @return Number of bytes consumed, or -EINVAL if @p in is malformed.
+ */
+int modbus_codec_decode(const uint8_t* in, size_t len, const uint16_t* baseline, uint8_t nb_regs, uint16_t* values);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_CODEC_H */
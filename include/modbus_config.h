@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_CONFIG_H
+#define MODBUS_CONFIG_H
+
+/** @file modbus_config.h
+ * @brief Persistent Modbus configuration.
+ * @defgroup modbus_config Modbus configuration
+ * @{
+ *
+ * The Modbus cluster baudrate and request timeout, the channel of the last
+ * network joined and, with the rules engine, the rules program are stored
+ * in the ZBOSS NVRAM application dataset. The dataset is loaded by the stack
+ * on start, before the network is joined, so the configuration is restored
+ * without any Zigbee traffic.
+ *
+ * The network itself is restored by the stack. The stored channel is only
+ * used when the device has to search for a network again: it is scanned
+ * first, and the other channels of the channel mask only if the network is
+ * not found there.
+ *
+ * Changes are written behind: the first change after a write starts a
+ * timer, and all changes made until it expires are stored with a single
+ * dataset write.
+ */
+
+#include "zb_zcl_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Register the NVRAM dataset. Must be called before the Zigbee stack is started.
+ *
+ *  @param attrs  Modbus cluster attributes restored from and stored to NVRAM.
+ */
+void modbus_config_init(zb_zcl_modbus_attrs_t* attrs);
+
+/** @brief Update the channel of the network joined. Must be called from the Zigbee stack context.
+ *
+ *  @param channel  Current channel.
+ */
+void modbus_config_set_channel(zb_uint8_t channel);
+
+/** @brief Schedule a write of the configuration. Must be called from the Zigbee stack context. */
+void modbus_config_changed(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_CONFIG_H */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_FRAME_H
+#define MODBUS_FRAME_H
+
+/** @file modbus_frame.h
+ * @brief Decoding of Modbus cluster command payloads.
+ * @defgroup modbus_frame Modbus cluster frame decoding
+ * @{
+ *
+ * Modbus cluster commands carry a length-prefixed string, which holds a
+ * request data packet (fc, slave_id, addr, nb_regs, the values of writes
+ * and an optional deadline) or a response data packet header (fc, slave_id,
+ * addr, err, nb_regs) followed by command specific data. All values are
+ * little endian, see zb_zcl_modbus.h.
+ *
+ * Every length is checked against the received frame before it is used.
+ * The decoders do not copy: the results point into the frame, which must
+ * stay valid while they are used. They have no dependencies on the Zigbee
+ * stack or the kernel, so they can be built and fuzzed on the host with
+ * scripts/modbus_frame_fuzz.c.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum length of a command string */
+#define MODBUS_FRAME_STRING_MAX_LEN 82
+
+/** @brief Maximum number of registers in a response that fits in a command string */
+#define MODBUS_FRAME_MAX_REGS ((MODBUS_FRAME_STRING_MAX_LEN - MODBUS_FRAME_RESP_HDR_LEN) / 2)
+
+/** @brief Size of a request data packet without values or deadline */
+#define MODBUS_FRAME_REQ_HDR_LEN 5
+
+/** @brief Size of a response data packet header */
+#define MODBUS_FRAME_RESP_HDR_LEN 7
+
+/** @brief Size of the optional deadline of a request */
+#define MODBUS_FRAME_DEADLINE_LEN 2
+
+/** @brief Decoded request data packet. */
+struct modbus_frame_request {
+    uint8_t        fc;
+    uint8_t        slave_id;
+    uint16_t       addr;
+    uint8_t        nb_regs;
+    bool           has_deadline;
+    uint16_t       deadline_ms;
+    const uint8_t* values; /**< nb_regs words to write, NULL for other function codes */
+};
+
+/** @brief Decoded response data packet header. */
+struct modbus_frame_response {
+    uint8_t        fc;
+    uint8_t        slave_id;
+    uint16_t       addr;
+    int16_t        err;
+    uint8_t        nb_regs;
+    const uint8_t* data; /**< Command specific data following the header */
+    size_t         len;  /**< Length of @p data */
+};
+
+/** @brief Get the string of a command payload.
+ *
+ *  @param buf      Command payload, without ZCL header.
+ *  @param len      Length of @p buf.
+ *  @param max_len  Longest string accepted.
+ *  @param str      Set to the first byte of the string.
+ *
+ *  @return Length of the string, -EINVAL if @p buf is shorter than the string
+ *          or -EMSGSIZE if the string is longer than @p max_len.
+ */
+int modbus_frame_string(const uint8_t* buf, size_t len, size_t max_len, const uint8_t** str);
+
+/** @brief Decode a request data packet.
+ *
+ *  @param data      Data packet.
+ *  @param len       Length of @p data.
+ *  @param max_regs  Largest number of registers accepted.
+ *  @param req       Decoded request.
+ *
+ *  @return 0, or -EINVAL if the packet is malformed.
+ */
+int modbus_frame_parse_request(const uint8_t* data, size_t len, uint8_t max_regs, struct modbus_frame_request* req);
+
+/** @brief Decode a response data packet header.
+ *
+ *  @param data  Data packet.
+ *  @param len   Length of @p data.
+ *  @param resp  Decoded header.
+ *
+ *  @return 0, or -EINVAL if @p data is shorter than the header.
+ */
+int modbus_frame_parse_response(const uint8_t* data, size_t len, struct modbus_frame_response* resp);
+
+/** @brief Get a little endian word. */
+static inline uint16_t modbus_frame_get_le16(const uint8_t* src) {
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+/** @brief Put a little endian word. */
+static inline void modbus_frame_put_le16(uint8_t* dst, uint16_t value) {
+    dst[0] = (uint8_t)(value & 0xFF);
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_FRAME_H */
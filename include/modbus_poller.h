@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_POLLER_H
+#define MODBUS_POLLER_H
+
+/** @file modbus_poller.h
+ * @brief Periodic polling of the registers listed in MODBUS_POLL_LIST.
+ * @defgroup modbus_poller Modbus poller
+ * @{
+ *
+ * Every poll interval, each entry of the poll list is read through the
+ * Modbus client queue and successful reads are passed to the sample log, the
+ * aggregation and the rules engine, whichever are enabled.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Start polling. Must be called from the Zigbee stack context.
+ *
+ *  Calls after the first one have no effect.
+ */
+void modbus_poller_start(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_POLLER_H */
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_REGMAP_H
+#define MODBUS_REGMAP_H
+
+/** @file modbus_regmap.h
+ * @brief Compile-time register maps of the Modbus slaves on the bus.
+ * @defgroup modbus_regmap Modbus register maps
+ * @{
+ *
+ * Register maps are declared in modbus_regmap_defs.h and expanded into
+ * constant tables at build time. They are used to reject requests that do
+ * not match the register layout of a slave before they reach the bus, and
+ * to decode raw register words into typed, scaled values.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @name Modbus function codes for register access
+ * @{
+ */
+#define MODBUS_FC_READ_HOLDING_REGS  0x03
+#define MODBUS_FC_READ_INPUT_REGS    0x04
+#define MODBUS_FC_WRITE_HOLDING_REG  0x06
+#define MODBUS_FC_WRITE_HOLDING_REGS 0x10
+/** @} */
+
+/** @brief Register address space. */
+enum modbus_reg_space
+{
+    MODBUS_REG_SPACE_HOLDING, /**< Holding registers (FC 3, 6, 16) */
+    MODBUS_REG_SPACE_INPUT,   /**< Input registers (FC 4) */
+};
+
+/** @brief Register value type. */
+enum modbus_reg_type
+{
+    MODBUS_REG_TYPE_U16,
+    MODBUS_REG_TYPE_I16,
+    MODBUS_REG_TYPE_U32,
+    MODBUS_REG_TYPE_I32,
+    MODBUS_REG_TYPE_FLOAT32,
+    MODBUS_REG_TYPE_BITFIELD,
+};
+
+/** @brief Word order of 32-bit values. */
+enum modbus_word_order
+{
+    MODBUS_WORD_ORDER_HL, /**< High word at the lower address */
+    MODBUS_WORD_ORDER_LH, /**< Low word at the lower address */
+};
+
+/** @brief Engineering unit of a register value. */
+enum modbus_reg_unit
+{
+    MODBUS_UNIT_NONE,
+    MODBUS_UNIT_CELSIUS,
+    MODBUS_UNIT_PERCENT,
+    MODBUS_UNIT_RPM,
+    MODBUS_UNIT_PPM,
+    MODBUS_UNIT_PASCAL,
+    MODBUS_UNIT_HOURS,
+    MODBUS_UNIT_M3_PER_HOUR,
+};
+
+#define MODBUS_REG_ACCESS_R  0x01
+#define MODBUS_REG_ACCESS_W  0x02
+#define MODBUS_REG_ACCESS_RW (MODBUS_REG_ACCESS_R | MODBUS_REG_ACCESS_W)
+
+/** @brief Register map entry. */
+struct modbus_reg_desc {
+    uint16_t addr;       /**< First register address */
+    uint8_t  space;      /**< @ref modbus_reg_space */
+    uint8_t  type;       /**< @ref modbus_reg_type */
+    uint8_t  word_order; /**< @ref modbus_word_order, 32-bit types only */
+    int8_t   scale;      /**< Decimal exponent: value = raw * 10^scale */
+    uint8_t  unit;       /**< @ref modbus_reg_unit */
+    uint8_t  access;     /**< MODBUS_REG_ACCESS_* flags */
+};
+
+/** @brief Register map of one slave type, sorted by space and address. */
+struct modbus_regmap {
+    const struct modbus_reg_desc* regs;
+    uint16_t                      count;
+};
+
+/** @brief Decoded register value. */
+struct modbus_reg_value {
+    int32_t value; /**< Fixed-point value, multiply by 10^scale for the unit value */
+    int8_t  scale; /**< Decimal exponent */
+    uint8_t type;  /**< @ref modbus_reg_type */
+    uint8_t unit;  /**< @ref modbus_reg_unit */
+};
+
+/** @brief Number of 16-bit registers taken by a value of the given type. */
+#define MODBUS_REG_TYPE_WORDS(type) (((type) == MODBUS_REG_TYPE_U32 || (type) == MODBUS_REG_TYPE_I32 || (type) == MODBUS_REG_TYPE_FLOAT32) ? 2 : 1)
+
+/** @brief Get the register map of a slave.
+ *
+ *  @param slave_id  Modbus unit identifier.
+ *
+ *  @return Register map, or NULL if the slave has no register map.
+ */
+const struct modbus_regmap* modbus_regmap_get(uint8_t slave_id);
+
+/** @brief Check a request against a register map.
+ *
+ *  The range must start on an entry, cover whole entries without gaps and
+ *  every entry must allow the access implied by the function code.
+ *
+ *  @param map      Register map.
+ *  @param fc       Modbus function code.
+ *  @param addr     First register address.
+ *  @param nb_regs  Number of registers.
+ *
+ *  @return Number of values in the range, or -EINVAL if the range does not
+ *          match the map.
+ */
+int modbus_regmap_validate(const struct modbus_regmap* map, uint8_t fc, uint16_t addr, uint16_t nb_regs);
+
+/** @brief Decode raw registers into typed values.
+ *
+ *  The range must have been accepted by @ref modbus_regmap_validate.
+ *
+ *  @param map      Register map.
+ *  @param fc       Modbus function code used to read the registers.
+ *  @param addr     First register address.
+ *  @param words    Raw register words.
+ *  @param nb_regs  Number of raw register words.
+ *  @param values   Output values.
+ *  @param max      Capacity of @p values.
+ *
+ *  @return Number of decoded values, or -EINVAL on error.
+ */
+int modbus_regmap_decode(const struct modbus_regmap* map, uint8_t fc, uint16_t addr, const uint16_t* words, uint16_t nb_regs, struct modbus_reg_value* values, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_REGMAP_H */
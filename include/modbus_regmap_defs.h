@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_REGMAP_DEFS_H
+#define MODBUS_REGMAP_DEFS_H
+
+/** @file modbus_regmap_defs.h
+ * @brief Register maps of the Modbus slave types and the slaves on the bus.
+ *
+ * Every slave type is described by one X-macro list named
+ * MODBUS_REGMAP_<type>. Entries have the form
+ *
+ *     REG(space, addr, type, word_order, scale, unit, access)
+ *
+ * using the suffixes of @ref modbus_reg_space, @ref modbus_reg_type,
+ * @ref modbus_word_order, @ref modbus_reg_unit and MODBUS_REG_ACCESS_*.
+ * Entries must be sorted by space (holding first), then by address.
+ *
+ * Slaves without an entry in MODBUS_SLAVES are passed through unchecked.
+ */
+
+/* Ventilation unit */
+#define MODBUS_REGMAP_VENTILATION_UNIT(REG)                                                                                                                                                                                                              \
+    REG(HOLDING, 0x0000, U16, HL, 0, PERCENT, RW)      /* Fan speed setpoint */                                                                                                                                                                          \
+    REG(HOLDING, 0x0001, I16, HL, -1, CELSIUS, RW)     /* Supply air temperature setpoint */                                                                                                                                                             \
+    REG(HOLDING, 0x0002, U16, HL, 0, PPM, RW)          /* CO2 boost threshold */                                                                                                                                                                         \
+    REG(HOLDING, 0x0003, BITFIELD, HL, 0, NONE, RW)    /* Operating mode flags */                                                                                                                                                                        \
+    REG(INPUT, 0x0000, I16, HL, -1, CELSIUS, R)        /* Supply air temperature */                                                                                                                                                                      \
+    REG(INPUT, 0x0001, I16, HL, -1, CELSIUS, R)        /* Extract air temperature */                                                                                                                                                                     \
+    REG(INPUT, 0x0002, U16, HL, 0, PPM, R)             /* CO2 concentration */                                                                                                                                                                           \
+    REG(INPUT, 0x0003, U16, HL, 0, RPM, R)             /* Supply fan speed */                                                                                                                                                                            \
+    REG(INPUT, 0x0004, U16, HL, 0, RPM, R)             /* Extract fan speed */                                                                                                                                                                           \
+    REG(INPUT, 0x0005, BITFIELD, HL, 0, NONE, R)       /* Alarm flags */                                                                                                                                                                                 \
+    REG(INPUT, 0x0006, U32, HL, 0, HOURS, R)           /* Operating hours */                                                                                                                                                                             \
+    REG(INPUT, 0x0008, FLOAT32, HL, -1, PASCAL, R)     /* Filter pressure drop */                                                                                                                                                                        \
+    REG(INPUT, 0x000A, FLOAT32, HL, 0, M3_PER_HOUR, R) /* Air flow */
+
+/* Slave types with a register map */
+#define MODBUS_REGMAP_TYPES(TYPE) TYPE(VENTILATION_UNIT)
+
+/* Slaves on the bus: SLAVE(unit_id, type) */
+#define MODBUS_SLAVES(SLAVE) SLAVE(1, VENTILATION_UNIT)
+
+/* Registers sampled periodically into the sample log: POLL(unit_id, fc, addr, nb_regs)
+ * with fc READ_HOLDING_REGS or READ_INPUT_REGS. The position in the list is the
+ * index stored with every sample.
+ */
+#define MODBUS_POLL_LIST(POLL)                                                                                                                                                                                                                           \
+    POLL(1, READ_INPUT_REGS, 0x0000, 6)   /* Temperatures, CO2, fan speeds, alarms */                                                                                                                                                                    \
+    POLL(1, READ_INPUT_REGS, 0x0008, 4)   /* Filter pressure drop, air flow */                                                                                                                                                                           \
+    POLL(1, READ_HOLDING_REGS, 0x0000, 4) /* Setpoints and operating mode */
+
+/* Polled registers aggregated over tumbling windows: AGG(index, poll_entry, reg, window_s, type)
+ * with reg the offset of the register in the poll list entry and type U16 or I16.
+ * Indexes must be consecutive from 0, they select the statistics attributes.
+ */
+#define MODBUS_AGGREGATE_LIST(AGG)                                                                                                                                                                                                                       \
+    AGG(0, 0, 0, 60, I16)  /* Supply air temperature */                                                                                                                                                                                                  \
+    AGG(1, 0, 1, 60, I16)  /* Extract air temperature */                                                                                                                                                                                                 \
+    AGG(2, 0, 2, 60, U16)  /* CO2 concentration */                                                                                                                                                                                                       \
+    AGG(3, 0, 3, 300, U16) /* Supply fan speed */
+
+#endif /* MODBUS_REGMAP_DEFS_H */
@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_SERVER_H
+#define MODBUS_SERVER_H
+
+/** @file modbus_server.h
+ * @brief Modbus server exposing the device's own state as registers.
+ * @defgroup modbus_server Modbus server
+ * @{
+ */
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Register map of the Modbus server.
+ *
+ * The same map is served as input registers (FC 4) and holding registers
+ * (FC 3). All registers are read-only. 32-bit values are split over two
+ * registers, high word first.
+ */
+enum modbus_server_reg
+{
+    MODBUS_SERVER_REG_NETWORK_STATE = 0,      /**< 1 if joined to a Zigbee network */
+    MODBUS_SERVER_REG_LQI,                    /**< LQI of the link to the coordinator */
+    MODBUS_SERVER_REG_RSSI,                   /**< RSSI of the link to the coordinator, signed */
+    MODBUS_SERVER_REG_HALL_SENSOR,            /**< Hall sensor button bitmask */
+    MODBUS_SERVER_REG_CMD_RECEIVED_HI,
+    MODBUS_SERVER_REG_CMD_RECEIVED_LO,
+    MODBUS_SERVER_REG_CMD_REJECTED_HI,
+    MODBUS_SERVER_REG_CMD_REJECTED_LO,
+    MODBUS_SERVER_REG_RESP_SENT_HI,
+    MODBUS_SERVER_REG_RESP_SENT_LO,
+    MODBUS_SERVER_REG_BUS_ERRORS_HI,
+    MODBUS_SERVER_REG_BUS_ERRORS_LO,
+    MODBUS_SERVER_REG_CMD_DUPLICATES_HI,
+    MODBUS_SERVER_REG_CMD_DUPLICATES_LO,
+    MODBUS_SERVER_REG_BOOT_JOINED_HI,         /**< Time from reset to joined [ms], 0 if not yet */
+    MODBUS_SERVER_REG_BOOT_JOINED_LO,
+    MODBUS_SERVER_REG_BOOT_FIRST_RESPONSE_HI, /**< Time from reset to the first Modbus cluster response [ms], 0 if not yet */
+    MODBUS_SERVER_REG_BOOT_FIRST_RESPONSE_LO,
+    MODBUS_SERVER_REG_RELAYED_HI,             /**< Relay counters, see relay_stats.h, not available without CONFIG_APP_RELAY_STATS */
+    MODBUS_SERVER_REG_RELAYED_LO,
+    MODBUS_SERVER_REG_BUF_ALLOC_FAIL_HI,
+    MODBUS_SERVER_REG_BUF_ALLOC_FAIL_LO,
+    MODBUS_SERVER_REG_BUF_LOW_S_HI,
+    MODBUS_SERVER_REG_BUF_LOW_S_LO,
+    MODBUS_SERVER_REG_NWK_RETRY_OVERFLOW_HI,
+    MODBUS_SERVER_REG_NWK_RETRY_OVERFLOW_LO,
+    MODBUS_SERVER_REG_BCAST_TABLE_FULL_HI,
+    MODBUS_SERVER_REG_BCAST_TABLE_FULL_LO,
+    MODBUS_SERVER_REG_MAC_TX_FAIL_HI,
+    MODBUS_SERVER_REG_MAC_TX_FAIL_LO,
+    MODBUS_SERVER_REG_MAC_RX_DROP_HI,
+    MODBUS_SERVER_REG_MAC_RX_DROP_LO,
+    MODBUS_SERVER_REG_CMD_EXPIRED_HI,         /**< Modbus cluster requests expired in the queue */
+    MODBUS_SERVER_REG_CMD_EXPIRED_LO,
+    MODBUS_SERVER_REG_CMD_CANCELLED_HI,       /**< Modbus cluster requests cancelled */
+    MODBUS_SERVER_REG_CMD_CANCELLED_LO,
+    MODBUS_SERVER_REG_BUS_RECONFIGS_HI,       /**< Reconfigurations of the Modbus client interface */
+    MODBUS_SERVER_REG_BUS_RECONFIGS_LO,
+    MODBUS_SERVER_REG_COUNT,
+};
+
+/** @brief Initialize the Modbus server on the configured interface.
+ *
+ *  @retval 0           If the operation was successful.
+ *                      Otherwise, a (negative) error code is returned.
+ */
+int modbus_server_init(void);
+
+/** @brief Update the network state exposed by the Modbus server.
+ *
+ *  Must be called from the Zigbee stack context. The first call with
+ *  @p joined set starts the periodic link quality sampling.
+ *
+ *  @param joined  True if the device is joined to a Zigbee network.
+ */
+void modbus_server_set_network_state(bool joined);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_SERVER_H */
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_SNAPSHOT_H
+#define MODBUS_SNAPSHOT_H
+
+/** @file modbus_snapshot.h
+ * @brief Configuration snapshot and restore of Modbus slaves.
+ * @defgroup modbus_snapshot Modbus configuration snapshot
+ * @{
+ *
+ * A snapshot holds the writable holding registers of the register map of a
+ * slave, read in ranges of consecutive registers. It is stored in the ZBOSS
+ * NVRAM application dataset 2, can be exported and imported with the Modbus
+ * cluster snapshot command, and is restored to a slave with one write
+ * multiple registers request per range, each verified by reading the range
+ * back. All fields are little endian:
+ *
+ *     uint8   MODBUS_SNAPSHOT_VERSION
+ *     uint8   slave_id the snapshot was captured from
+ *     uint16  number of registers
+ *     uint16  CRC-16/CCITT (seed 0xFFFF) of the ranges
+ *     ranges, each:
+ *         uint16    addr
+ *         uint8     nb_regs, 1 to MODBUS_SNAPSHOT_RANGE_MAX
+ *         uint16[]  values
+ *
+ * One capture or restore runs at a time.
+ */
+
+#include "zb_zcl_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Snapshot format version */
+#define MODBUS_SNAPSHOT_VERSION 1
+
+/** @brief Size of the snapshot header */
+#define MODBUS_SNAPSHOT_HDR_LEN 6
+
+/** @brief Maximum number of registers of a range, the write multiple registers limit */
+#define MODBUS_SNAPSHOT_RANGE_MAX 123
+
+/** @brief Register the NVRAM dataset. Must be called before the Zigbee stack is started. */
+void modbus_snapshot_init(void);
+
+/** @brief Capture a snapshot of a slave. Must be called from the Zigbee stack context.
+ *
+ *  The stored snapshot is replaced once every range has been read, an import
+ *  in progress is dropped. A snapshot response is sent to @p addr when the
+ *  capture ends, with err -EFBIG if the snapshot is larger than
+ *  CONFIG_APP_MODBUS_SNAPSHOT_MAX_SIZE.
+ *
+ *  @param addr      Requester.
+ *  @param slave_id  Modbus unit identifier.
+ *
+ *  @retval 0        The capture started.
+ *  @retval -EBUSY   A capture or restore is in progress.
+ *  @retval -ENOENT  The slave has no writable holding registers in its register map.
+ */
+int modbus_snapshot_capture(const zb_zcl_modbus_addr_t* addr, zb_uint8_t slave_id);
+
+/** @brief Restore the stored snapshot to a slave. Must be called from the Zigbee stack context.
+ *
+ *  The slave may differ from the one the snapshot was captured from. A
+ *  snapshot response is sent to @p addr when the restore ends.
+ *
+ *  @param addr      Requester.
+ *  @param slave_id  Modbus unit identifier.
+ *
+ *  @retval 0        The restore started.
+ *  @retval -EBUSY   A capture or restore is in progress.
+ *  @retval -ENOENT  No snapshot is stored.
+ *  @retval -EINVAL  A range does not match the register map of the slave.
+ */
+int modbus_snapshot_restore(const zb_zcl_modbus_addr_t* addr, zb_uint8_t slave_id);
+
+/** @brief Send a part of the stored snapshot in a snapshot response. Must be called from the Zigbee stack context.
+ *
+ *  @param addr    Requester.
+ *  @param offset  Offset in the snapshot.
+ *
+ *  @retval 0        The response will be sent.
+ *  @retval -EBUSY   An export is waiting for a buffer.
+ *  @retval -ENOENT  No snapshot is stored.
+ *  @retval -EINVAL  @p offset is past the end of the snapshot.
+ */
+int modbus_snapshot_export(const zb_zcl_modbus_addr_t* addr, zb_uint16_t offset);
+
+/** @brief Store a chunk of an imported snapshot. Must be called from the Zigbee stack context.
+ *
+ *  Chunks must be sent in order, a whole snapshot may be a single chunk.
+ *  The snapshot replaces the stored one once its last chunk has been
+ *  received and it has been validated. A total length of 0 removes the
+ *  stored snapshot.
+ *
+ *  @param offset  Offset of the chunk in the snapshot.
+ *  @param total   Length of the snapshot.
+ *  @param data    Chunk.
+ *  @param len     Length of the chunk.
+ *
+ *  @retval 0        If the chunk was stored, or the snapshot was loaded.
+ *  @retval -EBUSY   A capture or restore is in progress.
+ *  @retval -EINVAL  If the chunk is out of order, its total length differs from the one of the first chunk, or the snapshot is invalid.
+ *  @retval -EFBIG   If the snapshot is larger than CONFIG_APP_MODBUS_SNAPSHOT_MAX_SIZE.
+ */
+int modbus_snapshot_import(zb_uint16_t offset, zb_uint16_t total, const zb_uint8_t* data, zb_uint16_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_SNAPSHOT_H */
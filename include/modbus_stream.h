@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_STREAM_H
+#define MODBUS_STREAM_H
+
+/** @file modbus_stream.h
+ * @brief Streaming read of large register ranges.
+ * @defgroup modbus_stream Modbus stream transfer
+ * @{
+ *
+ * A stream transfer reads a register range of any length in chunks of
+ * CONFIG_APP_MODBUS_STREAM_CHUNK_REGS registers and sends every chunk to the
+ * requester in an APS fragmented stream data frame. Up to the window of the
+ * requester, capped at CONFIG_APP_MODBUS_STREAM_WINDOW, chunks are read and
+ * sent ahead of the acknowledgements, so the bus and the radio work in
+ * parallel. Chunks not acknowledged are kept in RAM and sent again (go-back-N)
+ * on repeated acknowledgements, once per acknowledged register, or after
+ * CONFIG_APP_MODBUS_STREAM_ACK_TIMEOUT_MS.
+ *
+ * One transfer runs at a time. See zb_zcl_modbus.h for the frame formats.
+ */
+
+#include "zb_zcl_modbus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Start a transfer. Must be called from the Zigbee stack context.
+ *
+ *  A transfer of the same requester in progress is replaced.
+ *
+ *  @param addr      Requester; its sequence number identifies the transfer.
+ *  @param fc        MODBUS_FC_READ_HOLDING_REGS or MODBUS_FC_READ_INPUT_REGS.
+ *  @param slave_id  Modbus unit identifier.
+ *  @param start     First register.
+ *  @param count     Number of registers.
+ *  @param window    Data frames the requester accepts ahead of its acknowledgements.
+ *
+ *  @retval 0        The transfer started.
+ *  @retval -EBUSY   A transfer of another requester is in progress.
+ *  @retval -EINVAL  The range is invalid.
+ */
+int modbus_stream_start(const zb_zcl_modbus_addr_t* addr, zb_uint8_t fc, zb_uint8_t slave_id, zb_uint16_t start, zb_uint16_t count, zb_uint8_t window);
+
+/** @brief Acknowledge the registers received. Must be called from the Zigbee stack context.
+ *
+ *  @param addr         Requester.
+ *  @param transfer_id  Sequence number of the stream read request.
+ *  @param next         First register not received yet.
+ *
+ *  @retval 0        If the operation was successful.
+ *  @retval -ENOENT  No such transfer in progress.
+ *  @retval -EINVAL  @p next is not a chunk boundary that was sent, including before a go-back.
+ */
+int modbus_stream_ack(const zb_zcl_modbus_addr_t* addr, zb_uint8_t transfer_id, zb_uint16_t next);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_STREAM_H */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MODBUS_TIMING_H
+#define MODBUS_TIMING_H
+
+/** @file modbus_timing.h
+ * @brief Response time model of a Modbus slave.
+ * @defgroup modbus_timing Modbus slave response times
+ * @{
+ *
+ * A transaction takes the time its request and response frames need on the
+ * line, which grows with the number of registers, plus the time the slave
+ * takes to answer. Only the latter is learned: the line time of the frames
+ * is subtracted from each measured transaction, and added back to the
+ * timeout of the next one. A slave measured with short polls thus gets a
+ * timeout long enough for a long read.
+ *
+ * The smoothed response time and its mean deviation are scaled by 8 and 4,
+ * as in the TCP retransmission timer (RFC 6298). There are no dependencies
+ * on the kernel, so the model can be tested on the host with
+ * scripts/modbus_timing_test.c.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Bits per character of a Modbus RTU frame: start, 8 data bits, parity or second stop bit, stop */
+#define MODBUS_TIMING_CHAR_BITS 11
+
+/** @brief Response time model of a slave */
+struct modbus_timing {
+    bool     answered; /**< At least one answer measured */
+    uint32_t srtt8;    /**< Smoothed response time [ms / 8] */
+    uint32_t rttvar4;  /**< Mean deviation of the response time [ms / 4] */
+};
+
+/** @brief Get the time the frames of a transaction take on the line.
+ *
+ *  @param fc       Function code.
+ *  @param nb_regs  Number of registers read or written.
+ *  @param bps      Baudrate of the bus.
+ *
+ *  @return Request and response frames, with the silent interval that ends
+ *          each of them, in milliseconds rounded up.
+ */
+uint32_t modbus_timing_line_ms(uint8_t fc, uint16_t nb_regs, uint32_t bps);
+
+/** @brief Add an answered transaction to the model.
+ *
+ *  @param timing      Model of the slave.
+ *  @param elapsed_ms  Time from the start of the request to the end of the response.
+ *  @param line_ms     Line time of the transaction, see @ref modbus_timing_line_ms.
+ */
+void modbus_timing_sample(struct modbus_timing* timing, uint32_t elapsed_ms, uint32_t line_ms);
+
+/** @brief Get the bus timeout of a transaction.
+ *
+ *  @param timing   Model of the slave.
+ *  @param backoff  Doubling of the response time after timeouts, as a power of two.
+ *  @param line_ms  Line time of the transaction, see @ref modbus_timing_line_ms.
+ *  @param min_ms   Lower bound of the response time.
+ *  @param max_ms   Upper bound of the response time, and response time of a slave that has not answered yet.
+ *
+ *  @return Smoothed response time plus four deviations, doubled @p backoff times and bounded,
+ *          plus the line time of the transaction, in milliseconds.
+ */
+uint32_t modbus_timing_timeout(const struct modbus_timing* timing, uint8_t backoff, uint32_t line_ms, uint32_t min_ms, uint32_t max_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* MODBUS_TIMING_H */
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RELAY_STATS_H
+#define RELAY_STATS_H
+
+/** @file relay_stats.h
+ * @brief Relay pressure counters.
+ * @defgroup relay_stats Relay statistics
+ * @{
+ *
+ * The stack diagnostics counters that explain lost relayed traffic are
+ * read periodically, and the buffer pool is sampled every second for low
+ * memory. All counters are cumulative since reset.
+ */
+
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Relay counters */
+enum relay_stat
+{
+    RELAY_STAT_RELAYED = 0,        /**< Unicast frames relayed */
+    RELAY_STAT_BUF_ALLOC_FAIL,     /**< Stack buffer allocation failures */
+    RELAY_STAT_BUF_LOW_S,          /**< Seconds with the buffer pool close to exhaustion */
+    RELAY_STAT_NWK_RETRY_OVERFLOW, /**< Frames dropped because the NWK retry queue was full */
+    RELAY_STAT_BCAST_TABLE_FULL,   /**< Broadcasts dropped because the broadcast transaction table was full */
+    RELAY_STAT_MAC_TX_FAIL,        /**< Unicast frames not acknowledged after all MAC retries */
+    RELAY_STAT_MAC_RX_DROP,        /**< Received frames dropped by the MAC */
+    RELAY_STAT_COUNT,
+};
+
+/** @brief Start sampling. Must be called from the Zigbee stack context.
+ *
+ *  Calls after the first one have no effect.
+ */
+void relay_stats_start(void);
+
+/** @brief Get a counter. Can be called from any context.
+ *
+ *  @param stat  Counter.
+ *
+ *  @return Value of the counter.
+ */
+uint32_t relay_stats_get(enum relay_stat stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* RELAY_STATS_H */
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+/** @file rules.h
+ * @brief Local rules engine for Modbus control loops.
+ * @defgroup rules Rules engine
+ * @{
+ *
+ * A rules program is compiled on the host and downloaded with the Modbus
+ * cluster rules download command. It is a sequence of rules, each encoded
+ * as:
+ *
+ *     uint8   trigger: RULES_TRIGGER_BUTTONS or a poll list index
+ *     uint8   length of the code
+ *     uint8[] code
+ *
+ * When the buttons change or a poll list entry has been read, every rule
+ * with a matching trigger is run. The code is executed by a stack machine
+ * with 32-bit signed values. Jumps only go forward, so every rule ends after
+ * at most its length in instructions. A rule stops at RULES_OP_END, at the
+ * end of its code, or on a stack overflow or underflow.
+ *
+ * Example, write 0 to holding register 0x0010 of slave 1 while button 0 is
+ * pressed: trigger 0xFF, code
+ *
+ *     BUTTON 0, JZ 6, PUSH8 0, WRITE 1 0x10 0x00, END
+ */
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Trigger of rules run when the buttons change */
+#define RULES_TRIGGER_BUTTONS 0xFF
+
+/** @brief Number of variables kept between runs, shared by all rules */
+#define RULES_VAR_COUNT 8
+
+/** @brief Maximum stack depth of a rule */
+#define RULES_STACK_DEPTH 8
+
+/** @brief Instructions, operands follow the opcode */
+enum rules_op
+{
+    RULES_OP_END = 0x00, /**< Stop the rule */
+    RULES_OP_PUSH8,      /**< int8: push a constant */
+    RULES_OP_PUSH16,     /**< int16 (LE): push a constant */
+    RULES_OP_BUTTON,     /**< uint8 button: push 1 if the button is pressed, 0 otherwise */
+    RULES_OP_REG,        /**< uint8 entry, uint8 reg: push the last value read of a polled register, unsigned */
+    RULES_OP_REG_S,      /**< uint8 entry, uint8 reg: same as RULES_OP_REG, signed */
+    RULES_OP_LOAD,       /**< uint8 var: push a variable */
+    RULES_OP_STORE,      /**< uint8 var: pop into a variable */
+    RULES_OP_DUP,        /**< Duplicate the top of the stack */
+    RULES_OP_DROP,       /**< Pop and discard */
+    RULES_OP_ADD,        /**< Pop b, a, push a + b */
+    RULES_OP_SUB,        /**< Pop b, a, push a - b */
+    RULES_OP_LT,         /**< Pop b, a, push a < b */
+    RULES_OP_GT,         /**< Pop b, a, push a > b */
+    RULES_OP_EQ,         /**< Pop b, a, push a == b */
+    RULES_OP_AND,        /**< Pop b, a, push a && b */
+    RULES_OP_OR,         /**< Pop b, a, push a || b */
+    RULES_OP_NOT,        /**< Pop a, push !a */
+    RULES_OP_JZ,         /**< uint8 offset: pop, skip offset bytes if zero */
+    RULES_OP_JMP,        /**< uint8 offset: skip offset bytes */
+    RULES_OP_WRITE,      /**< uint8 slave, uint16 addr (LE): pop and write to a holding register */
+    RULES_OP_COUNT,
+};
+
+/** @brief Store a chunk of a downloaded program. Must be called from the Zigbee stack context.
+ *
+ *  Chunks must be sent in order. The program replaces the running one once
+ *  its last chunk has been received and it has been validated. A total
+ *  length of 0 removes the running program.
+ *
+ *  @param offset  Offset of the chunk in the program.
+ *  @param total   Length of the program.
+ *  @param data    Chunk.
+ *  @param len     Length of the chunk.
+ *
+ *  @retval 0        If the chunk was stored, or the program was loaded.
+ *  @retval -EINVAL  If the chunk is out of order, its total length differs from the one of the first chunk, or the program is invalid.
+ *  @retval -EFBIG   If the program is larger than CONFIG_APP_RULES_MAX_SIZE.
+ */
+int rules_download(uint16_t offset, uint16_t total, const uint8_t* data, uint8_t len);
+
+/** @brief Get the running program.
+ *
+ *  @param len  Length of the program, 0 if none.
+ *
+ *  @return The program.
+ */
+const uint8_t* rules_get(uint16_t* len);
+
+/** @brief Run the rules triggered by the buttons. Must be called from the Zigbee stack context.
+ *
+ *  @param button_state  Bitmask of button states.
+ */
+void rules_buttons_changed(uint8_t button_state);
+
+/** @brief Run the rules triggered by a poll list entry. Must be called from the Zigbee stack context.
+ *
+ *  @param entry    Poll list index.
+ *  @param values   Register values.
+ *  @param nb_regs  Number of registers.
+ */
+void rules_poll_result(uint8_t entry, const uint16_t* values, uint8_t nb_regs);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* RULES_H */
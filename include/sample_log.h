@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H
+
+/** @file sample_log.h
+ * @brief Store-and-forward log of polled register samples.
+ * @defgroup sample_log Sample log
+ * @{
+ *
+ * Samples are collected in batches in RAM. While the device is joined and
+ * no backlog is pending, a full batch is sent right away. Otherwise it is
+ * appended to the sample_log flash partition, and the backlog is sent at a
+ * limited rate once the network is back. The partition is a ring of flash
+ * sectors: a full log drops its oldest sector, and a sent backlog is marked
+ * with a cursor entry rather than erased.
+ *
+ * A batch starts with a header of the boot counter (1 byte) and the uptime
+ * in seconds of its first sample (4 bytes, little-endian). Every sample is
+ * then encoded as:
+ *
+ *     varint  seconds since the previous sample of the batch
+ *     uint8   poll list index
+ *     uint8   number of registers
+ *     varint  per register, zigzag delta to the previous sample of the same
+ *             poll list entry in the batch, or to 0 for the first one
+ *
+ * Batches are sent with the Modbus cluster sample log command, prefixed with
+ * the boot counter and uptime in seconds at the time of sending, so that the
+ * receiver can place the samples of the current boot in time.
+ */
+
+#include <stdbool.h>
+#include <zephyr/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Size of the batch header: boot counter and uptime */
+#define SAMPLE_LOG_BATCH_HDR_LEN 5
+
+/** @brief Size of the frame header: boot counter and uptime when sent */
+#define SAMPLE_LOG_FRAME_HDR_LEN 5
+
+/** @brief Maximum number of registers in one sample */
+#define SAMPLE_LOG_MAX_REGS 8
+
+/** @brief Maximum number of poll list entries */
+#define SAMPLE_LOG_MAX_ENTRIES 16
+
+/** @brief Open the flash log and recover the backlog left by a previous boot.
+ *
+ *  @param endpoint  Endpoint of the Modbus cluster used to send the batches.
+ *
+ *  @retval 0           If the operation was successful.
+ *                      Otherwise, a (negative) error code is returned.
+ */
+int sample_log_init(uint8_t endpoint);
+
+/** @brief Add a sample. Must be called from the Zigbee stack context.
+ *
+ *  @param entry    Poll list index.
+ *  @param values   Register values.
+ *  @param nb_regs  Number of registers.
+ */
+void sample_log_add(uint8_t entry, const uint16_t* values, uint8_t nb_regs);
+
+/** @brief Update the network state. Must be called from the Zigbee stack context.
+ *
+ *  @param joined  True if the device is joined to a Zigbee network.
+ */
+void sample_log_set_network_state(bool joined);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* SAMPLE_LOG_H */
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef SIGNAL_DISPATCH_H
+#define SIGNAL_DISPATCH_H
+
+/** @file signal_dispatch.h
+ * @brief Zigbee stack signal dispatch.
+ * @defgroup signal_dispatch Signal dispatch
+ * @{
+ *
+ * Signal handlers are listed in a constant table, each with the signal it
+ * handles. A signal is passed, in table order, to the handlers of that
+ * signal and to the handlers of SIGNAL_DISPATCH_ANY only. With
+ * CONFIG_APP_SIGNAL_STATS, the time spent in each table entry is measured
+ * with the timing functions, in CPU cycles, and logged periodically by
+ * signal_dispatch_report().
+ */
+
+#include <stddef.h>
+#include <zboss_api.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Signal of the handlers called for every signal */
+#define SIGNAL_DISPATCH_ANY 0xFF
+
+/** @brief Signal handler. The buffer is freed by the dispatcher.
+ *
+ *  @param bufid  Buffer holding the signal.
+ */
+typedef void (*signal_handler_t)(zb_bufid_t bufid);
+
+/** @brief Signal handler table entry */
+struct signal_handler {
+    zb_zdo_app_signal_type_t signal; /**< Signal handled, or SIGNAL_DISPATCH_ANY */
+    signal_handler_t         handler;
+    const char*              name;
+};
+
+/** @brief Time spent in a signal handler table entry */
+struct signal_handler_stats {
+    uint32_t calls;
+    uint32_t calls_reported; /**< Calls when last reported */
+    uint32_t max_ns;
+    uint64_t total_ns;
+};
+
+/** @brief Declare a signal handler table entry */
+#define SIGNAL_HANDLER(sig, fn) {.signal = (sig), .handler = (fn), .name = #fn}
+
+/** @brief Start the time measurement. Must be called before the stack starts. */
+void signal_dispatch_init(void);
+
+/** @brief Dispatch a signal and free its buffer. Called from zboss_signal_handler().
+ *
+ *  @param handlers  Handler table.
+ *  @param stats     Time spent in each entry of the table.
+ *  @param count     Number of entries of the table.
+ *  @param bufid     Buffer holding the signal.
+ */
+void signal_dispatch(const struct signal_handler* handlers, struct signal_handler_stats* stats, size_t count, zb_bufid_t bufid);
+
+/** @brief Log the calls, mean and maximum time of the table entries called since the last report.
+ *         Must be called from the Zigbee stack context.
+ *
+ *  @param handlers  Handler table.
+ *  @param stats     Time spent in each entry of the table.
+ *  @param count     Number of entries of the table.
+ */
+void signal_dispatch_report(const struct signal_handler* handlers, struct signal_handler_stats* stats, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* SIGNAL_DISPATCH_H */
@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef VARINT_H
+#define VARINT_H
+
+/** @file varint.h
+ * @brief LEB128 variable length integers and zigzag encoding of signed deltas.
+ * @defgroup varint Variable length integers
+ * @{
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maximum encoded size of a 32-bit value */
+#define VARINT_MAX_LEN 5
+
+/** @brief Map a signed value to an unsigned one, small magnitudes to small values. */
+static inline uint32_t zigzag_encode(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/** @brief Inverse of @ref zigzag_encode. */
+static inline int32_t zigzag_decode(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/** @brief Encode a value, least significant group first.
+ *
+ *  @param out    Buffer with room for at least VARINT_MAX_LEN bytes.
+ *  @param value  Value to encode.
+ *
+ *  @return Number of bytes written.
+ */
+static inline size_t varint_put(uint8_t* out, uint32_t value) {
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    out[len++] = (uint8_t)value;
+
+    return len;
+}
+
+/** @brief Decode a value.
+ *
+ *  @param in     Encoded data.
+ *  @param len    Number of bytes available in @p in.
+ *  @param value  Decoded value.
+ *
+ *  @return Number of bytes consumed, or 0 if @p in is truncated or too long.
+ */
+static inline size_t varint_get(const uint8_t* in, size_t len, uint32_t* value) {
+    uint32_t result = 0;
+
+    for (size_t i = 0; i < len && i < VARINT_MAX_LEN; i++) {
+        result |= (uint32_t)(in[i] & 0x7F) << (7 * i);
+        if (!(in[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
+
+#endif /* VARINT_H */
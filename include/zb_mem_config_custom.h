@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ZB_MEM_CONFIG_CUSTOM_H
+#define ZB_MEM_CONFIG_CUSTOM_H
+
+/** @file zb_mem_config_custom.h
+ * @brief Zigbee stack memory configuration.
+ *
+ * With CONFIG_APP_ZB_MEM_PROFILE_LIBRARY, the memory configuration of the
+ * stack library is kept. With CONFIG_APP_ZB_MEM_PROFILE_LARGE, starts from
+ * the ZBOSS profile of a router in a large, high traffic network, and
+ * overrides the tables that limit how much traffic the device can relay
+ * with the CONFIG_APP_ZB_* options. An option set to 0 keeps the value of
+ * the profile.
+ *
+ * This file defines the stack memory, so it is included by main.c only.
+ */
+
+#ifdef CONFIG_APP_ZB_MEM_PROFILE_LARGE
+#define ZB_CONFIG_ROLE_ZR
+#define ZB_CONFIG_OVERALL_NETWORK_SIZE 128
+#define ZB_CONFIG_HIGH_TRAFFIC
+#define ZB_CONFIG_APPLICATION_COMPLEX
+
+#include "zb_mem_config_common.h"
+
+#if CONFIG_APP_ZB_IOBUF_POOL_SIZE > 0
+#undef ZB_CONFIG_IOBUF_POOL_SIZE
+#define ZB_CONFIG_IOBUF_POOL_SIZE CONFIG_APP_ZB_IOBUF_POOL_SIZE
+#endif
+
+#if CONFIG_APP_ZB_ROUTING_TABLE_SIZE > 0
+#undef ZB_CONFIG_NWK_ROUTING_TABLE_SIZE
+#define ZB_CONFIG_NWK_ROUTING_TABLE_SIZE CONFIG_APP_ZB_ROUTING_TABLE_SIZE
+#endif
+
+#if CONFIG_APP_ZB_NEIGHBOR_TABLE_SIZE > 0
+#undef ZB_CONFIG_NEIGHBOR_TABLE_SIZE
+#define ZB_CONFIG_NEIGHBOR_TABLE_SIZE CONFIG_APP_ZB_NEIGHBOR_TABLE_SIZE
+#endif
+
+#if CONFIG_APP_ZB_APS_DUPS_TABLE_SIZE > 0
+#undef ZB_CONFIG_APS_DUPS_TABLE_SIZE
+#define ZB_CONFIG_APS_DUPS_TABLE_SIZE CONFIG_APP_ZB_APS_DUPS_TABLE_SIZE
+#endif
+
+#include "zb_mem_config_context.h"
+#endif /* CONFIG_APP_ZB_MEM_PROFILE_LARGE */
+
+#endif /* ZB_MEM_CONFIG_CUSTOM_H */
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ZB_MODBUS_DEVICE_H
+#define ZB_MODBUS_DEVICE_H 1
+
+#include <zboss_api.h>
+#include "zb_zcl_modbus.h"
+
+/** @defgroup ZB_DEFINE_DEVICE_MODBUS Modbus device
+ *  @{
+ *  @details
+ *    An endpoint bridging a Modbus bus, with the Modbus cluster server,
+ *    the Groups cluster server and the Modbus cluster client, used to
+ *    originate group commands. ZB_DECLARE_MODBUS_DEVICE declares all the
+ *    descriptors of such an endpoint in one line, so a device can expose
+ *    several of them from a list.
+ */
+
+/** Modbus device ID */
+#define ZB_MODBUS_DEVICE_ID 0xF003
+
+/** Modbus device version */
+#define ZB_DEVICE_VER_MODBUS 1
+
+/** Modbus device IN (server) clusters number */
+#define ZB_MODBUS_DEVICE_IN_CLUSTER_NUM 2
+
+/** Modbus device OUT (client) clusters number */
+#define ZB_MODBUS_DEVICE_OUT_CLUSTER_NUM 1
+
+/** @cond internals_doc */
+
+#define ZB_MODBUS_DEVICE_SIMPLE_DESC_TYPE_(in_clust_num, out_clust_num)    ZB_AF_SIMPLE_DESC_TYPE(in_clust_num, out_clust_num)
+#define ZB_MODBUS_DEVICE_DECLARE_SIMPLE_DESC_(in_clust_num, out_clust_num) ZB_DECLARE_SIMPLE_DESC(in_clust_num, out_clust_num)
+
+/** Simple descriptor type of the Modbus device, declared once for all its endpoints */
+#define ZB_MODBUS_DEVICE_SIMPLE_DESC_TYPE ZB_MODBUS_DEVICE_SIMPLE_DESC_TYPE_(ZB_MODBUS_DEVICE_IN_CLUSTER_NUM, ZB_MODBUS_DEVICE_OUT_CLUSTER_NUM)
+
+ZB_MODBUS_DEVICE_DECLARE_SIMPLE_DESC_(ZB_MODBUS_DEVICE_IN_CLUSTER_NUM, ZB_MODBUS_DEVICE_OUT_CLUSTER_NUM);
+
+/** @endcond */ /* internals_doc */
+
+/*!
+  @brief Declare cluster list for Modbus device
+  @param cluster_list_name - cluster list variable name
+  @param modbus_attr_list - attribute list for the Modbus cluster server
+  @param groups_attr_list - attribute list for the Groups cluster
+  @param modbus_client_attr_list - attribute list for the Modbus cluster client
+*/
+#define ZB_DECLARE_MODBUS_DEVICE_CLUSTER_LIST(cluster_list_name, modbus_attr_list, groups_attr_list, modbus_client_attr_list)                                                                                                                            \
+    zb_zcl_cluster_desc_t cluster_list_name[] = {                                                                                                                                                                                                        \
+        ZB_ZCL_CLUSTER_DESC(ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_ARRAY_SIZE(modbus_attr_list, zb_zcl_attr_t), (modbus_attr_list), ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_MANUF_CODE_INVALID),                                                                    \
+        ZB_ZCL_CLUSTER_DESC(ZB_ZCL_CLUSTER_ID_GROUPS, ZB_ZCL_ARRAY_SIZE(groups_attr_list, zb_zcl_attr_t), (groups_attr_list), ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_MANUF_CODE_INVALID),                                                                    \
+        ZB_ZCL_CLUSTER_DESC(ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_ARRAY_SIZE(modbus_client_attr_list, zb_zcl_attr_t), (modbus_client_attr_list), ZB_ZCL_CLUSTER_CLIENT_ROLE, ZB_ZCL_MANUF_CODE_INVALID),                                                      \
+    }
+
+/*!
+  @brief Declare endpoint for Modbus device
+  @param ep_name - endpoint variable name
+  @param ep_id - endpoint ID
+  @param cluster_list - endpoint cluster list
+  @param report_attr_count - number of reportable attributes of the endpoint
+*/
+#define ZB_DECLARE_MODBUS_DEVICE_EP(ep_name, ep_id, cluster_list, report_attr_count)                                                                                                                                                                     \
+    ZB_MODBUS_DEVICE_SIMPLE_DESC_TYPE simple_desc_##ep_name = {                                                                                                                                                                                          \
+        ep_id,                                                                                                                                                                                                                                           \
+        ZB_AF_HA_PROFILE_ID,                                                                                                                                                                                                                             \
+        ZB_MODBUS_DEVICE_ID,                                                                                                                                                                                                                             \
+        ZB_DEVICE_VER_MODBUS,                                                                                                                                                                                                                            \
+        0,                                                                                                                                                                                                                                               \
+        ZB_MODBUS_DEVICE_IN_CLUSTER_NUM,                                                                                                                                                                                                                 \
+        ZB_MODBUS_DEVICE_OUT_CLUSTER_NUM,                                                                                                                                                                                                                \
+        {                                                                                                                                                                                                                                                \
+            ZB_ZCL_CLUSTER_ID_MODBUS,                                                                                                                                                                                                                    \
+            ZB_ZCL_CLUSTER_ID_GROUPS,                                                                                                                                                                                                                    \
+            ZB_ZCL_CLUSTER_ID_MODBUS,                                                                                                                                                                                                                    \
+        },                                                                                                                                                                                                                                               \
+    };                                                                                                                                                                                                                                                   \
+    ZBOSS_DEVICE_DECLARE_REPORTING_CTX(reporting_info_##ep_name, report_attr_count);                                                                                                                                                                     \
+    ZB_AF_DECLARE_ENDPOINT_DESC(ep_name, ep_id, ZB_AF_HA_PROFILE_ID, 0, NULL, ZB_ZCL_ARRAY_SIZE(cluster_list, zb_zcl_cluster_desc_t), cluster_list, (zb_af_simple_desc_1_1_t*)&simple_desc_##ep_name, report_attr_count, reporting_info_##ep_name, 0, NULL)
+
+/*!
+  @brief Declare a complete Modbus device endpoint: attribute lists, cluster list, simple descriptor, reporting context and endpoint descriptor
+  @param ep_name - endpoint variable name, also the prefix of the other variables
+  @param ep_id - endpoint ID
+  @param modbus_attrs - zb_zcl_modbus_attrs_t storing the Modbus cluster attributes
+  @param groups_attrs - zb_zcl_groups_attrs_t storing the Groups cluster attributes
+  @param ext_attrs - name of a macro without parameters expanding to additional Modbus cluster attribute descriptors, see ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT (a name, as the descriptors contain commas)
+  @param report_attr_count - number of reportable attributes of the endpoint
+*/
+#define ZB_DECLARE_MODBUS_DEVICE(ep_name, ep_id, modbus_attrs, groups_attrs, ext_attrs, report_attr_count)                                                                                                                                               \
+    ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT(ep_name##_modbus_attr_list, &(modbus_attrs).baudrate, &(modbus_attrs).capabilities, &(modbus_attrs).request_timeout, ext_attrs());                                                                             \
+    ZB_ZCL_DECLARE_GROUPS_ATTRIB_LIST(ep_name##_groups_attr_list, &(groups_attrs).name_support);                                                                                                                                                         \
+    ZB_ZCL_DECLARE_MODBUS_CLIENT_ATTRIB_LIST(ep_name##_modbus_client_attr_list);                                                                                                                                                                         \
+    ZB_DECLARE_MODBUS_DEVICE_CLUSTER_LIST(ep_name##_clusters, ep_name##_modbus_attr_list, ep_name##_groups_attr_list, ep_name##_modbus_client_attr_list);                                                                                                \
+    ZB_DECLARE_MODBUS_DEVICE_EP(ep_name, ep_id, ep_name##_clusters, report_attr_count)
+
+/** @brief Endpoint list entry of a ZB_DECLARE_MODBUS_DEVICE endpoint, takes the same arguments */
+#define ZB_MODBUS_DEVICE_EP_REF(ep_name, ...) &ep_name,
+
+/*! @} */
+
+#endif /* ZB_MODBUS_DEVICE_H */
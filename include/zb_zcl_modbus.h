@@ -6,6 +6,9 @@
 #include "zcl/zb_zcl_common.h"
 #include "zcl/zb_zcl_commands.h"
 
+#include "modbus_codec.h"
+#include "modbus_frame.h"
+
 /** @cond DOXYGEN_ZCL_SECTION */
 
 /** @addtogroup ZB_ZCL_MODBUS
@@ -28,6 +31,25 @@ enum zb_zcl_modbus_attr_e
 {
     /*! @brief internal baudrate */
     ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID = 0x0000,
+    /*! @brief optional features supported by the server */
+    ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID = 0x0001,
+    /*! @brief time after which requests without a deadline field expire [ms], 0 for never */
+    ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID = 0x0002,
+};
+
+/**
+ * @brief Modbus capabilities attribute bits
+ */
+enum zb_zcl_modbus_capabilities_e
+{
+    /*! @brief read compressed command is supported */
+    ZB_ZCL_MODBUS_CAP_COMPRESSED = 1 << 0,
+    /*! @brief requests may carry a deadline field, and the cancel command is supported */
+    ZB_ZCL_MODBUS_CAP_DEADLINE = 1 << 1,
+    /*! @brief stream read and stream ack commands are supported */
+    ZB_ZCL_MODBUS_CAP_STREAM = 1 << 2,
+    /*! @brief snapshot command is supported */
+    ZB_ZCL_MODBUS_CAP_SNAPSHOT = 1 << 3,
 };
 
 /**
@@ -55,14 +77,43 @@ typedef enum
 /** @brief Baudrate attribute default value */
 #define ZB_ZCL_MODBUS_BAUDRATE_DEFAULT_VALUE ((zb_uint8_t)ZB_ZCL_MODBUS_BAUDRATE_19200)
 
+/** @brief Capabilities attribute value of this implementation */
+#define ZB_ZCL_MODBUS_CAPABILITIES_DEFAULT_VALUE ((zb_uint8_t)(ZB_ZCL_MODBUS_CAP_COMPRESSED | ZB_ZCL_MODBUS_CAP_DEADLINE))
+
+/** @brief Request timeout attribute default value, requests without a deadline field never expire */
+#define ZB_ZCL_MODBUS_REQUEST_TIMEOUT_DEFAULT_VALUE ((zb_uint16_t)0)
+
 /*!
-  @brief Declare attribute list for Modbus cluster
+  @brief Declare attribute list for Modbus cluster with additional attributes
   @param attr_list - attribute list name
   @param baudrate - pointer to variable to store baudrate attribute value
+  @param capabilities - pointer to variable to store capabilities attribute value
+  @param request_timeout - pointer to variable to store request timeout attribute value
+  @param ext_attrs - attribute descriptors appended to the list, each followed by a comma
 */
-#define ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST(attr_list, baudrate)                                                                                                                                                                                           \
+#define ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT(attr_list, baudrate, capabilities, request_timeout, ext_attrs)                                                                                                                                             \
     ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(attr_list, ZB_ZCL_MODBUS)                                                                                                                                                                          \
     ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID, (baudrate))                                                                                                                                                                                     \
+    ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID, (capabilities))                                                                                                                                                                             \
+    ZB_ZCL_SET_ATTR_DESC(ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID, (request_timeout))                                                                                                                                                                       \
+    ext_attrs                                                                                                                                                                                                                                            \
+    ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST
+
+/*!
+  @brief Declare attribute list for Modbus cluster
+  @param attr_list - attribute list name
+  @param baudrate - pointer to variable to store baudrate attribute value
+  @param capabilities - pointer to variable to store capabilities attribute value
+  @param request_timeout - pointer to variable to store request timeout attribute value
+*/
+#define ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST(attr_list, baudrate, capabilities, request_timeout) ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST_EXT(attr_list, baudrate, capabilities, request_timeout, )
+
+/*!
+  @brief Declare attribute list for the client role of the Modbus cluster
+  @param attr_list - attribute list name
+*/
+#define ZB_ZCL_DECLARE_MODBUS_CLIENT_ATTRIB_LIST(attr_list)                                                                                                                                                                                              \
+    ZB_ZCL_START_DECLARE_ATTRIB_LIST_CLUSTER_REVISION(attr_list, ZB_ZCL_MODBUS)                                                                                                                                                                          \
     ZB_ZCL_FINISH_DECLARE_ATTRIB_LIST
 
 /*! @} */ /* Modbus cluster attributes */
@@ -77,6 +128,12 @@ typedef enum
 #define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID(data_ptr)                                                                                                                                                                                  \
     { ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID, ZB_ZCL_ATTR_TYPE_8BIT_ENUM, ZB_ZCL_ATTR_ACCESS_READ_WRITE | ZB_ZCL_ATTR_MANUF_SPEC, (void*)data_ptr }
 
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID(data_ptr)                                                                                                                                                                              \
+    { ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID, ZB_ZCL_ATTR_TYPE_8BITMAP, ZB_ZCL_ATTR_ACCESS_READ_ONLY | ZB_ZCL_ATTR_MANUF_SPEC, (void*)data_ptr }
+
+#define ZB_SET_ATTR_DESCR_WITH_ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID(data_ptr)                                                                                                                                                                           \
+    { ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID, ZB_ZCL_ATTR_TYPE_U16, ZB_ZCL_ATTR_ACCESS_READ_WRITE | ZB_ZCL_ATTR_MANUF_SPEC, (void*)data_ptr }
+
 /** @internal Structure of addr variables for register commands
  */
 typedef struct zb_zcl_modbus_addr_s {
@@ -87,6 +144,8 @@ typedef struct zb_zcl_modbus_addr_s {
     zb_uint8_t  seq_number;
     zb_bool_t   disable_default_response;
     zb_uint16_t profile_id;
+    zb_uint8_t  base_tag;
+    zb_uint16_t timeout_ms;
 } zb_zcl_modbus_addr_t;
 
 /** @see Modbus Exception responses */
@@ -104,6 +163,9 @@ typedef enum
     ZB_ZCL_MODBUS_EXCP_GATE_TARGET_FAILED_TO_RESPOND,
 } zb_zcl_modbus_exception_t;
 
+/** @brief Exception code as sent on the bus and in the err field of a response */
+#define ZB_ZCL_MODBUS_EXCP_CODE(excp) ((zb_int16_t)(excp) + 1)
+
 typedef enum
 {
     ZB_ZCL_MODBUS_RESP_STATUS_OK,
@@ -126,25 +188,39 @@ typedef enum
  */
 enum zb_zcl_modbus_cmd_req_e
 {
-    ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID = 0xF1,
+    ZB_ZCL_CMD_MODBUS_SNAPSHOT_REQ_ID        = 0xF0,
+    ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID    = 0xF1,
+    ZB_ZCL_CMD_MODBUS_READ_DECODED_REQ_ID    = 0xF3,
+    ZB_ZCL_CMD_MODBUS_GROUP_COMMAND_REQ_ID   = 0xF5,
+    ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID = 0xF8,
+    ZB_ZCL_CMD_MODBUS_RULES_DOWNLOAD_REQ_ID  = 0xFA,
+    ZB_ZCL_CMD_MODBUS_CANCEL_REQ_ID          = 0xFB,
+    ZB_ZCL_CMD_MODBUS_STREAM_READ_REQ_ID     = 0xFC,
+    ZB_ZCL_CMD_MODBUS_STREAM_ACK_REQ_ID      = 0xFD,
 };
 
 enum zb_zcl_modbus_cmd_resp_e
 {
-    ZB_ZCL_CMD_MODBUS_JSON_COMMAND_RESP_ID = 0xF2,
+    ZB_ZCL_CMD_MODBUS_JSON_COMMAND_RESP_ID    = 0xF2,
+    ZB_ZCL_CMD_MODBUS_READ_DECODED_RESP_ID    = 0xF4,
+    ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID    = 0xF6,
+    ZB_ZCL_CMD_MODBUS_SAMPLE_LOG_ID           = 0xF7,
+    ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_RESP_ID = 0xF9,
+    ZB_ZCL_CMD_MODBUS_STREAM_DATA_ID          = 0xFE,
+    ZB_ZCL_CMD_MODBUS_SNAPSHOT_RESP_ID        = 0xFF,
 };
 
 /** @cond internals_doc */
 /* Modbus cluster commands list : only for information - do not modify */
-#define ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_GENERATED_CMD_LIST
+#define ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_GENERATED_CMD_LIST ZB_ZCL_CMD_MODBUS_JSON_COMMAND_RESP_ID, ZB_ZCL_CMD_MODBUS_READ_DECODED_RESP_ID, ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID, ZB_ZCL_CMD_MODBUS_SAMPLE_LOG_ID, ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_RESP_ID, ZB_ZCL_CMD_MODBUS_STREAM_DATA_ID, ZB_ZCL_CMD_MODBUS_SNAPSHOT_RESP_ID
 
 #define ZB_ZCL_CLUSTER_ID_MODBUS_CLIENT_ROLE_RECEIVED_CMD_LIST ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_GENERATED_CMD_LIST
 
-#define ZB_ZCL_CLUSTER_ID_MODBUS_CLIENT_ROLE_GENERATED_CMD_LIST ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID
+#define ZB_ZCL_CLUSTER_ID_MODBUS_CLIENT_ROLE_GENERATED_CMD_LIST ZB_ZCL_CMD_MODBUS_SNAPSHOT_REQ_ID, ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID, ZB_ZCL_CMD_MODBUS_READ_DECODED_REQ_ID, ZB_ZCL_CMD_MODBUS_GROUP_COMMAND_REQ_ID, ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID, ZB_ZCL_CMD_MODBUS_RULES_DOWNLOAD_REQ_ID, ZB_ZCL_CMD_MODBUS_CANCEL_REQ_ID, ZB_ZCL_CMD_MODBUS_STREAM_READ_REQ_ID, ZB_ZCL_CMD_MODBUS_STREAM_ACK_REQ_ID
 
 #define ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_RECEIVED_CMD_LIST ZB_ZCL_CLUSTER_ID_MODBUS_CLIENT_ROLE_GENERATED_CMD_LIST
 
-#define ZB_ZCL_MB_CMD_MAX_STRING_LENGTH 82
+#define ZB_ZCL_MB_CMD_MAX_STRING_LENGTH MODBUS_FRAME_STRING_MAX_LEN
 
 /*! @}
  *  @endcond */ /* internals_doc */
@@ -162,6 +238,24 @@ typedef ZB_PACKED_PRE struct zb_zcl_modbus_json_command_req_s {
 /** @brief Json command payload length macro */
 #define ZB_ZCL_MODBUS_JSON_COMMAND_REQ_MAX_PAYLOAD_LEN sizeof(zb_zcl_modbus_json_command_req_t)
 
+/*! @brief Request data packet: fc, slave_id, addr, nb_regs and, for writes, nb_regs words of data */
+typedef struct {
+    uint8_t   fc;
+    uint8_t   slave_id;
+    uint16_t  addr;
+    uint8_t   nb_regs;
+    uint16_t* data;
+    uint16_t  timeout_ms; /**< Deadline relative to the reception of the request, 0 to leave the field out */
+} zb_zcl_modbus_data_packet_req_t;
+
+/*! @brief Pre-built request frame payload, serialized once and sent to any number of peers */
+typedef struct zb_zcl_modbus_cmd_template_s {
+    zb_uint8_t cmd_id;
+    zb_uint8_t def_resp;
+    zb_uint8_t len;
+    zb_uint8_t payload[ZB_ZCL_MB_CMD_MAX_STRING_LENGTH + 1];
+} zb_zcl_modbus_cmd_template_t;
+
 /*! @brief Send json command
     @param buffer - to put packet to
     @param dst_addr - address to send packet to
@@ -171,27 +265,70 @@ typedef ZB_PACKED_PRE struct zb_zcl_modbus_json_command_req_s {
     @param prof_id - profile identifier
     @param def_resp - enable/disable default response
     @param cb - callback for getting command send status
-    @param address - address value
-    @param data_length - Data length value
-    @param slave_id - Slave_id value
+    @param req - request data packet
+    @param cmd_id - command id
+*/
+void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb,
+                                         const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t cmd_id);
+
+/*! @brief Serialize a request once for repeated sends
+    @param tmpl - template to fill
+    @param req - request data packet
     @param cmd_id - command id
+    @param def_resp - enable/disable default response
+    @return RET_OK, or RET_INVALID_PARAMETER if the request does not fit in a frame
+*/
+zb_ret_t zb_zcl_modbus_build_cmd_template(zb_zcl_modbus_cmd_template_t* tmpl, const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t cmd_id, zb_uint8_t def_resp);
+
+/*! @brief Send a pre-built request, only the ZCL header is written per send
+    @param buffer - to put packet to
+    @param tmpl - pre-built request
+    @param dst_addr - address to send packet to
+    @param dst_addr_mode - addressing mode, including group addressing
+    @param dst_ep - destination endpoint
+    @param ep - sending endpoint
+    @param prof_id - profile identifier
+    @param cb - callback for getting command send status
+*/
+void zb_zcl_modbus_send_cmd_template(zb_bufid_t buffer, const zb_zcl_modbus_cmd_template_t* tmpl, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_callback_t cb);
+
+/*! @brief Delay before trying again when the buffer pool or the client queue is exhausted */
+#define ZB_ZCL_MODBUS_RETRY_DELAY_MS 50
+
+/*! @brief Size of the ZCL header of a Modbus cluster command: frame control, sequence number and command identifier */
+#define ZB_ZCL_MODBUS_ZCL_HDR_LEN 3
+
+/*! @brief Send a pre-built request to a list of peers
+    @param tmpl - pre-built request, must stay valid until @p done is called
+    @param dst_addrs - short addresses of the peers, must stay valid until @p done is called
+    @param count - number of peers
+    @param dst_ep - destination endpoint on every peer
+    @param ep - sending endpoint
+    @param prof_id - profile identifier
+    @param done - called with param 0 once a frame has been handed to the stack for every peer
+    @return RET_OK, or RET_BUSY if a fan-out is already in progress
+
+    Waits ZB_ZCL_MODBUS_RETRY_DELAY_MS and tries again whenever no buffer is available.
 */
-void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb, zb_uint16_t address,
-                                         zb_uint8_t data_length, zb_uint8_t slave_id, zb_uint8_t cmd_id);
+zb_ret_t zb_zcl_modbus_send_cmd_fanout(const zb_zcl_modbus_cmd_template_t* tmpl, const zb_uint16_t* dst_addrs, zb_uint8_t count, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_callback_t done);
+
+/*! @brief Forget cached cluster revisions, for example after a peer has been updated */
+void zb_zcl_modbus_flush_rev_cache(void);
 
 /** @internal Macro for json command */
-#define ZB_ZCL_MODBUS_SEND_JSON_COMMAND_CMD(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, address, data_length, slave_id, cmd_id)                                                                                                      \
-    { zb_zcl_modbus_send_json_command_cmd(buffer, ZB_ADDR_U_CAST(addr), dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, address, data_length, slave_id, cmd_id); }
+#define ZB_ZCL_MODBUS_SEND_JSON_COMMAND_CMD(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, req, cmd_id)                                                                                                                                 \
+    { zb_zcl_modbus_send_json_command_cmd(buffer, ZB_ADDR_U_CAST(addr), dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, req, cmd_id); }
 
 /** @internal Macro for getting json command */
 #define ZB_ZCL_MODBUS_GET_JSON_COMMAND_CMD(buf, req, status)                                                                                                                                                                                             \
     {                                                                                                                                                                                                                                                    \
-        zb_zcl_modbus_json_command_req_t* modbus_cmd_ptr = (zb_zcl_modbus_json_command_req_t*)zb_buf_begin(buf);                                                                                                                                         \
-        status                                           = ZB_ZCL_PARSE_STATUS_FAILURE;                                                                                                                                                                  \
-        if (zb_buf_len(buf) >= (zb_uint_t)(modbus_cmd_ptr->len)) {                                                                                                                                                                                       \
-            req.len = modbus_cmd_ptr->len;                                                                                                                                                                                                               \
+        const zb_uint8_t* modbus_str;                                                                                                                                                                                                                    \
+        int               modbus_len = modbus_frame_string(zb_buf_begin(buf), zb_buf_len(buf), ZB_ZCL_MB_CMD_MAX_STRING_LENGTH, &modbus_str);                                                                                                            \
+        status                       = ZB_ZCL_PARSE_STATUS_FAILURE;                                                                                                                                                                                      \
+        if (modbus_len >= 0) {                                                                                                                                                                                                                           \
+            req.len = (zb_uint8_t)modbus_len;                                                                                                                                                                                                            \
             ZB_MEMSET(req.data, 0, sizeof(req.data));                                                                                                                                                                                                    \
-            ZB_MEMCPY(req.data, ((zb_uint8_t*)modbus_cmd_ptr->data), modbus_cmd_ptr->len);                                                                                                                                                               \
+            ZB_MEMCPY(req.data, modbus_str, modbus_len);                                                                                                                                                                                                 \
             status = ZB_ZCL_PARSE_STATUS_SUCCESS;                                                                                                                                                                                                        \
         }                                                                                                                                                                                                                                                \
     }
@@ -205,13 +342,11 @@ void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst
     @param prfl_id - profile identifier
     @param def_resp - enable/disable default response
     @param cb - callback for getting command send status
-    @param address - address value
-    @param data_length - data length value
-    @param slave_id - slave_id value
+    @param req - request data packet
 */
 
-#define ZB_ZCL_MODBUS_SEND_JSON_COMMAND_REQ(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, address, data_length, slave_id)                                                                                                              \
-    { ZB_ZCL_MODBUS_SEND_JSON_COMMAND_CMD(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, address, data_length, slave_id, ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID) }
+#define ZB_ZCL_MODBUS_SEND_JSON_COMMAND_REQ(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, req)                                                                                                                                         \
+    { ZB_ZCL_MODBUS_SEND_JSON_COMMAND_CMD(buffer, addr, dst_addr_mode, dst_ep, ep, prfl_id, def_resp, cb, req, ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID) }
 
 /*!
   @brief Parses Get json command and fills data request structure.
@@ -226,15 +361,7 @@ void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst
 
 /******** Response to Command json command ********/
 
-typedef struct {
-    uint8_t   fc;
-    uint8_t   slave_id;
-    uint16_t  addr;
-    uint8_t   nb_regs;
-    uint16_t* data;
-} zb_zcl_modbus_data_packet_req_t;
-
-#define MAX_NUM_REGISTERS ((zb_uint8_t)(ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - 7) / 2)
+#define MAX_NUM_REGISTERS ((zb_uint8_t)MODBUS_FRAME_MAX_REGS)
 
 typedef struct {
     uint8_t  fc;
@@ -247,15 +374,238 @@ typedef struct {
 
 #define ZB_ZCL_MODBUS_JSON_COMMAND_RESP_MAX_PAYLOAD_LEN (ZB_ZCL_MB_CMD_MAX_STRING_LENGTH + 1)
 
+/******** Read decoded command ********/
+
+/* The request payload is the same data packet as for the json command, with
+ * fc 3 or 4. The response carries the data packet header followed by the
+ * number of values and, per value, type, unit, decimal exponent and a 32-bit
+ * fixed-point value, all taken from the register map of the slave.
+ */
+
+/** @brief Size of the data packet header: fc, slave_id, addr, err, nb_regs */
+#define ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN MODBUS_FRAME_RESP_HDR_LEN
+
+/** @brief Size of one decoded value in a read decoded response */
+#define ZB_ZCL_MODBUS_DECODED_VALUE_LEN 7
+
+/** @brief Maximum number of values in a read decoded response */
+#define ZB_ZCL_MODBUS_DECODED_MAX_VALUES ((ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN - 1) / ZB_ZCL_MODBUS_DECODED_VALUE_LEN)
+
+/******** Read compressed command ********/
+
+/* Only sent to servers with ZB_ZCL_MODBUS_CAP_COMPRESSED in their capabilities
+ * attribute. The request payload is a read data packet followed by the tag of
+ * the baseline held by the requester, 0 if none. The response carries the data
+ * packet header, the tag of the baseline the values are encoded against (0 if
+ * encoded against zero), the tag of the new baseline and the values encoded as
+ * described in modbus_codec.h. The server keeps one baseline per requester and
+ * register range; the requester stores the decoded values under the new tag.
+ */
+
+/** @brief Size of the baseline tags in a read compressed response */
+#define ZB_ZCL_MODBUS_COMPRESSED_TAGS_LEN 2
+
+/** @brief Maximum number of registers in a read compressed request, so that the worst case encoding fits */
+#define ZB_ZCL_MODBUS_COMPRESSED_MAX_REGS MODBUS_CODEC_FRAME_MAX_REGS
+
+/******** Group command ********/
+
+/* The request payload is the same data packet as for the json command and is
+ * sent to a group address. Every member executes it on its own bus and answers
+ * unicast, after a random delay, with a group status response that carries only
+ * the data packet header. The originator collects the answers in a window.
+ */
+
+/** @brief Upper bound of the random delay before a member sends its group status */
+#ifndef ZB_ZCL_MODBUS_GROUP_JITTER_MS
+#define ZB_ZCL_MODBUS_GROUP_JITTER_MS 500
+#endif
+
+/** @brief Collection window used when none is given, covers the bus transaction and the jitter */
+#define ZB_ZCL_MODBUS_GROUP_WINDOW_DEFAULT_MS 3000
+
+/** @brief Maximum number of members listed in a group result */
+#define ZB_ZCL_MODBUS_GROUP_MAX_MEMBERS 32
+
+/** @brief Outcome of a group command on one member */
+typedef struct zb_zcl_modbus_group_member_s {
+    zb_uint16_t short_addr; /**< Address of the member */
+    zb_int16_t  err;        /**< Result, as in the err field of a data packet */
+} zb_zcl_modbus_group_member_t;
+
+/** @brief Aggregated outcome of a group command */
+typedef struct zb_zcl_modbus_group_result_s {
+    zb_uint16_t                  group_addr;                               /**< Group the command was sent to */
+    zb_uint8_t                   expected;                                 /**< Number of answers the originator waited for, 0 if unknown */
+    zb_uint8_t                   received;                                 /**< Number of members that answered */
+    zb_uint8_t                   failed;                                   /**< Number of members that answered with an error */
+    zb_zcl_modbus_group_member_t members[ZB_ZCL_MODBUS_GROUP_MAX_MEMBERS]; /**< First answers, in order of arrival */
+} zb_zcl_modbus_group_result_t;
+
+/** @brief Called when all expected members answered or the window expired */
+typedef void (*zb_zcl_modbus_group_cb_t)(const zb_zcl_modbus_group_result_t* result);
+
+/*! @brief Send a request to a group and aggregate the answers of its members
+    @param buffer - to put packet to, not consumed if an error is returned
+    @param group_addr - group address
+    @param ep - sending endpoint, must have the client role of the Modbus cluster
+    @param prof_id - profile identifier
+    @param req - request data packet
+    @param expected - number of members, the result is reported as soon as all answered; 0 to always wait for the whole window
+    @param window_ms - how long to wait for answers, 0 for ZB_ZCL_MODBUS_GROUP_WINDOW_DEFAULT_MS
+    @param cb - called once with the aggregated result
+    @return RET_OK, RET_BUSY if a group command is already in progress, or RET_INVALID_PARAMETER
+*/
+zb_ret_t zb_zcl_modbus_send_group_cmd(zb_bufid_t buffer, zb_uint16_t group_addr, zb_uint8_t ep, zb_uint16_t prof_id, const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t expected, zb_uint16_t window_ms, zb_zcl_modbus_group_cb_t cb);
+
+/******** Request deadline and cancel command ********/
+
+/* Servers with ZB_ZCL_MODBUS_CAP_DEADLINE in their capabilities attribute
+ * accept a deadline field after the data packet of the json, read decoded,
+ * group and read compressed commands (before the baseline tag of the latter):
+ * the time in milliseconds, from the reception of the request, after which
+ * its answer is useless. Requests without the field use the request timeout
+ * attribute of the server. A request still queued at its deadline is not
+ * executed and is answered with err -ETIME, and the bus timeout of a request
+ * that is executed is bounded by the time left. A deadline of 0 means none.
+ *
+ * The cancel command payload is a string carrying the sequence numbers of the
+ * requests to cancel, or nothing to cancel all the requests of the sender.
+ * Cancelled requests are dropped without an answer; a request already on the
+ * bus completes. It is answered with a default response: success if at least
+ * one request was cancelled, not found otherwise.
+ */
+
+/** @brief Size of the deadline field */
+#define ZB_ZCL_MODBUS_DEADLINE_LEN MODBUS_FRAME_DEADLINE_LEN
+
+/******** Rules download command ********/
+
+/* The request payload is a string carrying the offset of the chunk in the
+ * rules program (2 bytes), the length of the program (2 bytes) and the chunk,
+ * see rules.h for the program format. Chunks are sent in order and answered
+ * with a default response: success, malformed command, invalid value if the
+ * chunk is out of order or the program does not validate, or insufficient
+ * space if the program is too large. A program length of 0 removes the rules.
+ */
+
+/** @brief Size of the offset and program length in a rules download request */
+#define ZB_ZCL_MODBUS_RULES_HDR_LEN 4
+
+/** @brief Maximum size of a chunk in a rules download request */
+#define ZB_ZCL_MODBUS_RULES_MAX_CHUNK (ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - ZB_ZCL_MODBUS_RULES_HDR_LEN)
+
+/******** Stream read, stream data and stream ack commands ********/
+
+/* Only sent to servers with ZB_ZCL_MODBUS_CAP_STREAM in their capabilities
+ * attribute. The stream read request payload is a string carrying fc (3 or 4),
+ * slave_id, addr (2 bytes), the number of registers to read (2 bytes) and the
+ * number of data frames the requester accepts before it acknowledges (1 byte).
+ * Its sequence number identifies the transfer. It is answered with a default
+ * response: success if the transfer started, failure if a transfer of another
+ * requester is in progress, invalid value if the range is empty, wraps or
+ * does not match the register map of the slave.
+ *
+ * The server reads the range in chunks of up to 125 registers and sends every
+ * chunk in a stream data frame, APS fragmented, whose payload is not a string:
+ * the transfer identifier, the data packet header of the chunk (its own addr
+ * and nb_regs) and the values. A chunk with a nonzero err ends the transfer.
+ *
+ * The stream ack request payload is a string carrying the transfer identifier
+ * and the address of the first register not received yet (2 bytes), at a
+ * chunk boundary. The server sends chunks past the acknowledged address up to
+ * the window, and sends the chunks after it again when the same address is
+ * acknowledged twice or no acknowledgement arrives in time. The transfer ends
+ * when the end of the range is acknowledged. A stream read of the same
+ * requester replaces its transfer in progress, so an interrupted transfer is
+ * resumed by requesting the registers not received yet.
+ */
+
+/** @brief Size of the stream read request string */
+#define ZB_ZCL_MODBUS_STREAM_READ_LEN 7
+
+/** @brief Size of the stream ack request string */
+#define ZB_ZCL_MODBUS_STREAM_ACK_LEN 3
+
+/** @brief Size of a stream data frame payload without values: transfer identifier and data packet header */
+#define ZB_ZCL_MODBUS_STREAM_DATA_HDR_LEN (1 + ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN)
+
+/******** Snapshot command ********/
+
+/* Only sent to servers with ZB_ZCL_MODBUS_CAP_SNAPSHOT in their capabilities
+ * attribute. The snapshot request payload is a string carrying an operation,
+ * see zb_zcl_modbus_snapshot_op_e, followed by its arguments:
+ *
+ * - capture: slave_id. The server reads the writable holding registers of the
+ *   register map of the slave into a snapshot stored in NVRAM, see
+ *   modbus_snapshot.h for its format.
+ * - restore: slave_id. The server writes the stored snapshot to the slave with
+ *   write multiple registers requests and reads every range back to verify it.
+ * - export: offset in the snapshot (2 bytes).
+ * - import: offset of the chunk in the snapshot (2 bytes), length of the
+ *   snapshot (2 bytes) and the chunk. Chunks are sent in order, the snapshot
+ *   replaces the stored one once the last chunk has been received and it has
+ *   been validated. A length of 0 removes the stored snapshot. When the
+ *   string holds the header only, the chunk is the rest of the payload after
+ *   the string, so the requester can send the whole snapshot in one APS
+ *   fragmented frame instead of ZB_ZCL_MODBUS_SNAPSHOT_MAX_CHUNK bytes at a
+ *   time.
+ *
+ * Capture, restore and import are answered with a default response: success
+ * if the operation started or the chunk was stored, failure if a capture or
+ * restore is in progress, not found if the slave has no writable registers or
+ * no snapshot is stored, invalid value if the snapshot does not match the
+ * register map of the slave or the chunk is out of order, or insufficient
+ * space. An export is answered with a snapshot response, or a default response
+ * on error.
+ *
+ * The snapshot response payload is not a string, and is APS fragmented when
+ * it exceeds a frame: the operation, err (2 bytes), offset (2 bytes), the
+ * length of the snapshot (2 bytes) and, for an export, the snapshot from the
+ * offset on, up to CONFIG_APP_MODBUS_SNAPSHOT_EXPORT_CHUNK bytes. A response
+ * is also sent to the requester when a capture or a restore ends; if it
+ * failed on a register range, offset is the address of the first register
+ * that could not be read, written or verified.
+ */
+
+/** @brief Snapshot operations */
+enum zb_zcl_modbus_snapshot_op_e
+{
+    ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE = 0,
+    ZB_ZCL_MODBUS_SNAPSHOT_RESTORE = 1,
+    ZB_ZCL_MODBUS_SNAPSHOT_EXPORT  = 2,
+    ZB_ZCL_MODBUS_SNAPSHOT_IMPORT  = 3,
+};
+
+/** @brief Size of the operation, offset and snapshot length in a snapshot import request */
+#define ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN 5
+
+/** @brief Maximum size of a chunk in the string of a snapshot import request */
+#define ZB_ZCL_MODBUS_SNAPSHOT_MAX_CHUNK (ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN)
+
+/** @brief Size of a snapshot response payload without data */
+#define ZB_ZCL_MODBUS_SNAPSHOT_RESP_HDR_LEN 7
+
+/** @brief Send a response frame built in a buffer to a requester, with APS fragmentation permitted.
+ *
+ *  The ZCL send functions do not permit fragmentation. Must be called from the
+ *  Zigbee stack context.
+ *
+ *  @param bufid  Buffer holding the ZCL frame, finished with ZB_ZCL_FINISH_PACKET.
+ *  @param addr   Requester.
+ */
+void zb_zcl_modbus_send_fragmented(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr);
+
 #define ZB_ZCL_MODBUS_GET_JSON_COMMAND_RESP(buf, resp, parse_status)                                                                                                                                                                                     \
     {                                                                                                                                                                                                                                                    \
-        zb_uint8_t len = ((uint8_t*)zb_buf_begin(buf))[0];                                                                                                                                                                                               \
-        status         = ZB_ZCL_PARSE_STATUS_FAILURE;                                                                                                                                                                                                    \
-        if ((zb_uint_t)(len + 1) == zb_buf_len(buf)) {                                                                                                                                                                                                   \
-            resp.len = len;                                                                                                                                                                                                                              \
+        const zb_uint8_t* modbus_str;                                                                                                                                                                                                                    \
+        int               modbus_len = modbus_frame_string(zb_buf_begin(buf), zb_buf_len(buf), ZB_ZCL_MB_CMD_MAX_STRING_LENGTH, &modbus_str);                                                                                                            \
+        parse_status                 = ZB_ZCL_PARSE_STATUS_FAILURE;                                                                                                                                                                                      \
+        if (modbus_len >= 0 && (zb_uint_t)(modbus_len + 1) == zb_buf_len(buf)) {                                                                                                                                                                         \
+            resp.len = (zb_uint8_t)modbus_len;                                                                                                                                                                                                           \
             ZB_MEMSET(resp.data, 0, sizeof(resp.data));                                                                                                                                                                                                  \
-            ZB_MEMCPY(resp.data, (zb_uint8_t*)zb_buf_begin(buf) + 1, len);                                                                                                                                                                               \
-            status = ZB_ZCL_PARSE_STATUS_SUCCESS;                                                                                                                                                                                                        \
+            ZB_MEMCPY(resp.data, modbus_str, modbus_len);                                                                                                                                                                                                \
+            parse_status = ZB_ZCL_PARSE_STATUS_SUCCESS;                                                                                                                                                                                                  \
         }                                                                                                                                                                                                                                                \
     }
 
@@ -294,6 +644,14 @@ typedef struct zb_zcl_modbus_attrs_s {
      * @see ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID
      */
     zb_zcl_modbus_baudrate_t baudrate;
+    /** @copydoc ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID
+     * @see ZB_ZCL_ATTR_MODBUS_CAPABILITIES_ID
+     */
+    zb_uint8_t capabilities;
+    /** @copydoc ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID
+     * @see ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID
+     */
+    zb_uint16_t request_timeout;
 } zb_zcl_modbus_attrs_t;
 
 /*! @} */ /* ZCL Modbus cluster definitions */
@@ -303,10 +661,27 @@ typedef struct zb_zcl_modbus_attrs_s {
 typedef struct {
     void*                            fifo_reserved;
     void*                            cb;
+    zb_bufid_t                       bufid;
+    zb_uint32_t                      deadline; /**< Uptime after which the request is not executed [ms], 0 for none */
     zb_zcl_modbus_addr_t             addr;
     zb_zcl_modbus_data_packet_resp_t resp;
+    zb_uint16_t*                     regs; /**< Register buffer of transfers longer than MAX_NUM_REGISTERS, NULL to use resp.data */
 } modbus_cmd_resp_queue_data_t;
 
+/** @brief Modbus cluster diagnostics counters */
+typedef struct zb_zcl_modbus_diag_s {
+    zb_uint32_t cmd_received;   /**< Cluster specific commands received */
+    zb_uint32_t cmd_rejected;   /**< Commands dropped because they could not be parsed or handled */
+    zb_uint32_t resp_sent;      /**< Responses sent back to the requester */
+    zb_uint32_t bus_errors;     /**< Modbus transactions that ended with an error or exception */
+    zb_uint32_t cmd_duplicates; /**< Repeated requests answered from the dedup cache or the pending transaction */
+    zb_uint32_t cmd_expired;    /**< Requests answered without touching the bus because their deadline passed in the queue */
+    zb_uint32_t cmd_cancelled;  /**< Requests removed from the queue by a cancel command */
+} zb_zcl_modbus_diag_t;
+
+/** @brief Get the Modbus cluster diagnostics counters */
+const zb_zcl_modbus_diag_t* zb_zcl_modbus_get_diag(void);
+
 void zb_zcl_modbus_init_server(void);
 void zb_zcl_modbus_init_client(void);
 #define ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_INIT zb_zcl_modbus_init_server
@@ -0,0 +1,236 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2023 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+
+"""Create a delta firmware update patch between two signed images.
+
+The patch format is described in include/delta_ota.h. The patch is applied
+on the device to the image running in mcuboot_primary, so OLD must be the
+signed image (app_update.bin) the device runs, and NEW the signed image to
+update to. The output is wrapped into a Zigbee OTA file the same way as a
+full app_update.bin.
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = 0x544C445A
+VERSION = 1
+
+OP_COPY = 0x01
+OP_DATA = 0x02
+OP_ADD = 0x03
+
+COPY_LEN = 9
+DATA_LEN = 3
+DATA_MAX = 0xFFFF
+ADD_LEN = 11
+ADD_PAIR_LEN = 2
+ADD_GAP_MAX = 0xFF
+ADD_PAIRS_MAX = 0xFFFF
+
+# Length of the blocks indexed in the old image, and of the shortest copy
+# worth a record.
+BLOCK = 16
+MIN_COPY = 2 * COPY_LEN
+# Candidates tried for a block found several times in the old image.
+MAX_CANDIDATES = 8
+# An approximate match ends once it is this many bytes worse than a literal
+# at its best length.
+ADD_STOP = 32
+
+
+def index_blocks(old):
+    index = {}
+    for offset in range(len(old) - BLOCK + 1):
+        candidates = index.setdefault(old[offset:offset + BLOCK], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(offset)
+    return index
+
+
+def match_len(old, old_pos, new, new_pos):
+    length = 0
+    while old_pos + length < len(old) and new_pos + length < len(new) and old[old_pos + length] == new[new_pos + length]:
+        length += 1
+    return length
+
+
+def approx_len(old, old_pos, new, new_pos):
+    """Return the length over which new is best encoded as old plus a sparse
+    difference, and the bytes saved over a literal.
+
+    Like bsdiff, an equal byte scores one and a different byte, which takes a
+    pair instead of a literal byte, scores minus one.
+    """
+    best_len = 0
+    best_score = 0
+    score = 0
+    i = 0
+    while old_pos + i < len(old) and new_pos + i < len(new):
+        score += 1 if old[old_pos + i] == new[new_pos + i] else -1
+        i += 1
+        if score > best_score:
+            best_len, best_score = i, score
+        elif score < best_score - ADD_STOP:
+            break
+    return best_len, best_score
+
+
+def add_pairs(old, offset, data):
+    """Return the (gap, delta) pairs turning old[offset:] into data."""
+    pairs = []
+    gap = 0
+    for i, byte in enumerate(data):
+        delta = (byte - old[offset + i]) & 0xFF
+        if delta == 0 and gap < ADD_GAP_MAX:
+            gap += 1
+            continue
+        pairs.append((gap, delta))
+        gap = 0
+    return pairs
+
+
+def diff(old, new):
+    """Return a list of (OP_COPY, offset, length), (OP_DATA, bytes) and
+    (OP_ADD, offset, bytes) records."""
+    index = index_blocks(old)
+    records = []
+    literal = bytearray()
+    pos = 0
+    # Offset in the old image following the last copy, where unchanged code
+    # usually continues.
+    next_old = None
+
+    while pos < len(new):
+        # Shifted pointers and branch offsets break an exact match, the code
+        # around them usually continues at the same offset.
+        if next_old is not None:
+            length, saved = approx_len(old, next_old, new, pos)
+            if saved > ADD_LEN + DATA_LEN:
+                if literal:
+                    records.append((OP_DATA, bytes(literal)))
+                    literal.clear()
+                records.append((OP_ADD, next_old, bytes(new[pos:pos + length])))
+                pos += length
+                next_old += length
+                continue
+
+        best_len = 0
+        best_off = 0
+        candidates = index.get(bytes(new[pos:pos + BLOCK]), [])
+        for offset in candidates:
+            length = match_len(old, offset, new, pos)
+            if length > best_len:
+                best_len, best_off = length, offset
+
+        if best_len < MIN_COPY:
+            literal.append(new[pos])
+            pos += 1
+            next_old = None
+            continue
+
+        pos += best_len
+
+        # Take back the end of the pending literal when it matches too.
+        while literal and best_off > 0 and old[best_off - 1] == literal[-1]:
+            literal.pop()
+            best_off -= 1
+            best_len += 1
+
+        if literal:
+            records.append((OP_DATA, bytes(literal)))
+            literal.clear()
+        records.append((OP_COPY, best_off, best_len))
+        next_old = best_off + best_len
+
+    if literal:
+        records.append((OP_DATA, bytes(literal)))
+    return records
+
+
+def encode(old, new, records):
+    out = bytearray(struct.pack("<IB3xIIII", MAGIC, VERSION, len(old), zlib.crc32(old), len(new), zlib.crc32(new)))
+    for record in records:
+        if record[0] == OP_COPY:
+            out += struct.pack("<BII", OP_COPY, record[1], record[2])
+            continue
+        if record[0] == OP_ADD:
+            offset, data = record[1], record[2]
+            pairs = add_pairs(old, offset, data)
+            # Split where the pairs do not fit a record.
+            start = 0
+            for first in range(0, max(len(pairs), 1), ADD_PAIRS_MAX):
+                chunk = pairs[first:first + ADD_PAIRS_MAX]
+                end = len(data) if first + ADD_PAIRS_MAX >= len(pairs) else start + sum(gap + 1 for gap, _ in chunk)
+                out += struct.pack("<BIIH", OP_ADD, offset + start, end - start, len(chunk))
+                out += b"".join(struct.pack("<BB", gap, delta) for gap, delta in chunk)
+                start = end
+            continue
+        data = record[1]
+        for start in range(0, len(data), DATA_MAX):
+            chunk = data[start:start + DATA_MAX]
+            out += struct.pack("<BH", OP_DATA, len(chunk)) + chunk
+    return bytes(out)
+
+
+def apply(old, patch):
+    """Rebuild the new image from a patch, as the device does."""
+    magic, version, old_size, old_crc, new_size, new_crc = struct.unpack_from("<IB3xIIII", patch)
+    if magic != MAGIC or version != VERSION or old_size != len(old) or old_crc != zlib.crc32(old):
+        raise ValueError("patch does not apply to this image")
+    new = bytearray()
+    pos = struct.calcsize("<IB3xIIII")
+    while pos < len(patch):
+        if patch[pos] == OP_COPY:
+            _, offset, length = struct.unpack_from("<BII", patch, pos)
+            new += old[offset:offset + length]
+            pos += COPY_LEN
+        elif patch[pos] == OP_DATA:
+            _, length = struct.unpack_from("<BH", patch, pos)
+            new += patch[pos + DATA_LEN:pos + DATA_LEN + length]
+            pos += DATA_LEN + length
+        elif patch[pos] == OP_ADD:
+            _, offset, length, count = struct.unpack_from("<BIIH", patch, pos)
+            data = bytearray(old[offset:offset + length])
+            i = 0
+            for gap, delta in struct.iter_unpack("<BB", patch[pos + ADD_LEN:pos + ADD_LEN + ADD_PAIR_LEN * count]):
+                i += gap
+                data[i] = (data[i] + delta) & 0xFF
+                i += 1
+            new += data
+            pos += ADD_LEN + ADD_PAIR_LEN * count
+        else:
+            raise ValueError("invalid record at %d" % pos)
+    if len(new) != new_size or zlib.crc32(new) != new_crc:
+        raise ValueError("patched image does not match")
+    return bytes(new)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("old", help="signed image running on the devices")
+    parser.add_argument("new", help="signed image to update to")
+    parser.add_argument("-o", "--output", required=True, help="patch file")
+    args = parser.parse_args()
+
+    with open(args.old, "rb") as f:
+        old = f.read()
+    with open(args.new, "rb") as f:
+        new = f.read()
+
+    patch = encode(old, new, diff(old, new))
+    apply(old, patch)
+
+    with open(args.output, "wb") as f:
+        f.write(patch)
+
+    print("%s: %d bytes, %.1f%% of %d bytes" % (args.output, len(patch), 100.0 * len(patch) / len(new), len(new)), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,486 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2023 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+
+"""Load test the Modbus cluster request pipeline.
+
+slave  Serve scripted Modbus RTU slaves on a pseudo terminal, to connect
+       the Modbus client of a device through a serial adapter, or of any
+       other build, to slaves with known response times and losses.
+
+fleet  Simulate a fleet of routers, each with its own bus of scripted
+       slaves, and drive Modbus cluster read requests at a given rate per
+       router. The ZBOSS stack only runs on nRF hardware, so the routers
+       are a model of the firmware pipeline: shared radio channel, hop
+       latency, request queue (src/modbus_client.c), deadlines, per-slave
+       timeouts and offline slaves. Report end-to-end latency percentiles,
+       queue saturation and drop rates. With several rates, one line is
+       printed per rate, to find the saturation point.
+
+Changes to src/zb_zcl_modbus.c or src/modbus_client.c that affect the
+pipeline should be reflected in the Firmware class below.
+"""
+
+import argparse
+import collections
+import heapq
+import json
+import os
+import random
+import select
+import struct
+import sys
+import time
+import tty
+
+# Firmware constants, keep in sync with src/modbus_client.c and Kconfig.
+QUEUE_SIZE = 10
+TIMEOUT_MIN_MS = 50
+TIMEOUT_MAX_MS = 1000
+TIMEOUT_LOWER_AFTER = 8
+BACKOFF_MAX_SHIFT = 4
+OFFLINE_TIMEOUTS = 3
+PROBE_INTERVAL_MS = 10000
+
+FC_READ_HOLDING_REGS = 3
+FC_READ_INPUT_REGS = 4
+FC_WRITE_HOLDING_REG = 6
+FC_WRITE_HOLDING_REGS = 16
+
+EXCP_ILLEGAL_FUNC = 1
+EXCP_SERVER_DEV_BUSY = 6
+EXCP_GATE_TARGET_FAILED_TO_RESPOND = 11
+
+# Bits per character on the bus: start, 8 data bits, 2 stop bits without parity.
+BITS_PER_CHAR = 11
+# Silent interval after each frame [characters]
+FRAME_GAP_CHARS = 3.5
+
+# IEEE 802.15.4 at 2.4 GHz: 32 us per byte, and the bytes of the PHY, MAC,
+# NWK, APS and ZCL headers around the Modbus cluster payload.
+RADIO_US_PER_BYTE = 32
+RADIO_HEADER_LEN = 45
+# Mean CSMA-CA backoff and turnaround per hop, including the MAC ACK.
+RADIO_HOP_OVERHEAD_US = 1800
+# Frames that would wait longer for the channel are dropped, as when the
+# stack runs out of buffers or channel access fails.
+RADIO_MAX_WAIT_MS = 500
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def rtu_frame(pdu):
+    return pdu + struct.pack("<H", crc16(pdu))
+
+
+def rtu_request_len(fc, nb_regs):
+    if fc == FC_WRITE_HOLDING_REGS:
+        return 9 + 2 * nb_regs
+    return 8
+
+
+def rtu_response_len(fc, nb_regs):
+    if fc in (FC_READ_HOLDING_REGS, FC_READ_INPUT_REGS):
+        return 5 + 2 * nb_regs
+    return 8
+
+
+def line_ms(fc, nb_regs, baudrate):
+    """Same as modbus_timing_line_ms() in src/modbus_timing.c."""
+    halves = 2 * (rtu_request_len(fc, nb_regs) + rtu_response_len(fc, nb_regs)) + int(4 * FRAME_GAP_CHARS)
+    return -(-halves * BITS_PER_CHAR * 1000 // (2 * baudrate))
+
+
+def timeout_step(timeout):
+    """Same as timeout_step() in src/modbus_client.c."""
+    step = TIMEOUT_MIN_MS
+    while step < timeout:
+        step <<= 1
+    return step
+
+
+class Slave:
+    """Scripted slave: response delay, jitter and probability of not answering."""
+
+    def __init__(self, slave_id, delay_ms, jitter_ms=0.0, loss=0.0):
+        self.slave_id = slave_id
+        self.delay_ms = delay_ms
+        self.jitter_ms = jitter_ms
+        self.loss = loss
+        self.registers = collections.defaultdict(int)
+
+    @classmethod
+    def parse(cls, spec):
+        """ID:DELAY_MS[:JITTER_MS[:LOSS]]"""
+        fields = spec.split(":")
+        if not 2 <= len(fields) <= 4:
+            raise argparse.ArgumentTypeError("expected ID:DELAY_MS[:JITTER_MS[:LOSS]], got %r" % spec)
+        values = [float(f) for f in fields[1:]]
+        return cls(int(fields[0], 0), *values)
+
+    def answer_delay_ms(self, rng):
+        """Delay before the slave answers, None if it does not."""
+        if rng.random() < self.loss:
+            return None
+        return max(0.0, rng.gauss(self.delay_ms, self.jitter_ms) if self.jitter_ms else self.delay_ms)
+
+    def handle(self, pdu):
+        """Response PDU to a request PDU, without the slave ID."""
+        fc = pdu[0]
+        if fc in (FC_READ_HOLDING_REGS, FC_READ_INPUT_REGS) and len(pdu) == 5:
+            addr, count = struct.unpack(">HH", pdu[1:5])
+            values = [self.registers[(fc, addr + i)] for i in range(count)]
+            return struct.pack(">BB%dH" % count, fc, 2 * count, *values)
+        if fc == FC_WRITE_HOLDING_REG and len(pdu) == 5:
+            addr, value = struct.unpack(">HH", pdu[1:5])
+            self.registers[(FC_READ_HOLDING_REGS, addr)] = value
+            return pdu
+        if fc == FC_WRITE_HOLDING_REGS and len(pdu) >= 6:
+            addr, count, nbytes = struct.unpack(">HHB", pdu[1:6])
+            values = struct.unpack(">%dH" % count, pdu[6:6 + nbytes])
+            for i, value in enumerate(values):
+                self.registers[(FC_READ_HOLDING_REGS, addr + i)] = value
+            return pdu[:5]
+        return bytes([fc | 0x80, EXCP_ILLEGAL_FUNC])
+
+
+def serve_slaves(args):
+    slaves = {slave.slave_id: slave for slave in args.slave}
+    rng = random.Random(args.seed)
+    master, pty = os.openpty()
+    tty.setraw(master)
+    tty.setraw(pty)
+    print("Modbus slaves %s on %s" % (", ".join(str(s) for s in sorted(slaves)), os.ttyname(pty)), file=sys.stderr)
+
+    # A frame ends after 3.5 characters of silence.
+    gap = max(3.5 * BITS_PER_CHAR / args.baudrate, 0.00175)
+    frame = bytearray()
+    while True:
+        ready, _, _ = select.select([master], [], [], gap if frame else None)
+        if ready:
+            frame += os.read(master, 256)
+            continue
+
+        if len(frame) < 4 or crc16(frame) != 0:
+            print("dropped %d bytes" % len(frame), file=sys.stderr)
+        elif frame[0] in slaves:
+            slave = slaves[frame[0]]
+            delay = slave.answer_delay_ms(rng)
+            if delay is not None:
+                time.sleep(delay / 1000.0)
+                os.write(master, rtu_frame(bytes([slave.slave_id]) + slave.handle(bytes(frame[1:-2]))))
+        frame.clear()
+
+
+class Simulator:
+    def __init__(self):
+        self.now = 0.0
+        self.events = []
+        self.seq = 0
+
+    def at(self, when, callback, *args):
+        self.seq += 1
+        heapq.heappush(self.events, (when, self.seq, callback, args))
+
+    def run(self, until):
+        while self.events and self.events[0][0] <= until:
+            self.now, _, callback, args = heapq.heappop(self.events)
+            callback(*args)
+        self.now = until
+
+
+class Channel:
+    """Radio channel shared by all routers: frames are sent one after the other."""
+
+    def __init__(self, sim):
+        self.sim = sim
+        self.busy_until = 0.0
+        self.busy_time = 0.0
+
+    def send(self, payload_len, hops):
+        """Time at which a frame relayed over hops is delivered in ms, None if it is dropped."""
+        airtime = ((RADIO_HEADER_LEN + payload_len) * RADIO_US_PER_BYTE + RADIO_HOP_OVERHEAD_US) / 1000.0
+        if self.busy_until - self.sim.now > RADIO_MAX_WAIT_MS:
+            return None
+        t = self.sim.now
+        for _ in range(hops):
+            start = max(t, self.busy_until)
+            self.busy_until = start + airtime
+            self.busy_time += airtime
+            t = self.busy_until
+        return t
+
+
+class SlaveTiming:
+    """Same response time model as struct slave_timing in src/modbus_client.c and src/modbus_timing.c."""
+
+    def __init__(self):
+        self.answered = False
+        self.misses = 0
+        self.srtt8 = 0
+        self.rttvar4 = 0
+        self.probe_time = 0.0
+
+    def offline(self):
+        return self.misses >= OFFLINE_TIMEOUTS
+
+    def timeout(self, line):
+        timeout = TIMEOUT_MAX_MS
+        if self.answered:
+            timeout = min(max(self.srtt8 // 8 + self.rttvar4, TIMEOUT_MIN_MS), TIMEOUT_MAX_MS)
+        if not self.offline():
+            timeout <<= min(self.misses, BACKOFF_MAX_SHIFT)
+        return min(timeout, TIMEOUT_MAX_MS) + line
+
+    def update(self, answered, elapsed, line, now):
+        if not answered:
+            self.misses += 1
+            if self.misses == OFFLINE_TIMEOUTS:
+                self.probe_time = now
+            return
+        rtt = max(int(elapsed) - line, 0)
+        self.misses = 0
+        if not self.answered:
+            self.srtt8, self.rttvar4, self.answered = rtt * 8, rtt * 2, True
+        else:
+            self.rttvar4 += abs(rtt - self.srtt8 // 8) - self.rttvar4 // 4
+            self.srtt8 += rtt - self.srtt8 // 8
+
+
+Request = collections.namedtuple("Request", "created router slave_id nb_regs deadline")
+
+
+class Firmware:
+    """Modbus cluster server and client queue of one router."""
+
+    def __init__(self, fleet, index, slaves, hops):
+        self.fleet = fleet
+        self.sim = fleet.sim
+        self.index = index
+        self.slaves = slaves
+        self.hops = hops
+        self.queue = collections.deque()
+        self.busy = False
+        self.timings = collections.defaultdict(SlaveTiming)
+        self.bus_time = 0.0
+        self.iface_timeout = timeout_step(TIMEOUT_MAX_MS)
+        self.lower_count = 0
+        self.lower_timeout = 0
+
+    def reconfigure(self, timeout):
+        """Interface timeout of the next transaction, as client_reconfigure() in src/modbus_client.c."""
+        timeout = timeout_step(timeout)
+        if timeout >= self.iface_timeout:
+            self.lower_count, self.lower_timeout = 0, 0
+        else:
+            self.lower_count += 1
+            self.lower_timeout = max(self.lower_timeout, timeout)
+            if self.lower_count < TIMEOUT_LOWER_AFTER:
+                return
+            timeout = self.lower_timeout
+            self.lower_count, self.lower_timeout = 0, 0
+        if timeout != self.iface_timeout:
+            self.iface_timeout = timeout
+            self.fleet.reconfigs += 1
+
+    def receive(self, req):
+        if len(self.queue) >= QUEUE_SIZE:
+            self.fleet.queue_full += 1
+            self.reply(req, "busy")
+            return
+        self.queue.append(req)
+        self.fleet.queue_depth_max = max(self.fleet.queue_depth_max, len(self.queue))
+        if not self.busy:
+            self.next()
+
+    def next(self):
+        if not self.queue:
+            self.busy = False
+            return
+        self.busy = True
+        req = self.queue.popleft()
+        now = self.sim.now
+        timing = self.timings[req.slave_id]
+
+        if req.deadline and now >= req.deadline:
+            self.reply(req, "expired")
+            self.sim.at(now, self.next)
+            return
+        if timing.offline() and now - timing.probe_time < PROBE_INTERVAL_MS:
+            self.reply(req, "offline")
+            self.sim.at(now, self.next)
+            return
+        if timing.offline():
+            timing.probe_time = now
+
+        line = line_ms(FC_READ_HOLDING_REGS, req.nb_regs, self.fleet.baudrate)
+        self.reconfigure(timing.timeout(line))
+        timeout = self.iface_timeout
+
+        char_ms = BITS_PER_CHAR * 1000.0 / self.fleet.baudrate
+        tx = rtu_request_len(FC_READ_HOLDING_REGS, req.nb_regs) * char_ms
+        slave = self.slaves[req.slave_id]
+        delay = slave.answer_delay_ms(self.fleet.rng)
+        rx = rtu_response_len(FC_READ_HOLDING_REGS, req.nb_regs) * char_ms
+        # The timeout of the Zephyr Modbus client starts with the transmission of the request.
+        elapsed = tx + 3.5 * char_ms + delay + rx if delay is not None else None
+        if elapsed is not None and elapsed <= timeout:
+            timing.update(True, elapsed, line, now + elapsed)
+            outcome = "ok"
+        else:
+            elapsed = timeout
+            timing.update(False, elapsed, line, now + elapsed)
+            outcome = "timeout"
+
+        self.bus_time += elapsed
+        self.sim.at(now + elapsed, self.done, req, outcome)
+
+    def done(self, req, outcome):
+        self.reply(req, outcome)
+        self.next()
+
+    def reply(self, req, outcome):
+        payload_len = 8 + (2 * req.nb_regs if outcome == "ok" else 0)
+        self.fleet.transmit(payload_len, self.hops, self.fleet.record, req, outcome)
+
+
+class Fleet:
+    def __init__(self, args, rate):
+        self.sim = Simulator()
+        self.rng = random.Random(args.seed)
+        self.channel = Channel(self.sim)
+        self.baudrate = args.baudrate
+        self.loss = args.loss
+        self.rate = rate
+        self.nb_regs = args.regs
+        self.deadline_ms = args.deadline_ms
+        self.routers = [Firmware(self, i, {s.slave_id: s for s in args.slave}, self.rng.randint(1, args.max_hops)) for i in range(args.routers)]
+        self.latencies = []
+        self.outcomes = collections.Counter()
+        self.queue_full = 0
+        self.queue_depth_max = 0
+        self.reconfigs = 0
+        self.warmup = args.warmup_s * 1000.0
+
+    def generate(self, router):
+        slave_id = self.rng.choice(list(router.slaves))
+        req = Request(self.sim.now, router.index, slave_id, self.nb_regs, 0)
+        payload_len = 7 + (2 if self.deadline_ms else 0)
+        self.transmit(payload_len, router.hops, self.deliver, router, req)
+        self.sim.at(self.sim.now + self.rng.expovariate(self.rate) * 1000.0, self.generate, router)
+
+    def transmit(self, payload_len, hops, callback, *args):
+        """Send a frame, the request is recorded as lost or dropped if it does not arrive."""
+        req = next(a for a in args if isinstance(a, Request))
+        if self.rng.random() < self.loss:
+            self.record(req, "lost")
+            return
+        delivered = self.channel.send(payload_len, hops)
+        if delivered is None:
+            self.record(req, "dropped")
+            return
+        self.sim.at(delivered, callback, *args)
+
+    def deliver(self, router, req):
+        # The deadline is relative to the reception of the request.
+        if self.deadline_ms:
+            req = req._replace(deadline=self.sim.now + self.deadline_ms)
+        router.receive(req)
+
+    def record(self, req, outcome):
+        if req.created < self.warmup:
+            return
+        self.outcomes[outcome] += 1
+        if outcome == "ok":
+            self.latencies.append(self.sim.now - req.created)
+
+    def run(self, duration_s):
+        for router in self.routers:
+            self.sim.at(self.rng.uniform(0, 1000.0 / self.rate), self.generate, router)
+        end = self.warmup + duration_s * 1000.0
+        self.sim.run(end)
+        return self.report(end - self.warmup)
+
+    def report(self, duration_ms):
+        total = sum(self.outcomes.values())
+        latencies = sorted(self.latencies)
+
+        def percentile(p):
+            if not latencies:
+                return None
+            return round(latencies[min(len(latencies) - 1, int(p / 100.0 * len(latencies)))], 1)
+
+        return {
+            "rate": self.rate,
+            "routers": len(self.routers),
+            "requests": total,
+            "outcomes": {k: round(v / total, 4) if total else 0 for k, v in sorted(self.outcomes.items())},
+            "latency_ms": {"p50": percentile(50), "p90": percentile(90), "p99": percentile(99), "max": round(latencies[-1], 1) if latencies else None},
+            "queue_full": self.queue_full,
+            "queue_depth_max": self.queue_depth_max,
+            "reconfigs": self.reconfigs,
+            "channel_utilization": round(min(1.0, self.channel.busy_time / (self.sim.now or 1)), 3),
+            "bus_utilization": round(max(r.bus_time for r in self.routers) / (self.sim.now or 1), 3),
+        }
+
+
+def print_table(reports):
+    print("%8s %9s %8s %8s %8s %8s %8s %8s %8s %8s %7s %7s %8s" % ("rate/s", "requests", "ok", "busy", "expired", "timeout", "lost", "p50 ms", "p99 ms", "max ms", "radio", "bus", "reconfig"))
+    for r in reports:
+        o = r["outcomes"]
+        print("%8g %9d %7.1f%% %7.1f%% %7.1f%% %7.1f%% %7.1f%% %8s %8s %8s %6.0f%% %6.0f%% %8d" %
+              (r["rate"], r["requests"], 100 * o.get("ok", 0), 100 * o.get("busy", 0), 100 * o.get("expired", 0), 100 * (o.get("timeout", 0) + o.get("offline", 0)), 100 * (o.get("lost", 0) + o.get("dropped", 0)),
+               r["latency_ms"]["p50"], r["latency_ms"]["p99"], r["latency_ms"]["max"], 100 * r["channel_utilization"], 100 * r["bus_utilization"], r["reconfigs"]))
+
+
+def run_fleet(args):
+    if not args.slave:
+        args.slave = [Slave(1, 5.0, 1.0), Slave(2, 200.0, 20.0), Slave(3, 20.0, 5.0, 0.02)]
+    reports = [Fleet(args, rate).run(args.duration_s) for rate in args.rates]
+    if args.json:
+        json.dump(reports, sys.stdout, indent=2)
+        print()
+    else:
+        print_table(reports)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--slave", type=Slave.parse, action="append", default=[], help="scripted slave ID:DELAY_MS[:JITTER_MS[:LOSS]], repeatable")
+    parser.add_argument("--baudrate", type=int, default=19200, help="bus baudrate (default: %(default)s)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: %(default)s)")
+    sub = parser.add_subparsers(dest="mode", required=True)
+
+    sub.add_parser("slave", help="serve the scripted slaves on a pseudo terminal")
+
+    fleet = sub.add_parser("fleet", help="simulate a fleet of routers")
+    fleet.add_argument("--routers", type=int, default=200, help="number of routers (default: %(default)s)")
+    fleet.add_argument("--rates", type=lambda s: [float(r) for r in s.split(",")], default=[0.1, 0.5, 1, 2, 5], help="comma separated requests per second per router (default: 0.1,0.5,1,2,5)")
+    fleet.add_argument("--regs", type=int, default=10, help="registers per read (default: %(default)s)")
+    fleet.add_argument("--deadline-ms", type=int, default=0, help="deadline field of the requests, 0 for none (default: %(default)s)")
+    fleet.add_argument("--max-hops", type=int, default=3, help="routers are 1 to this many hops from the coordinator (default: %(default)s)")
+    fleet.add_argument("--loss", type=float, default=0.0, help="probability of losing a frame end to end (default: %(default)s)")
+    fleet.add_argument("--duration-s", type=float, default=300, help="simulated time per rate (default: %(default)s)")
+    fleet.add_argument("--warmup-s", type=float, default=30, help="simulated time before measuring (default: %(default)s)")
+    fleet.add_argument("--json", action="store_true", help="print the reports as JSON")
+
+    args = parser.parse_args()
+    if args.mode == "slave":
+        if not args.slave:
+            parser.error("slave mode needs at least one --slave")
+        serve_slaves(args)
+    else:
+        run_fleet(args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Host test of the compressed register codec (include/modbus_codec.h).
+ *
+ * Round trip of random and typical register blocks, empty and maximum size
+ * blocks, output buffers too small and corrupt streams, run from the
+ * repository root:
+ *
+ *     cc -g -O1 -fsanitize=address,undefined -Iinclude -o modbus_codec_test scripts/modbus_codec_test.c src/modbus_codec.c
+ *     ./modbus_codec_test [iterations]
+ *
+ * Compression ratio and encode/decode throughput of typical blocks:
+ *
+ *     cc -O2 -DMODBUS_CODEC_BENCH -Iinclude -o modbus_codec_bench scripts/modbus_codec_test.c src/modbus_codec.c
+ *     ./modbus_codec_bench [blocks]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modbus_codec.h"
+
+#define MAX_REGS 255
+
+/* Kind of block, from a live device to random noise */
+enum block_kind {
+    BLOCK_SAME,     /* Nothing changed since the baseline */
+    BLOCK_DRIFT,    /* A few registers moved by a small step, like measurements between two polls */
+    BLOCK_SETTINGS, /* Small values without a baseline, like configuration registers */
+    BLOCK_RANDOM,
+    BLOCK_KIND_COUNT,
+};
+
+static void make_block(enum block_kind kind, uint8_t nb_regs, uint16_t* values, uint16_t* baseline) {
+    for (uint16_t i = 0; i < nb_regs; i++) {
+        baseline[i] = (uint16_t)rand();
+        switch (kind) {
+        case BLOCK_SAME:
+            values[i] = baseline[i];
+            break;
+        case BLOCK_DRIFT:
+            values[i] = (rand() % 4 == 0) ? (uint16_t)(baseline[i] + rand() % 33 - 16) : baseline[i];
+            break;
+        case BLOCK_SETTINGS:
+            values[i] = (rand() % 3 == 0) ? 0 : (uint16_t)(rand() % 200);
+            break;
+        default:
+            values[i] = (uint16_t)rand();
+            break;
+        }
+    }
+}
+
+#ifndef MODBUS_CODEC_BENCH
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                                                                                                                                                                                 \
+    do {                                                                                                                                                                                                                                                 \
+        if (!(cond)) {                                                                                                                                                                                                                                   \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                                                                                                                                                  \
+            printf(__VA_ARGS__);                                                                                                                                                                                                                         \
+            printf("\n");                                                                                                                                                                                                                                \
+            failures++;                                                                                                                                                                                                                                  \
+            return;                                                                                                                                                                                                                                      \
+        }                                                                                                                                                                                                                                                \
+    } while (0)
+
+/* Encode into a buffer of exactly the maximum size, so that any overrun is caught by the address sanitizer. */
+static void round_trip(const uint16_t* values, const uint16_t* baseline, uint8_t nb_regs) {
+    size_t    max     = MODBUS_CODEC_MAX_LEN(nb_regs);
+    uint8_t*  enc     = malloc(max ? max : 1);
+    uint16_t* decoded = malloc(sizeof(uint16_t) * (nb_regs ? nb_regs : 1));
+    int       len     = modbus_codec_encode(values, baseline, nb_regs, enc, max);
+    int       used;
+
+    if (len < 0 || (size_t)len > max) {
+        printf("FAIL: encode of %u registers returned %d\n", nb_regs, len);
+        failures++;
+        goto out;
+    }
+
+    used = modbus_codec_decode(enc, (size_t)len, baseline, nb_regs, decoded);
+    if (used != len || memcmp(values, decoded, sizeof(uint16_t) * nb_regs) != 0) {
+        printf("FAIL: round trip of %u registers, %d of %d bytes decoded\n", nb_regs, used, len);
+        failures++;
+        goto out;
+    }
+
+    /* Every shorter output buffer is either enough or reported too small. */
+    for (size_t size = 0; size < (size_t)len; size++) {
+        uint8_t* small = malloc(size ? size : 1);
+
+        if (modbus_codec_encode(values, baseline, nb_regs, small, size) != -ENOSPC) {
+            printf("FAIL: encode of %d bytes into %zu did not fail\n", len, size);
+            failures++;
+            free(small);
+            goto out;
+        }
+        free(small);
+    }
+
+    /* Every truncation of a stream holding values is rejected. */
+    for (int cut = 0; cut < len; cut++) {
+        uint8_t* part = malloc(cut ? (size_t)cut : 1);
+
+        memcpy(part, enc, (size_t)cut);
+        if (modbus_codec_decode(part, (size_t)cut, baseline, nb_regs, decoded) != -EINVAL) {
+            printf("FAIL: truncation of %d bytes to %d was decoded\n", len, cut);
+            failures++;
+            free(part);
+            goto out;
+        }
+        free(part);
+    }
+
+out:
+    free(enc);
+    free(decoded);
+}
+
+static void test_empty(void) {
+    uint8_t  out[1] = {0xAA};
+    uint16_t value  = 0x1234;
+
+    CHECK(modbus_codec_encode(NULL, NULL, 0, out, 0) == 0, "empty encode");
+    CHECK(modbus_codec_decode(out, 0, NULL, 0, &value) == 0, "empty decode");
+    CHECK(value == 0x1234, "empty decode wrote a value");
+}
+
+static void test_extremes(void) {
+    uint16_t values[MAX_REGS];
+    uint16_t baseline[MAX_REGS];
+    uint8_t  out[MODBUS_CODEC_MAX_LEN(MAX_REGS)];
+
+    /* The largest difference in both directions takes 3 bytes. */
+    for (uint16_t i = 0; i < MAX_REGS; i++) {
+        baseline[i] = (i % 2) ? 0x0000 : 0xFFFF;
+        values[i]   = (i % 2) ? 0x8000 : 0x7FFF;
+    }
+    CHECK(modbus_codec_encode(values, baseline, MAX_REGS, out, sizeof(out)) == (int)sizeof(out), "worst case is MODBUS_CODEC_MAX_LEN");
+    round_trip(values, baseline, MAX_REGS);
+
+    for (uint16_t i = 0; i < MAX_REGS; i++) {
+        values[i] = 0xFFFF;
+    }
+    round_trip(values, NULL, MAX_REGS);
+    CHECK(MODBUS_CODEC_MAX_LEN(MODBUS_CODEC_FRAME_MAX_REGS) <= MODBUS_CODEC_FRAME_LEN, "worst case fits in a frame");
+    round_trip(values, NULL, MODBUS_CODEC_FRAME_MAX_REGS);
+    round_trip(values, values, MAX_REGS);
+    CHECK(modbus_codec_encode(values, values, MAX_REGS, out, sizeof(out)) == MODBUS_CODEC_BITMAP_LEN(MAX_REGS), "unchanged block is its bitmap");
+}
+
+static void test_corrupt(long iterations) {
+    uint8_t  in[MODBUS_CODEC_MAX_LEN(MAX_REGS) + 8];
+    uint16_t values[MAX_REGS];
+
+    /* A varint longer than 5 bytes, and a bitmap without its values */
+    memset(in, 0xFF, sizeof(in));
+    CHECK(modbus_codec_decode(in, sizeof(in), NULL, 8, values) == -EINVAL, "overlong varint");
+    CHECK(modbus_codec_decode(in, 1, NULL, 8, values) == -EINVAL, "bitmap only");
+    CHECK(modbus_codec_decode(in, 1, NULL, 9, values) == -EINVAL, "short bitmap");
+
+    /* Random bytes are either rejected or decoded without reading past the input. */
+    for (long n = 0; n < iterations; n++) {
+        uint8_t  nb_regs = (uint8_t)(rand() % (MAX_REGS + 1));
+        size_t   len     = (size_t)rand() % sizeof(in);
+        uint8_t* buf     = malloc(len ? len : 1);
+        int      used;
+
+        for (size_t i = 0; i < len; i++) {
+            buf[i] = (uint8_t)rand();
+        }
+        used = modbus_codec_decode(buf, len, NULL, nb_regs, values);
+        free(buf);
+        CHECK(used == -EINVAL || (used >= (int)MODBUS_CODEC_BITMAP_LEN(nb_regs) && (size_t)used <= len), "corrupt stream of %zu bytes returned %d", len, used);
+    }
+}
+
+static void test_blocks(long iterations) {
+    uint16_t values[MAX_REGS];
+    uint16_t baseline[MAX_REGS];
+
+    for (long n = 0; n < iterations; n++) {
+        enum block_kind kind    = (enum block_kind)(n % BLOCK_KIND_COUNT);
+        uint8_t         nb_regs = (uint8_t)(rand() % (MAX_REGS + 1));
+
+        make_block(kind, nb_regs, values, baseline);
+        round_trip(values, (kind == BLOCK_SETTINGS) ? NULL : baseline, nb_regs);
+    }
+}
+
+int main(int argc, char** argv) {
+    long iterations = (argc > 1) ? atol(argv[1]) : 20000;
+
+    srand(1);
+    test_empty();
+    test_extremes();
+    test_corrupt(iterations);
+    test_blocks(iterations);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
+
+#else
+
+#include <time.h>
+
+#define BENCH_BLOCKS 256
+
+static const char* const kind_names[BLOCK_KIND_COUNT] = {"unchanged", "drift", "settings", "random"};
+
+static double seconds(const struct timespec* start, const struct timespec* end) {
+    return (double)(end->tv_sec - start->tv_sec) + (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char** argv) {
+    static uint16_t values[BENCH_BLOCKS][MODBUS_CODEC_FRAME_MAX_REGS];
+    static uint16_t baseline[BENCH_BLOCKS][MODBUS_CODEC_FRAME_MAX_REGS];
+    static uint8_t  enc[BENCH_BLOCKS][MODBUS_CODEC_MAX_LEN(MODBUS_CODEC_FRAME_MAX_REGS)];
+    static int      lens[BENCH_BLOCKS];
+    uint16_t        decoded[MODBUS_CODEC_FRAME_MAX_REGS];
+    long            count = (argc > 1) ? atol(argv[1]) : 2000000;
+
+    printf("%-10s %6s %9s %7s %14s %14s\n", "block", "regs", "bytes", "ratio", "encode MB/s", "decode MB/s");
+
+    for (int kind = 0; kind < BLOCK_KIND_COUNT; kind++) {
+        struct timespec start;
+        struct timespec end;
+        const uint16_t* base = NULL;
+        size_t          raw  = 0;
+        size_t          out  = 0;
+        double          enc_s;
+        double          dec_s;
+        volatile int    sink = 0;
+
+        srand(1);
+        for (int b = 0; b < BENCH_BLOCKS; b++) {
+            make_block((enum block_kind)kind, MODBUS_CODEC_FRAME_MAX_REGS, values[b], baseline[b]);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long n = 0; n < count; n++) {
+            int b = (int)(n % BENCH_BLOCKS);
+
+            base    = (kind == BLOCK_SETTINGS) ? NULL : baseline[b];
+            lens[b] = modbus_codec_encode(values[b], base, MODBUS_CODEC_FRAME_MAX_REGS, enc[b], sizeof(enc[b]));
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        enc_s = seconds(&start, &end);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long n = 0; n < count; n++) {
+            int b = (int)(n % BENCH_BLOCKS);
+
+            base = (kind == BLOCK_SETTINGS) ? NULL : baseline[b];
+            sink += modbus_codec_decode(enc[b], (size_t)lens[b], base, MODBUS_CODEC_FRAME_MAX_REGS, decoded);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        dec_s = seconds(&start, &end);
+
+        for (int b = 0; b < BENCH_BLOCKS; b++) {
+            raw += 2 * MODBUS_CODEC_FRAME_MAX_REGS;
+            out += (size_t)lens[b];
+        }
+
+        /* Throughput in register bytes, before encoding */
+        printf("%-10s %6d %9.1f %7.2f %14.1f %14.1f\n", kind_names[kind], MODBUS_CODEC_FRAME_MAX_REGS, (double)out / BENCH_BLOCKS, (double)raw / (double)out, 2.0 * MODBUS_CODEC_FRAME_MAX_REGS * count / enc_s / 1e6,
+               2.0 * MODBUS_CODEC_FRAME_MAX_REGS * count / dec_s / 1e6);
+    }
+
+    return 0;
+}
+
+#endif /* MODBUS_CODEC_BENCH */
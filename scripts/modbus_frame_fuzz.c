@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Host harness of the Modbus cluster frame decoders (include/modbus_frame.h).
+ *
+ * libFuzzer target, run from the repository root:
+ *
+ *     clang -g -O1 -fsanitize=fuzzer,address,undefined -Iinclude -o modbus_frame_fuzz scripts/modbus_frame_fuzz.c src/modbus_frame.c
+ *     ./modbus_frame_fuzz -max_len=128
+ *
+ * The input is decoded as a command payload the way the Modbus cluster
+ * does, and every decoded request is encoded back and compared with the
+ * input. On start, strings of exactly MODBUS_FRAME_STRING_MAX_LEN and
+ * MODBUS_FRAME_STRING_MAX_LEN + 1 bytes check the length limit. Parse throughput of the request path, in frames per second:
+ *
+ *     cc -O2 -DMODBUS_FRAME_BENCH -Iinclude -o modbus_frame_bench scripts/modbus_frame_fuzz.c src/modbus_frame.c
+ *     ./modbus_frame_bench [frames]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "modbus_frame.h"
+#include "modbus_regmap.h"
+
+#ifndef MODBUS_FRAME_BENCH
+
+static size_t encode_request(const struct modbus_frame_request* req, uint8_t* out) {
+    size_t len = 0;
+
+    out[len++] = req->fc;
+    out[len++] = req->slave_id;
+    out[len++] = (uint8_t)(req->addr & 0xFF);
+    out[len++] = (uint8_t)(req->addr >> 8);
+    out[len++] = req->nb_regs;
+    if (req->values != NULL) {
+        memcpy(&out[len], req->values, 2 * (size_t)req->nb_regs);
+        len += 2 * (size_t)req->nb_regs;
+    }
+    if (req->has_deadline) {
+        out[len++] = (uint8_t)(req->deadline_ms & 0xFF);
+        out[len++] = (uint8_t)(req->deadline_ms >> 8);
+    }
+
+    return len;
+}
+
+/* Decode a payload, returns 1 if it holds a valid request. */
+static int decode(const uint8_t* buf, size_t len) {
+    struct modbus_frame_request  req;
+    struct modbus_frame_response resp;
+    uint8_t                      out[MODBUS_FRAME_STRING_MAX_LEN];
+    const uint8_t*               str;
+    int                          str_len;
+
+    str_len = modbus_frame_string(buf, len, MODBUS_FRAME_STRING_MAX_LEN, &str);
+    if (str_len < 0) {
+        if (str_len != -EINVAL && str_len != -EMSGSIZE) {
+            abort();
+        }
+        return 0;
+    }
+    if (str < buf || str + str_len > buf + len) {
+        abort();
+    }
+
+    if (modbus_frame_parse_response(str, (size_t)str_len, &resp) == 0 && resp.data + resp.len != str + str_len) {
+        abort();
+    }
+
+    if (modbus_frame_parse_request(str, (size_t)str_len, MODBUS_FRAME_MAX_REGS, &req) != 0) {
+        return 0;
+    }
+    if (req.nb_regs == 0 || req.nb_regs > MODBUS_FRAME_MAX_REGS || encode_request(&req, out) != (size_t)str_len || memcmp(out, str, (size_t)str_len) != 0) {
+        abort();
+    }
+
+    return 1;
+}
+
+/* The longest string is accepted, one byte more is not. */
+int LLVMFuzzerInitialize(int* argc, char*** argv) {
+    static uint8_t buf[1 + MODBUS_FRAME_STRING_MAX_LEN + 1];
+    const uint8_t* str;
+
+    (void)argc;
+    (void)argv;
+
+    buf[0] = MODBUS_FRAME_STRING_MAX_LEN;
+    if (modbus_frame_string(buf, 1 + MODBUS_FRAME_STRING_MAX_LEN, MODBUS_FRAME_STRING_MAX_LEN, &str) != MODBUS_FRAME_STRING_MAX_LEN || str != &buf[1]) {
+        abort();
+    }
+    buf[0] = MODBUS_FRAME_STRING_MAX_LEN + 1;
+    if (modbus_frame_string(buf, sizeof(buf), MODBUS_FRAME_STRING_MAX_LEN, &str) != -EMSGSIZE) {
+        abort();
+    }
+
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    decode(data, size);
+    return 0;
+}
+
+#else
+
+#include <time.h>
+
+#define BENCH_FRAMES 64
+
+int main(int argc, char** argv) {
+    static uint8_t  frames[BENCH_FRAMES][MODBUS_FRAME_STRING_MAX_LEN + 1];
+    static size_t   lens[BENCH_FRAMES];
+    long            count = (argc > 1) ? atol(argv[1]) : 10000000;
+    struct timespec start;
+    struct timespec end;
+    long            valid = 0;
+    double          elapsed;
+
+    /* Mix of reads, writes with and without deadline, and truncated frames. */
+    srand(1);
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        uint8_t* f   = frames[i];
+        uint8_t  fc  = (i % 4 == 0) ? MODBUS_FC_WRITE_HOLDING_REGS : MODBUS_FC_READ_HOLDING_REGS;
+        uint8_t  nb  = (uint8_t)(1 + rand() % MODBUS_FRAME_MAX_REGS);
+        size_t   len = 1;
+
+        f[len++] = fc;
+        f[len++] = (uint8_t)(1 + rand() % 8);
+        f[len++] = (uint8_t)rand();
+        f[len++] = (uint8_t)rand();
+        f[len++] = nb;
+        if (fc == MODBUS_FC_WRITE_HOLDING_REGS) {
+            for (int r = 0; r < 2 * nb && len < MODBUS_FRAME_STRING_MAX_LEN - 1; r++) {
+                f[len++] = (uint8_t)rand();
+            }
+        }
+        if (i % 2) {
+            f[len++] = (uint8_t)rand();
+            f[len++] = (uint8_t)rand();
+        }
+        f[0]    = (uint8_t)(len - 1);
+        lens[i] = (i % 16 == 15) ? len / 2 : len;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long n = 0; n < count; n++) {
+        struct modbus_frame_request req;
+        const uint8_t*              str;
+        int                         str_len = modbus_frame_string(frames[n % BENCH_FRAMES], lens[n % BENCH_FRAMES], MODBUS_FRAME_STRING_MAX_LEN, &str);
+
+        if (str_len >= 0 && modbus_frame_parse_request(str, (size_t)str_len, MODBUS_FRAME_MAX_REGS, &req) == 0) {
+            valid++;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    elapsed = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%ld frames (%ld valid) in %.3f s: %.0f frames/s, %.1f ns/frame\n", count, valid, elapsed, (double)count / elapsed, 1e9 * elapsed / (double)count);
+
+    return 0;
+}
+
+#endif /* MODBUS_FRAME_BENCH */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/* Host test of the slave response time model (include/modbus_timing.h), run
+ * from the repository root:
+ *
+ *     cc -g -O1 -fsanitize=address,undefined -Iinclude -o modbus_timing_test scripts/modbus_timing_test.c src/modbus_timing.c
+ *     ./modbus_timing_test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "modbus_regmap.h"
+#include "modbus_timing.h"
+
+/* Defaults of CONFIG_APP_MODBUS_TIMEOUT_MIN_MS and CONFIG_APP_MODBUS_TIMEOUT_MAX_MS */
+#define MIN_MS 50
+#define MAX_MS 1000
+
+static int failures;
+
+#define CHECK(cond, ...)                                                                                                                                                                                                                                 \
+    do {                                                                                                                                                                                                                                                 \
+        if (!(cond)) {                                                                                                                                                                                                                                   \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                                                                                                                                                  \
+            printf(__VA_ARGS__);                                                                                                                                                                                                                         \
+            printf("\n");                                                                                                                                                                                                                                \
+            failures++;                                                                                                                                                                                                                                  \
+            return;                                                                                                                                                                                                                                      \
+        }                                                                                                                                                                                                                                                \
+    } while (0)
+
+static void test_line_time(void) {
+    /* 8 + 5 + 240 bytes and 7 characters of silence, 11 bits each at 19200 bps: 148.96 ms */
+    CHECK(modbus_timing_line_ms(MODBUS_FC_READ_HOLDING_REGS, 120, 19200) == 149, "read of 120 registers");
+    CHECK(modbus_timing_line_ms(MODBUS_FC_READ_INPUT_REGS, 120, 19200) == 149, "read of 120 input registers");
+    /* 8 + 8 bytes and 7 characters at 9600 bps: 26.35 ms */
+    CHECK(modbus_timing_line_ms(MODBUS_FC_WRITE_HOLDING_REG, 1, 9600) == 27, "single write");
+    /* 9 + 246 + 8 bytes and 7 characters at 115200 bps: 25.78 ms */
+    CHECK(modbus_timing_line_ms(MODBUS_FC_WRITE_HOLDING_REGS, 123, 115200) == 26, "write of 123 registers");
+    CHECK(modbus_timing_line_ms(MODBUS_FC_READ_HOLDING_REGS, 2, 19200) < modbus_timing_line_ms(MODBUS_FC_READ_HOLDING_REGS, 3, 19200), "line time grows with registers");
+}
+
+static void test_unanswered(void) {
+    struct modbus_timing timing = {0};
+
+    CHECK(modbus_timing_timeout(&timing, 0, 0, MIN_MS, MAX_MS) == MAX_MS, "no answer yet");
+    CHECK(modbus_timing_timeout(&timing, 0, 149, MIN_MS, MAX_MS) == MAX_MS + 149, "no answer yet, long read");
+    CHECK(modbus_timing_timeout(&timing, 4, 0, MIN_MS, MAX_MS) == MAX_MS, "backoff is bounded");
+}
+
+static void test_bounds(void) {
+    struct modbus_timing timing = {0};
+
+    /* Answers faster than the line time, within the resolution of the clock */
+    modbus_timing_sample(&timing, 10, 14);
+    CHECK(timing.answered && timing.srtt8 == 0 && timing.rttvar4 == 0, "elapsed below the line time");
+    CHECK(modbus_timing_timeout(&timing, 0, 14, MIN_MS, MAX_MS) == MIN_MS + 14, "lower bound");
+    CHECK(modbus_timing_timeout(&timing, 2, 14, MIN_MS, MAX_MS) == 4 * MIN_MS + 14, "backoff");
+
+    for (int i = 0; i < 50; i++) {
+        modbus_timing_sample(&timing, 5000, 14);
+    }
+    CHECK(modbus_timing_timeout(&timing, 0, 14, MIN_MS, MAX_MS) == MAX_MS + 14, "upper bound");
+}
+
+/* A slave answering in 8 to 12 ms is polled 2 registers at a time, then read 120 registers at once. */
+static void test_long_read_after_polls(void) {
+    struct modbus_timing timing    = {0};
+    uint32_t             poll_line = modbus_timing_line_ms(MODBUS_FC_READ_HOLDING_REGS, 2, 19200);
+    uint32_t             long_line = modbus_timing_line_ms(MODBUS_FC_READ_HOLDING_REGS, 120, 19200);
+    uint32_t             timeout;
+
+    srand(1);
+    for (int i = 0; i < 200; i++) {
+        uint32_t elapsed = poll_line + 8 + (uint32_t)(rand() % 5);
+
+        CHECK(elapsed <= modbus_timing_timeout(&timing, 0, poll_line, MIN_MS, MAX_MS), "poll %d timed out", i);
+        modbus_timing_sample(&timing, elapsed, poll_line);
+    }
+
+    /* The model learned from the polls alone would wait 50 ms, the long read takes 149 ms on the line. */
+    timeout = modbus_timing_timeout(&timing, 0, long_line, MIN_MS, MAX_MS);
+    CHECK(timeout >= long_line + 12, "long read times out: %u ms for %u ms", timeout, long_line + 12);
+    CHECK(timeout <= long_line + MIN_MS, "long read timeout %u ms above the bound", timeout);
+    CHECK(timing.srtt8 / 8 >= 8 && timing.srtt8 / 8 <= 12, "smoothed response time %u ms", timing.srtt8 / 8);
+
+    /* Learning from the long read does not change the model. */
+    modbus_timing_sample(&timing, long_line + 10, long_line);
+    CHECK(timing.srtt8 / 8 >= 8 && timing.srtt8 / 8 <= 12, "smoothed response time after the long read %u ms", timing.srtt8 / 8);
+}
+
+int main(void) {
+    test_line_time();
+    test_unanswered();
+    test_bounds();
+    test_long_read_after_polls();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
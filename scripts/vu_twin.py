@@ -0,0 +1,398 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2023 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+
+"""Serve a ventilation unit digital twin as a Modbus RTU slave.
+
+The register map is read from include/modbus_regmap_defs.h: the slaves of
+MODBUS_SLAVES with a VENTILATION_UNIT map are served, with the encoding,
+word order, scale and access of each register. Behind the map, a model of
+the unit evolves over time: outdoor temperature over the day, occupancy
+raising the CO2 level, fans following the speed setpoint and boosting
+above the CO2 threshold, heat recovery and heater, filter fouling.
+
+Requests are answered after a configurable response delay, and faults are
+injected with a configurable probability: no answer, corrupted CRC and
+exception responses (codes of zb_zcl_modbus_exception_t, see
+include/zb_zcl_modbus.h). Requests the map rejects get the exception a
+real unit sends: illegal function, illegal data address or illegal data
+value.
+
+Faults, delays and the model only depend on the seed and, with --step-s,
+on the sequence of requests, so a run can be repeated exactly.
+"""
+
+import argparse
+import math
+import os
+import random
+import re
+import select
+import socket
+import struct
+import sys
+import time
+import tty
+
+from fleet_load import BITS_PER_CHAR, FC_READ_HOLDING_REGS, FC_READ_INPUT_REGS, FC_WRITE_HOLDING_REG, FC_WRITE_HOLDING_REGS, crc16, rtu_frame
+
+REGMAP_DEFS = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "include", "modbus_regmap_defs.h")
+
+# zb_zcl_modbus_exception_t, the code on the bus is the enum value plus 1.
+EXCEPTIONS = ["ILLEGAL_FUNC", "ILLEGAL_DATA_ADDR", "ILLEGAL_DATA_VALUE", "SERVER_DEV_FAIL", "ACK", "SERVER_DEV_BUSY", "NACK", "MEM_PAIR_ERR", "GATE_PATH_UNAVAILABLE", "GATE_TARGET_FAILED_TO_RESPOND"]
+EXCP_ILLEGAL_FUNC = 1
+EXCP_ILLEGAL_DATA_ADDR = 2
+EXCP_ILLEGAL_DATA_VALUE = 3
+
+SPACES = {"HOLDING": FC_READ_HOLDING_REGS, "INPUT": FC_READ_INPUT_REGS}
+WORDS = {"U16": 1, "I16": 1, "BITFIELD": 1, "U32": 2, "I32": 2, "FLOAT32": 2}
+
+REG_RE = re.compile(r"REG\(\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*(\w+)\s*,\s*(-?\d+)\s*,\s*(\w+)\s*,\s*(\w+)\s*\)\s*(?:/\*\s*(.*?)\s*\*/)?")
+SLAVE_RE = re.compile(r"SLAVE\(\s*(\w+)\s*,\s*(\w+)\s*\)")
+
+
+class Reg:
+    def __init__(self, space, addr, type_, order, scale, unit, access, name):
+        self.space = SPACES[space]
+        self.addr = int(addr, 0)
+        self.type = type_
+        self.order = order
+        self.scale = int(scale)
+        self.unit = unit
+        self.readable = "R" in access
+        self.writable = "W" in access
+        self.name = name or "0x%04x" % self.addr
+        self.words = WORDS[type_]
+
+    def encode(self, value):
+        """Registers holding a value in the unit of the register."""
+        if self.type == "FLOAT32":
+            raw = struct.unpack(">I", struct.pack(">f", value))[0]
+        else:
+            raw = int(round(value / 10.0 ** self.scale))
+            bits = 16 * self.words
+            lo, hi = (-(1 << (bits - 1)), (1 << (bits - 1)) - 1) if self.type.startswith("I") else (0, (1 << bits) - 1)
+            raw = min(max(raw, lo), hi) & ((1 << bits) - 1)
+        if self.words == 1:
+            return [raw]
+        words = [raw >> 16, raw & 0xFFFF]
+        return words if self.order == "HL" else words[::-1]
+
+    def decode(self, words):
+        if self.words == 2:
+            hi, lo = words if self.order == "HL" else words[::-1]
+            raw = hi << 16 | lo
+        else:
+            raw = words[0]
+        if self.type == "FLOAT32":
+            return struct.unpack(">f", struct.pack(">I", raw))[0]
+        if self.type.startswith("I") and raw & (1 << (16 * self.words - 1)):
+            raw -= 1 << (16 * self.words)
+        return raw * 10.0 ** self.scale
+
+
+def load_regmaps(path):
+    """Register maps by slave type, and slave types by unit ID."""
+    with open(path) as f:
+        text = f.read()
+    maps = {}
+    for match in re.finditer(r"#define\s+MODBUS_REGMAP_(\w+)\(REG\)((?:.*\\\n)*.*)", text):
+        maps[match.group(1)] = [Reg(*m.groups()) for m in REG_RE.finditer(match.group(2))]
+    slaves = {}
+    match = re.search(r"#define\s+MODBUS_SLAVES\(SLAVE\)((?:.*\\\n)*.*)", text)
+    for unit_id, type_ in SLAVE_RE.findall(match.group(1) if match else ""):
+        slaves[int(unit_id, 0)] = type_
+    return maps, slaves
+
+
+class VentilationUnit:
+    """Model of a ventilation unit with heat recovery, in the units of the register map."""
+
+    MODE_ON = 0x0001
+    MODE_BOOST = 0x0002
+    ALARM_FILTER = 0x0001
+    ALARM_CO2 = 0x0002
+    ALARM_FROST = 0x0004
+
+    RPM_MAX = 3000.0
+    FLOW_MAX = 400.0
+    ROOM_VOLUME = 300.0
+    HEAT_RECOVERY = 0.8
+    FILTER_ALARM_PA = 150.0
+
+    def __init__(self, rng, start_s):
+        self.rng = rng
+        self.t = start_s
+        self.values = {
+            "Fan speed setpoint": 50.0,
+            "Supply air temperature setpoint": 19.0,
+            "CO2 boost threshold": 1000.0,
+            "Operating mode flags": self.MODE_ON,
+        }
+        self.extract = 21.5
+        self.co2 = 600.0
+        self.rpm = 0.0
+        self.fouling = rng.uniform(0.0, 0.3)
+        self.hours = rng.uniform(1000.0, 20000.0)
+        self.occupants = 2
+
+    def outdoor(self):
+        return 8.0 - 6.0 * math.cos(2 * math.pi * (self.t % 86400.0) / 86400.0)
+
+    def step(self, dt):
+        on = int(self.values["Operating mode flags"]) & self.MODE_ON
+        boost = on and (int(self.values["Operating mode flags"]) & self.MODE_BOOST or self.co2 > self.values["CO2 boost threshold"])
+        target = self.RPM_MAX * (1.0 if boost else min(max(self.values["Fan speed setpoint"], 0.0), 100.0) / 100.0) if on else 0.0
+        self.rpm += (target - self.rpm) * (1.0 - math.exp(-dt / 8.0))
+
+        if self.rng.random() < dt / 1800.0:
+            self.occupants = self.rng.choice([0, 1, 2, 2, 3, 4, 6])
+        flow = self.FLOW_MAX * self.rpm / self.RPM_MAX
+        # 20 l/h of CO2 per occupant, diluted by outdoor air at 420 ppm.
+        self.co2 += (self.occupants * 0.02e6 - flow * (self.co2 - 420.0)) / self.ROOM_VOLUME * dt / 3600.0
+        self.extract += ((20.5 + 0.4 * self.occupants) - self.extract) * (1.0 - math.exp(-dt / 1800.0))
+        if on:
+            self.hours += dt / 3600.0
+            self.fouling += flow * dt / 3.6e9
+
+    def refresh(self):
+        outdoor = self.outdoor()
+        flow = self.FLOW_MAX * self.rpm / self.RPM_MAX
+        supply = outdoor + self.HEAT_RECOVERY * (self.extract - outdoor) if flow > 1.0 else self.extract
+        supply = max(supply, self.values["Supply air temperature setpoint"]) if flow > 1.0 else supply
+        pressure = (0.5 + self.fouling) * 100.0 * (flow / self.FLOW_MAX) ** 2
+        alarms = (self.ALARM_FILTER if pressure > self.FILTER_ALARM_PA else 0) | (self.ALARM_CO2 if self.co2 > 2000.0 else 0) | (self.ALARM_FROST if outdoor < -15.0 else 0)
+        noise = self.rng.gauss
+        self.values.update({
+            "Supply air temperature": supply + noise(0.0, 0.05),
+            "Extract air temperature": self.extract + noise(0.0, 0.05),
+            "CO2 concentration": self.co2 + noise(0.0, 5.0),
+            "Supply fan speed": self.rpm + noise(0.0, 5.0) if self.rpm > 1.0 else 0.0,
+            "Extract fan speed": 0.97 * self.rpm + noise(0.0, 5.0) if self.rpm > 1.0 else 0.0,
+            "Alarm flags": alarms,
+            "Operating hours": math.floor(self.hours),
+            "Filter pressure drop": pressure,
+            "Air flow": flow,
+        })
+
+    def advance(self, t):
+        while self.t < t:
+            dt = min(1.0, t - self.t)
+            self.step(dt)
+            self.t += dt
+        self.refresh()
+
+    def valid(self, name, value):
+        if name == "Fan speed setpoint":
+            return 0 <= value <= 100
+        if name == "Supply air temperature setpoint":
+            return 10.0 <= value <= 30.0
+        if name == "CO2 boost threshold":
+            return 400 <= value <= 5000
+        return True
+
+
+class Twin:
+    """One slave: register map, model and injected faults."""
+
+    def __init__(self, unit_id, regs, args, rng):
+        self.unit_id = unit_id
+        self.regs = {(reg.space, reg.addr + i): (reg, i) for reg in regs for i in range(reg.words)}
+        self.args = args
+        self.rng = rng
+        self.model = VentilationUnit(rng, args.start_s)
+        self.requests = 0
+
+    def clock(self, now):
+        if self.args.step_s:
+            return self.args.start_s + self.requests * self.args.step_s
+        return self.args.start_s + now
+
+    def lookup(self, space, addr, count):
+        """Registers covering [addr, addr + count), None if the range splits or misses a value."""
+        regs = []
+        for a in range(addr, addr + count):
+            entry = self.regs.get((space, a))
+            if entry is None or (a == addr and entry[1] != 0) or (a == addr + count - 1 and entry[1] != entry[0].words - 1):
+                return None
+            if entry[1] == 0:
+                regs.append(entry[0])
+        return regs
+
+    def read(self, fc, addr, count):
+        regs = self.lookup(fc, addr, count)
+        if regs is None or not all(reg.readable for reg in regs):
+            return EXCP_ILLEGAL_DATA_ADDR
+        words = []
+        for reg in regs:
+            words += reg.encode(self.model.values.get(reg.name, 0.0))
+        return struct.pack(">BB%dH" % len(words), fc, 2 * len(words), *words)
+
+    def write(self, addr, words):
+        regs = self.lookup(FC_READ_HOLDING_REGS, addr, len(words))
+        if regs is None or not all(reg.writable for reg in regs):
+            return EXCP_ILLEGAL_DATA_ADDR
+        values = []
+        for reg in regs:
+            value = reg.decode(words[:reg.words])
+            words = words[reg.words:]
+            if not self.model.valid(reg.name, value):
+                return EXCP_ILLEGAL_DATA_VALUE
+            values.append((reg.name, value))
+        self.model.values.update(values)
+        return None
+
+    def handle(self, pdu, now):
+        """Response PDU, or an exception code."""
+        self.requests += 1
+        self.model.advance(self.clock(now))
+        fc = pdu[0]
+        if fc in (FC_READ_HOLDING_REGS, FC_READ_INPUT_REGS) and len(pdu) == 5:
+            addr, count = struct.unpack(">HH", pdu[1:5])
+            if not 1 <= count <= 125:
+                return EXCP_ILLEGAL_DATA_VALUE
+            return self.read(fc, addr, count)
+        if fc == FC_WRITE_HOLDING_REG and len(pdu) == 5:
+            addr, value = struct.unpack(">HH", pdu[1:5])
+            return self.write(addr, [value]) or pdu
+        if fc == FC_WRITE_HOLDING_REGS and len(pdu) >= 6:
+            addr, count, nbytes = struct.unpack(">HHB", pdu[1:6])
+            if not 1 <= count <= 123 or nbytes != 2 * count or len(pdu) != 6 + nbytes:
+                return EXCP_ILLEGAL_DATA_VALUE
+            return self.write(addr, list(struct.unpack(">%dH" % count, pdu[6:]))) or pdu[:5]
+        return EXCP_ILLEGAL_FUNC
+
+    def respond(self, pdu, now):
+        """(delay in seconds, frame), frame None when the slave does not answer."""
+        args = self.args
+        result = self.handle(pdu, now)
+        if self.rng.random() < args.no_answer:
+            return 0.0, None
+        for code, probability in args.exception:
+            if self.rng.random() < probability:
+                result = code
+                break
+
+        if isinstance(result, int):
+            response = bytes([pdu[0] | 0x80, result])
+            nb_regs = 0
+        else:
+            response = result
+            nb_regs = (len(result) - 2) // 2 if pdu[0] in (FC_READ_HOLDING_REGS, FC_READ_INPUT_REGS) else 0
+        frame = bytearray(rtu_frame(bytes([self.unit_id]) + response))
+        if self.rng.random() < args.crc_error:
+            frame[-1 - self.rng.randrange(2)] ^= 1 << self.rng.randrange(8)
+
+        delay_ms = args.delay_ms + args.per_reg_us * nb_regs / 1000.0
+        if args.jitter_ms:
+            delay_ms += self.rng.expovariate(1.0 / args.jitter_ms)
+        if self.rng.random() < args.slow:
+            delay_ms += args.slow_ms
+        if args.verbose:
+            print("%8.3f unit %d fc %d -> %s%s, %.1f ms" % (now, self.unit_id, pdu[0], "exception %d" % result if isinstance(result, int) else "ok", " (bad crc)" if crc16(frame) else "", delay_ms), file=sys.stderr)
+        return delay_ms / 1000.0, bytes(frame)
+
+
+def parse_exception(spec):
+    """NAME_OR_CODE:PROBABILITY"""
+    name, _, probability = spec.partition(":")
+    if name.upper() in EXCEPTIONS:
+        code = EXCEPTIONS.index(name.upper()) + 1
+    else:
+        code = int(name, 0)
+    if not 1 <= code <= 255 or not probability:
+        raise argparse.ArgumentTypeError("expected NAME_OR_CODE:PROBABILITY, got %r" % spec)
+    return code, float(probability)
+
+
+def open_transport(args):
+    """(read fd, write fd, description)."""
+    if args.tcp is None:
+        master, pty = os.openpty()
+        tty.setraw(master)
+        tty.setraw(pty)
+        if args.link:
+            if os.path.lexists(args.link):
+                os.unlink(args.link)
+            os.symlink(os.ttyname(pty), args.link)
+        return master, master, os.ttyname(pty)
+
+    server = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    server.bind(("127.0.0.1", args.tcp))
+    server.listen(1)
+    print("waiting for a connection on 127.0.0.1:%d" % args.tcp, file=sys.stderr)
+    conn, peer = server.accept()
+    server.close()
+    conn.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    args.conn = conn
+    return conn.fileno(), conn.fileno(), "%s:%d" % peer
+
+
+def serve(args, twins):
+    rfd, wfd, name = open_transport(args)
+    print("ventilation unit %s on %s" % (", ".join(str(u) for u in sorted(twins)), name), file=sys.stderr)
+
+    # A frame ends after 3.5 characters of silence.
+    gap = max(3.5 * BITS_PER_CHAR / args.baudrate, 0.00175)
+    start = time.monotonic()
+    frame = bytearray()
+    while True:
+        ready, _, _ = select.select([rfd], [], [], gap if frame else None)
+        if ready:
+            data = os.read(rfd, 256)
+            if not data:
+                return
+            frame += data
+            continue
+
+        if len(frame) < 4 or crc16(frame) != 0:
+            print("dropped %d bytes" % len(frame), file=sys.stderr)
+        elif frame[0] in twins:
+            delay, response = twins[frame[0]].respond(bytes(frame[1:-2]), time.monotonic() - start)
+            if response is not None:
+                time.sleep(delay)
+                os.write(wfd, response)
+        frame.clear()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--regmap", default=REGMAP_DEFS, help="register map definitions (default: include/modbus_regmap_defs.h)")
+    parser.add_argument("--unit", type=lambda s: int(s, 0), action="append", default=[], help="unit ID to serve, repeatable (default: the VENTILATION_UNIT slaves of MODBUS_SLAVES)")
+    parser.add_argument("--tcp", type=int, metavar="PORT", help="serve RTU frames on a TCP port of localhost instead of a pseudo terminal")
+    parser.add_argument("--link", help="symlink to create to the pseudo terminal")
+    parser.add_argument("--baudrate", type=int, default=19200, help="bus baudrate, for the end of frame gap (default: %(default)s)")
+    parser.add_argument("--seed", type=int, default=1, help="random seed (default: %(default)s)")
+    parser.add_argument("--start-s", type=float, default=8 * 3600, help="model time of day at start in seconds (default: %(default)s)")
+    parser.add_argument("--step-s", type=float, default=0.0, help="advance the model this many seconds per request instead of with the wall clock")
+    parser.add_argument("--delay-ms", type=float, default=5.0, help="base response delay (default: %(default)s)")
+    parser.add_argument("--per-reg-us", type=float, default=200.0, help="additional response delay per register read (default: %(default)s)")
+    parser.add_argument("--jitter-ms", type=float, default=1.0, help="mean of the exponential response delay jitter (default: %(default)s)")
+    parser.add_argument("--slow", type=float, default=0.0, help="probability of a slow response (default: %(default)s)")
+    parser.add_argument("--slow-ms", type=float, default=300.0, help="additional delay of a slow response (default: %(default)s)")
+    parser.add_argument("--no-answer", type=float, default=0.0, help="probability of not answering a request (default: %(default)s)")
+    parser.add_argument("--crc-error", type=float, default=0.0, help="probability of corrupting the CRC of a response (default: %(default)s)")
+    parser.add_argument("--exception", type=parse_exception, action="append", default=[], help="answer with an exception, NAME_OR_CODE:PROBABILITY with NAME from zb_zcl_modbus_exception_t (e.g. SERVER_DEV_BUSY:0.05), repeatable")
+    parser.add_argument("-v", "--verbose", action="store_true", help="log every request")
+    args = parser.parse_args()
+
+    maps, slaves = load_regmaps(args.regmap)
+    if "VENTILATION_UNIT" not in maps:
+        parser.error("%s has no VENTILATION_UNIT register map" % args.regmap)
+    units = args.unit or [u for u, t in slaves.items() if t == "VENTILATION_UNIT"]
+    if not units:
+        parser.error("no ventilation unit in MODBUS_SLAVES, use --unit")
+
+    rng = random.Random(args.seed)
+    twins = {u: Twin(u, maps["VENTILATION_UNIT"], args, random.Random(rng.random())) for u in units}
+    try:
+        serve(args, twins)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "boot_timing.h"
+
+LOG_MODULE_REGISTER(boot_timing, LOG_LEVEL_INF);
+
+static const char* const phase_names[BOOT_PHASE_COUNT] = {
+    [BOOT_PHASE_MAIN]           = "main",
+    [BOOT_PHASE_STACK_ENABLED]  = "stack enabled",
+    [BOOT_PHASE_STACK_STARTED]  = "stack started",
+    [BOOT_PHASE_JOINED]         = "joined",
+    [BOOT_PHASE_FIRST_RESPONSE] = "first Modbus response",
+};
+
+static atomic_t phase_ms[BOOT_PHASE_COUNT];
+
+void boot_timing_mark(enum boot_phase phase) {
+    /* 0 means not reached, a phase reached in the first millisecond is recorded as 1. */
+    uint32_t now = MAX(k_uptime_get_32(), 1);
+
+    if (phase < BOOT_PHASE_COUNT && atomic_cas(&phase_ms[phase], 0, (atomic_val_t)now)) {
+        LOG_INF("Boot phase %s at %u ms", phase_names[phase], now);
+    }
+}
+
+uint32_t boot_timing_get(enum boot_phase phase) {
+    return phase < BOOT_PHASE_COUNT ? (uint32_t)atomic_get(&phase_ms[phase]) : 0;
+}
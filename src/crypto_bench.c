@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <tinycrypt/aes.h>
+#include <tinycrypt/constants.h>
+#include <zephyr/crypto/crypto.h>
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "crypto_bench.h"
+
+LOG_MODULE_REGISTER(crypto_bench, LOG_LEVEL_INF);
+
+#define BENCH_BLOCKS 1000
+
+/* AES-128 block encryptions for CCM* with a 4 byte MIC on a full frame: CBC-MAC over about 30 bytes of
+ * headers and 96 bytes of payload, and CTR over the payload and the MIC. The stack encrypts these blocks
+ * with the same ECB peripheral driver.
+ */
+#define BENCH_BLOCKS_PER_FRAME 17
+
+static const uint8_t bench_key[16] = {0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c};
+
+static uint32_t bench_us(int64_t start) {
+    uint32_t us = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks() - start);
+
+    return us == 0 ? 1 : us;
+}
+
+/* TinyCrypt, as a reference only: the software AES of the stack is built into its library and cannot be timed from here. */
+static void bench_software(void) {
+    struct tc_aes_key_sched_struct sched;
+    uint8_t                        block[TC_AES_BLOCK_SIZE] = {0};
+    int64_t                        start;
+
+    tc_aes128_set_encrypt_key(&sched, bench_key);
+
+    start = k_uptime_ticks();
+    for (int i = 0; i < BENCH_BLOCKS; i++) {
+        tc_aes_encrypt(block, block, &sched);
+    }
+    LOG_INF("TinyCrypt AES: %u us/block", bench_us(start) / BENCH_BLOCKS);
+}
+
+#ifdef CONFIG_CRYPTO_NRF_ECB
+static void bench_hardware(void) {
+    const struct device* dev = DEVICE_DT_GET_ONE(nordic_nrf_ecb);
+    struct cipher_ctx    ctx = {0};
+    struct cipher_pkt    pkt = {0};
+    uint8_t              in[TC_AES_BLOCK_SIZE] = {0};
+    uint8_t              out[TC_AES_BLOCK_SIZE];
+    int64_t              start;
+    int                  err = 0;
+
+    ctx.keylen         = sizeof(bench_key);
+    ctx.key.bit_stream = (uint8_t*)bench_key;
+    ctx.flags          = CAP_RAW_KEY | CAP_SEPARATE_IO_BUF | CAP_SYNC_OPS;
+
+    pkt.in_buf      = in;
+    pkt.in_len      = sizeof(in);
+    pkt.out_buf     = out;
+    pkt.out_buf_max = sizeof(out);
+
+    if (!device_is_ready(dev) || cipher_begin_session(dev, &ctx, CRYPTO_CIPHER_ALGO_AES, CRYPTO_CIPHER_MODE_ECB, CRYPTO_CIPHER_OP_ENCRYPT) != 0) {
+        LOG_WRN("ECB peripheral not available");
+        return;
+    }
+
+    start = k_uptime_ticks();
+    for (int i = 0; i < BENCH_BLOCKS && err == 0; i++) {
+        err = cipher_block_op(&ctx, &pkt);
+    }
+    if (err) {
+        LOG_ERR("ECB peripheral encryption failed (err: %d)", err);
+    } else {
+        uint32_t us = bench_us(start);
+
+        LOG_INF("ECB peripheral AES: %u us/block, %u frames/s", us / BENCH_BLOCKS, (uint32_t)((uint64_t)BENCH_BLOCKS * USEC_PER_SEC / BENCH_BLOCKS_PER_FRAME / us));
+    }
+
+    cipher_free_session(dev, &ctx);
+}
+#endif /* CONFIG_CRYPTO_NRF_ECB */
+
+void crypto_bench_run(void) {
+#ifdef CONFIG_CRYPTO_NRF_ECB
+    bench_hardware();
+#endif /* CONFIG_CRYPTO_NRF_ECB */
+    bench_software();
+}
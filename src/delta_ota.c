@@ -0,0 +1,361 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <dfu/dfu_target.h>
+#include <dfu/dfu_target_custom.h>
+#include <errno.h>
+#include <string.h>
+#include <zephyr/dfu/mcuboot.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/storage/stream_flash.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "delta_ota.h"
+
+LOG_MODULE_REGISTER(delta_ota, LOG_LEVEL_INF);
+
+/* Size of the stack buffer used to read the running image */
+#define SOURCE_READ_CHUNK 64
+
+static const struct flash_area* src_fa;
+static const struct flash_area* dst_fa;
+static struct stream_flash_ctx  stream;
+static uint8_t                  stream_buf[CONFIG_IMG_BLOCK_BUF_SIZE];
+
+static uint32_t source_size;
+static uint32_t target_size;
+static uint32_t target_crc;
+static uint32_t written;
+static uint32_t written_crc;
+static size_t   received;
+
+/* Header or record header being received, and the data bytes of the current record still to come */
+static uint8_t  rec[DELTA_OTA_HDR_LEN];
+static size_t   rec_len;
+static bool     hdr_done;
+static uint32_t data_left;
+
+/* Add record being applied: source offset and target bytes left, and the pairs still to come */
+static uint32_t add_offset;
+static uint32_t add_left;
+static uint16_t pairs_left;
+
+static size_t rec_needed(void) {
+    if (!hdr_done) {
+        return DELTA_OTA_HDR_LEN;
+    }
+    if (pairs_left > 0) {
+        return DELTA_OTA_ADD_PAIR_LEN;
+    }
+    if (rec_len == 0) {
+        return 1;
+    }
+
+    switch (rec[0]) {
+    case DELTA_OTA_OP_COPY:
+        return DELTA_OTA_COPY_LEN;
+    case DELTA_OTA_OP_DATA:
+        return DELTA_OTA_DATA_LEN;
+    case DELTA_OTA_OP_ADD:
+        return DELTA_OTA_ADD_LEN;
+    default:
+        return 0;
+    }
+}
+
+static int target_write(const uint8_t* data, size_t len) {
+    if (written + len > target_size) {
+        return -EINVAL;
+    }
+
+    written_crc = crc32_ieee_update(written_crc, data, len);
+    written += len;
+
+    return stream_flash_buffered_write(&stream, data, len, false);
+}
+
+static int source_crc(uint32_t size, uint32_t* crc) {
+    uint8_t chunk[SOURCE_READ_CHUNK];
+
+    *crc = 0;
+    for (uint32_t offset = 0; offset < size;) {
+        uint32_t len = MIN(sizeof(chunk), size - offset);
+        int      err = flash_area_read(src_fa, offset, chunk, len);
+
+        if (err) {
+            return err;
+        }
+        *crc = crc32_ieee_update(*crc, chunk, len);
+        offset += len;
+    }
+
+    return 0;
+}
+
+static int source_copy(uint32_t offset, uint32_t len) {
+    uint8_t chunk[SOURCE_READ_CHUNK];
+
+    if (offset > source_size || len > source_size - offset) {
+        return -EINVAL;
+    }
+
+    while (len > 0) {
+        uint32_t n   = MIN(sizeof(chunk), len);
+        int      err = flash_area_read(src_fa, offset, chunk, n);
+
+        if (err == 0) {
+            err = target_write(chunk, n);
+        }
+        if (err) {
+            return err;
+        }
+        offset += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Copy gap bytes of the source, then the next one plus delta. The bytes after the last pair are copied unchanged. */
+static int add_pair_process(void) {
+    uint8_t gap   = rec[0];
+    uint8_t delta = rec[1];
+    uint8_t byte;
+    int     err;
+
+    if (gap >= add_left) {
+        return -EINVAL;
+    }
+
+    err = source_copy(add_offset, gap);
+    if (err == 0) {
+        err = flash_area_read(src_fa, add_offset + gap, &byte, 1);
+    }
+    if (err == 0) {
+        byte += delta;
+        err = target_write(&byte, 1);
+    }
+    if (err) {
+        return err;
+    }
+
+    add_offset += gap + 1;
+    add_left -= gap + 1;
+    if (--pairs_left == 0) {
+        err      = source_copy(add_offset, add_left);
+        add_left = 0;
+    }
+
+    return err;
+}
+
+static int header_process(void) {
+    uint32_t crc;
+    int      err;
+
+    if (sys_get_le32(&rec[0]) != DELTA_OTA_MAGIC || rec[4] != DELTA_OTA_VERSION) {
+        return -EINVAL;
+    }
+
+    source_size = sys_get_le32(&rec[8]);
+    target_size = sys_get_le32(&rec[16]);
+    target_crc  = sys_get_le32(&rec[20]);
+    if (source_size > src_fa->fa_size || target_size > dst_fa->fa_size) {
+        return -EFBIG;
+    }
+
+    /* A patch only applies to the image it was made from. */
+    err = source_crc(source_size, &crc);
+    if (err) {
+        return err;
+    }
+    if (crc != sys_get_le32(&rec[12])) {
+        LOG_ERR("Patch does not apply to the running image");
+        return -EINVAL;
+    }
+
+    LOG_INF("Applying patch: %u -> %u bytes", source_size, target_size);
+    hdr_done = true;
+    return 0;
+}
+
+static int record_process(void) {
+    switch (rec[0]) {
+    case DELTA_OTA_OP_COPY:
+        return source_copy(sys_get_le32(&rec[1]), sys_get_le32(&rec[5]));
+    case DELTA_OTA_OP_DATA:
+        data_left = sys_get_le16(&rec[1]);
+        return 0;
+    case DELTA_OTA_OP_ADD:
+        add_offset = sys_get_le32(&rec[1]);
+        add_left   = sys_get_le32(&rec[5]);
+        pairs_left = sys_get_le16(&rec[9]);
+        if (add_offset > source_size || add_left > source_size - add_offset) {
+            return -EINVAL;
+        }
+        if (pairs_left == 0) {
+            return source_copy(add_offset, add_left);
+        }
+        return 0;
+    default:
+        return -EINVAL;
+    }
+}
+
+static void areas_close(void) {
+    if (src_fa != NULL) {
+        flash_area_close(src_fa);
+        src_fa = NULL;
+    }
+    if (dst_fa != NULL) {
+        flash_area_close(dst_fa);
+        dst_fa = NULL;
+    }
+}
+
+/* Trailer written by boot_request_upgrade(), at the end of the slot and not reached by the image. */
+static int trailer_erase(void) {
+    struct flash_pages_info info;
+    int                     err;
+
+    err = flash_get_page_info_by_offs(flash_area_get_device(dst_fa), dst_fa->fa_off + dst_fa->fa_size - 1, &info);
+    if (err) {
+        return err;
+    }
+
+    return flash_area_erase(dst_fa, info.start_offset - dst_fa->fa_off, info.size);
+}
+
+bool dfu_target_custom_identify(const void* const buf) {
+    return sys_get_le32(buf) == DELTA_OTA_MAGIC;
+}
+
+int dfu_target_custom_init(size_t file_size, int img_num, dfu_target_callback_t cb) {
+    int err;
+
+    ARG_UNUSED(img_num);
+    ARG_UNUSED(cb);
+
+    if (file_size < DELTA_OTA_HDR_LEN) {
+        return -EINVAL;
+    }
+
+    areas_close();
+    err = flash_area_open(FIXED_PARTITION_ID(mcuboot_primary), &src_fa);
+    if (err == 0) {
+        err = flash_area_open(FIXED_PARTITION_ID(mcuboot_secondary), &dst_fa);
+    }
+    if (err == 0) {
+        err = stream_flash_init(&stream, flash_area_get_device(dst_fa), stream_buf, sizeof(stream_buf), dst_fa->fa_off, dst_fa->fa_size, NULL);
+    }
+    if (err) {
+        areas_close();
+        return err;
+    }
+
+    written     = 0;
+    written_crc = 0;
+    received    = 0;
+    rec_len     = 0;
+    hdr_done    = false;
+    data_left   = 0;
+    pairs_left  = 0;
+
+    return 0;
+}
+
+int dfu_target_custom_offset_get(size_t* offset) {
+    /* The patch state is not kept across resets, a download always starts over. */
+    *offset = received;
+    return 0;
+}
+
+int dfu_target_custom_write(const void* const buf, size_t len) {
+    const uint8_t* data = buf;
+    int            err  = 0;
+
+    if (dst_fa == NULL) {
+        return -EPERM;
+    }
+
+    received += len;
+    while (len > 0 && err == 0) {
+        size_t need = rec_needed();
+        size_t n;
+
+        if (data_left > 0) {
+            n   = MIN(len, data_left);
+            err = target_write(data, n);
+            data_left -= n;
+        } else if (need == 0) {
+            err = -EINVAL;
+            break;
+        } else {
+            n = MIN(len, need - rec_len);
+            memcpy(&rec[rec_len], data, n);
+            rec_len += n;
+
+            if (rec_len == rec_needed()) {
+                if (!hdr_done) {
+                    err = header_process();
+                } else if (pairs_left > 0) {
+                    err = add_pair_process();
+                } else {
+                    err = record_process();
+                }
+                rec_len = 0;
+            }
+        }
+
+        data += n;
+        len -= n;
+    }
+
+    if (err) {
+        LOG_ERR("Invalid patch at offset %u (err: %d)", (uint32_t)(received - len), err);
+    }
+
+    return err;
+}
+
+int dfu_target_custom_done(bool successful) {
+    int err = 0;
+
+    if (dst_fa == NULL) {
+        return -EPERM;
+    }
+
+    if (successful) {
+        err = stream_flash_buffered_write(&stream, NULL, 0, true);
+        if (err == 0 && (data_left > 0 || pairs_left > 0 || rec_len > 0 || written != target_size || written_crc != target_crc)) {
+            LOG_ERR("Patched image does not match (%u of %u bytes)", written, target_size);
+            err = -EINVAL;
+        }
+        if (err == 0) {
+            err = trailer_erase();
+        }
+    }
+
+    areas_close();
+    return err;
+}
+
+int dfu_target_custom_schedule_update(int img_num) {
+    ARG_UNUSED(img_num);
+
+    return boot_request_upgrade(BOOT_UPGRADE_TEST);
+}
+
+int dfu_target_custom_reset(void) {
+    areas_close();
+
+    return boot_erase_img_bank(FIXED_PARTITION_ID(mcuboot_secondary));
+}
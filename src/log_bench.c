@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/printk.h>
+#ifndef CONFIG_ARCH_POSIX
+#include <zephyr/timing/timing.h>
+#endif /* CONFIG_ARCH_POSIX */
+
+#ifdef CONFIG_ZIGBEE
+#include <zboss_api.h>
+#endif /* CONFIG_ZIGBEE */
+
+#include "app_log.h"
+#include "log_bench.h"
+
+/* Debug level, so that the debug messages are only dropped by the logging profile */
+LOG_MODULE_REGISTER(log_bench, LOG_LEVEL_DBG);
+
+/* Calls per measurement, few enough for the deferred log buffer to hold their messages */
+#define BENCH_CALLS 16
+
+/* Time left to the log thread to drain the buffer between measurements */
+#define BENCH_DRAIN_MS 200
+
+#ifdef CONFIG_ARCH_POSIX
+/* Simulated time stands still while code runs, count the time stamp counter of the host instead */
+#define BENCH_UNIT          "host TSC cycles"
+#define BENCH_COUNTER_GET() __builtin_ia32_rdtsc()
+#define BENCH_CYCLES(s, e)  ((e) - (s))
+#define BENCH_COUNTER_TYPE  uint64_t
+#else
+#define BENCH_UNIT          "cycles"
+#define BENCH_COUNTER_GET() timing_counter_get()
+#define BENCH_CYCLES(s, e)  timing_cycles_get(&(s), &(e))
+#define BENCH_COUNTER_TYPE  timing_t
+#endif /* CONFIG_ARCH_POSIX */
+
+#define BENCH_RUN(name, i, call)                                                                                                                                                                                                                         \
+    do {                                                                                                                                                                                                                                                 \
+        BENCH_COUNTER_TYPE start;                                                                                                                                                                                                                        \
+        BENCH_COUNTER_TYPE end;                                                                                                                                                                                                                          \
+                                                                                                                                                                                                                                                         \
+        start = BENCH_COUNTER_GET();                                                                                                                                                                                                                     \
+        for (int i = 0; i < BENCH_CALLS; i++) {                                                                                                                                                                                                          \
+            call;                                                                                                                                                                                                                                        \
+        }                                                                                                                                                                                                                                                \
+        end = BENCH_COUNTER_GET();                                                                                                                                                                                                                       \
+        printk("log bench: %s: %u " BENCH_UNIT "/call\n", name, (uint32_t)(BENCH_CYCLES(start, end) / BENCH_CALLS));                                                                                                                                     \
+        k_msleep(BENCH_DRAIN_MS);                                                                                                                                                                                                                        \
+    } while (0)
+
+void log_bench_run(void) {
+#ifndef CONFIG_ARCH_POSIX
+    timing_init();
+    timing_start();
+#endif /* CONFIG_ARCH_POSIX */
+
+    /* The values of a failed transaction, as logged by the Modbus client. */
+    BENCH_RUN("LOG_WRN, 2 args", i, LOG_WRN("Slave %d failed (err: %d)", i, -ETIMEDOUT));
+    BENCH_RUN("LOG_INF, 2 args", i, LOG_INF("Slave %d failed (err: %d)", i, -ETIMEDOUT));
+    /* Compiled out with CONFIG_LOG_MAX_LEVEL=2 only. */
+    BENCH_RUN("LOG_DBG, 1 arg", i, LOG_DBG("received cmd with id: %i", i));
+    /* The first call logs, the others are suppressed. */
+    BENCH_RUN("rate-limited LOG_WRN", i, APP_LOG_RATELIMIT(LOG_WRN, "Slave %d failed (err: %d)", i, -ETIMEDOUT));
+#ifdef CONFIG_ZIGBEE
+    BENCH_RUN("TRACE_MSG", i, TRACE_MSG(TRACE_ZCL1, "modbus cancel: %d requests", (FMT__D, i)));
+#endif /* CONFIG_ZIGBEE */
+
+#ifndef CONFIG_ARCH_POSIX
+    timing_stop();
+#endif /* CONFIG_ARCH_POSIX */
+}
@@ -12,6 +12,7 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include "zb_modbus_device.h"
 #include "zb_range_extender.h"
 #include <ram_pwrdn.h>
 #include <zb_nrf_platform.h>
@@ -21,12 +22,56 @@
 
 #include <zigbee/zigbee_app_utils.h>
 
+/* Defines the stack memory, included in this file only. */
+#include "zb_mem_config_custom.h"
+
 #include "zb_zcl_modbus.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "app_log.h"
+#include "boot_timing.h"
 #include "gpio.h"
+#include "modbus_client.h"
+#include "modbus_config.h"
+#include "signal_dispatch.h"
+
+#ifdef CONFIG_APP_MODBUS_SERVER
+#include "modbus_server.h"
+#endif /* CONFIG_APP_MODBUS_SERVER */
+
+#ifdef CONFIG_APP_MODBUS_POLLER
+#include "modbus_poller.h"
+#endif /* CONFIG_APP_MODBUS_POLLER */
+
+#ifdef CONFIG_APP_SAMPLE_LOG
+#include "sample_log.h"
+#endif /* CONFIG_APP_SAMPLE_LOG */
+
+#ifdef CONFIG_APP_MODBUS_AGGREGATE
+#include "modbus_aggregate.h"
+#endif /* CONFIG_APP_MODBUS_AGGREGATE */
+
+#ifdef CONFIG_APP_RULES
+#include "rules.h"
+#endif /* CONFIG_APP_RULES */
+
+#ifdef CONFIG_APP_MODBUS_SNAPSHOT
+#include "modbus_snapshot.h"
+#endif /* CONFIG_APP_MODBUS_SNAPSHOT */
+
+#ifdef CONFIG_APP_RELAY_STATS
+#include "relay_stats.h"
+#endif /* CONFIG_APP_RELAY_STATS */
+
+#ifdef CONFIG_APP_CRYPTO_BENCHMARK
+#include "crypto_bench.h"
+#endif /* CONFIG_APP_CRYPTO_BENCHMARK */
+
+#ifdef CONFIG_APP_LOG_BENCHMARK
+#include "log_bench.h"
+#endif /* CONFIG_APP_LOG_BENCHMARK */
 
 #define ZIGBEE_MANUFACTURER_CODE ZB_ZCL_MANUF_CODE_INVALID
 
@@ -37,8 +82,16 @@
 
 /* LED indicating OTA Client Activity. */
 #define OTA_ACTIVITY_LED LED_RED
+
+static void confirm_image(void);
+static void ota_block_size_set(void);
+static void ota_evt_handler(const struct zigbee_fota_evt* evt);
 #endif /* CONFIG_ZIGBEE_FOTA */
 
+#ifdef CONFIG_APP_SIGNAL_STATS
+static void signal_stats_report(zb_uint8_t param);
+#endif /* CONFIG_APP_SIGNAL_STATS */
+
 /* Device endpoint, used to receive ZCL commands. */
 #define TEST_EP_ENDPOINT 0x01
 
@@ -64,6 +117,7 @@ static bool network_led_state = false;
 typedef struct {
     zb_zcl_basic_attrs_ext_t basic_attr;
     zb_zcl_identify_attrs_t  identify_attr;
+    zb_zcl_groups_attrs_t    groups_attr;
     zb_zcl_modbus_attrs_t    modbus_attr;
 } zb_device_ctx_t;
 
@@ -81,42 +135,42 @@ ZB_DECLARE_RANGE_EXTENDER_EP(test_ep, TEST_EP_ENDPOINT, range_extender_clusters)
 
 #define MODBUS_CLUSTER_ENDPOINT 0x02
 
-// add Modbus cluster
-ZB_ZCL_DECLARE_MODBUS_ATTRIB_LIST(modbus_attr_list, &dev_ctx.modbus_attr.baudrate);
-zb_zcl_cluster_desc_t clusters_test[] = {
-    ZB_ZCL_CLUSTER_DESC(ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_ARRAY_SIZE(modbus_attr_list, zb_zcl_attr_t), (modbus_attr_list), ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_MANUF_CODE_INVALID),
-};
-
-ZB_AF_SIMPLE_DESC_TYPE(1, 1)
-simple_desc_test = {MODBUS_CLUSTER_ENDPOINT,
-                    ZB_AF_HA_PROFILE_ID,
-                    0xF003, // TODO change
-                    1,      // TODO change
-                    0,
-                    0,
-                    1,
-                    {
-                        ZB_ZCL_CLUSTER_ID_MODBUS,
-                    }};
-ZBOSS_DEVICE_DECLARE_REPORTING_CTX(reporting_info_test, 0);
-ZB_AF_DECLARE_ENDPOINT_DESC(device_ep, MODBUS_CLUSTER_ENDPOINT, ZB_AF_HA_PROFILE_ID, 0, NULL, ZB_ZCL_ARRAY_SIZE(clusters_test, zb_zcl_cluster_desc_t), clusters_test, (zb_af_simple_desc_1_1_t*)&simple_desc_test, 0, NULL, 0, NULL);
-
-#ifndef CONFIG_ZIGBEE_FOTA
-ZB_AF_START_DECLARE_ENDPOINT_LIST(ep_list_test_ep_ctx)
-&test_ep, &device_ep, ZB_AF_FINISH_DECLARE_ENDPOINT_LIST;
-ZBOSS_DECLARE_DEVICE_CTX(test_ep_ctx, ep_list_test_ep_ctx, (ZB_ZCL_ARRAY_SIZE(ep_list_test_ep_ctx, zb_af_endpoint_desc_t*)));
+#ifdef CONFIG_APP_MODBUS_AGGREGATE
+/* Statistics of the aggregated registers are reportable attributes of the server. */
+#define MODBUS_AGGREGATE_ATTRS   MODBUS_AGGREGATE_ATTR_DESC_LIST
+#define MODBUS_REPORT_ATTR_COUNT MODBUS_AGGREGATE_REPORT_ATTR_COUNT
 #else
+#define MODBUS_AGGREGATE_ATTRS
+#define MODBUS_REPORT_ATTR_COUNT 0
+#endif /* CONFIG_APP_MODBUS_AGGREGATE */
+
+/* Response time statistics of the slaves are read-only attributes of the server. */
+#define MODBUS_EXT_ATTRS() MODBUS_CLIENT_SLAVE_ATTR_DESC_LIST MODBUS_AGGREGATE_ATTRS
+
+/* Modbus device endpoints: name, endpoint ID, Modbus cluster attributes, Groups cluster attributes, additional Modbus cluster attributes, reportable attributes.
+ * Each entry declares all the descriptors of one endpoint, see ZB_DECLARE_MODBUS_DEVICE.
+ */
+#define MODBUS_ENDPOINT_LIST(EP) EP(device_ep, MODBUS_CLUSTER_ENDPOINT, dev_ctx.modbus_attr, dev_ctx.groups_attr, MODBUS_EXT_ATTRS, MODBUS_REPORT_ATTR_COUNT)
 
+#define MODBUS_ENDPOINT_DECLARE(...) ZB_DECLARE_MODBUS_DEVICE(__VA_ARGS__);
+
+MODBUS_ENDPOINT_LIST(MODBUS_ENDPOINT_DECLARE)
+
+#ifdef CONFIG_ZIGBEE_FOTA
 #if TEST_EP_ENDPOINT == CONFIG_ZIGBEE_FOTA_ENDPOINT
 #error "Device and Zigbee OTA endpoints should be different."
 #endif
 
 extern zb_af_endpoint_desc_t zigbee_fota_client_ep;
 
+#define FOTA_EP_REF &zigbee_fota_client_ep,
+#else
+#define FOTA_EP_REF
+#endif /* CONFIG_ZIGBEE_FOTA */
+
 ZB_AF_START_DECLARE_ENDPOINT_LIST(ep_list_test_ep_ctx)
-&test_ep, &device_ep, &zigbee_fota_client_ep, ZB_AF_FINISH_DECLARE_ENDPOINT_LIST;
+&test_ep, MODBUS_ENDPOINT_LIST(ZB_MODBUS_DEVICE_EP_REF) FOTA_EP_REF ZB_AF_FINISH_DECLARE_ENDPOINT_LIST;
 ZBOSS_DECLARE_DEVICE_CTX(test_ep_ctx, ep_list_test_ep_ctx, (ZB_ZCL_ARRAY_SIZE(ep_list_test_ep_ctx, zb_af_endpoint_desc_t*)));
-#endif /* CONFIG_ZIGBEE_FOTA */
 
 int set_pascal_string(char* str, char* dest, size_t max_length) {
     size_t str_length = strlen(str);
@@ -132,11 +186,14 @@ int set_pascal_string(char* str, char* dest, size_t max_length) {
 /**@brief Function for initializing all clusters attributes. */
 static void app_clusters_attr_init(void) {
     /* Basic cluster attributes data */
-    dev_ctx.basic_attr.zcl_version   = ZB_ZCL_VERSION;
-    dev_ctx.basic_attr.app_version   = ZB_ZCL_BASIC_APPLICATION_VERSION_DEFAULT_VALUE; // TODO set in production
-    dev_ctx.basic_attr.stack_version = ZB_ZCL_BASIC_STACK_VERSION_DEFAULT_VALUE;       // TODO set in production
-    dev_ctx.basic_attr.hw_version    = ZB_ZCL_BASIC_HW_VERSION_DEFAULT_VALUE;          // TODO set in production
-    dev_ctx.modbus_attr.baudrate     = ZB_ZCL_MODBUS_BAUDRATE_19200;
+    dev_ctx.basic_attr.zcl_version      = ZB_ZCL_VERSION;
+    dev_ctx.basic_attr.app_version      = ZB_ZCL_BASIC_APPLICATION_VERSION_DEFAULT_VALUE; // TODO set in production
+    dev_ctx.basic_attr.stack_version    = ZB_ZCL_BASIC_STACK_VERSION_DEFAULT_VALUE;       // TODO set in production
+    dev_ctx.basic_attr.hw_version       = ZB_ZCL_BASIC_HW_VERSION_DEFAULT_VALUE;          // TODO set in production
+    dev_ctx.modbus_attr.baudrate        = ZB_ZCL_MODBUS_BAUDRATE_19200;
+    dev_ctx.modbus_attr.capabilities    = ZB_ZCL_MODBUS_CAPABILITIES_DEFAULT_VALUE | (IS_ENABLED(CONFIG_APP_MODBUS_STREAM) ? ZB_ZCL_MODBUS_CAP_STREAM : 0) | (IS_ENABLED(CONFIG_APP_MODBUS_SNAPSHOT) ? ZB_ZCL_MODBUS_CAP_SNAPSHOT : 0);
+    dev_ctx.modbus_attr.request_timeout = CONFIG_APP_MODBUS_REQUEST_TIMEOUT_MS;
+    dev_ctx.groups_attr.name_support    = ZB_ZCL_ATTR_GROUPS_NAME_SUPPORT_DEFAULT_VALUE;
 
     set_pascal_string("TEST NV", dev_ctx.basic_attr.mf_name, sizeof(dev_ctx.basic_attr.mf_name));
     set_pascal_string("test", dev_ctx.basic_attr.model_id, sizeof(dev_ctx.basic_attr.model_id));
@@ -189,7 +246,7 @@ static void identify_cb(zb_bufid_t bufid) {
         ZVUNUSED(zb_err_code);
 
         gpio_set_led(IDENTIFY_LED, 0);
-        LOG_INF("cancel identify led state: %i\n", network_led_state);
+        LOG_DBG("cancel identify led state: %i", network_led_state);
         gpio_set_led(ZIGBEE_NETWORK_STATE_LED, network_led_state ? 1 : 0);
     }
 }
@@ -242,6 +299,13 @@ static void button_changed(uint32_t button_state, uint32_t has_changed) {
         LOG_INF("Hall sensor deactivated!");
     }
 
+#ifdef CONFIG_APP_RULES
+    /* Rules run in the Zigbee stack context, next to the Modbus client queue. */
+    if (zigbee_schedule_callback(rules_buttons_changed, (zb_uint8_t)button_state) != RET_OK) {
+        APP_LOG_RATELIMIT(LOG_WRN, "Rules not run, callback queue full");
+    }
+#endif /* CONFIG_APP_RULES */
+
     if (IDENTIFY_MODE_BUTTON & has_changed) {
         if (IDENTIFY_MODE_BUTTON & button_state) {
             /* Button changed its state to pressed */
@@ -277,61 +341,97 @@ static void configure_gpio(void) {
     }
 }
 
-/**@brief Zigbee stack event handler.
- *
- * @param[in]   bufid   Reference to the Zigbee stack buffer
- *                      used to pass signal.
- */
-void zboss_signal_handler(zb_bufid_t bufid) {
+/**@brief Called on the first signal, once the Zigbee stack runs. */
+static void stack_started(zb_bufid_t bufid) {
+    ZVUNUSED(bufid);
 
-    /* Update network status LED. */
-    zigbee_led_status_update(bufid, ZIGBEE_NETWORK_STATE_LED);
+    boot_timing_mark(BOOT_PHASE_STACK_STARTED);
 
 #ifdef CONFIG_ZIGBEE_FOTA
-    /* Pass signal to the OTA client implementation. */
-    zigbee_fota_signal_handler(bufid);
+    /* Not needed to rejoin, so done once the stack runs instead of delaying its start. */
+    zigbee_fota_init(ota_evt_handler);
+    ota_block_size_set();
+
+    /* Mark the current firmware as valid. */
+    confirm_image();
 #endif /* CONFIG_ZIGBEE_FOTA */
 
-    /* No application-specific behavior is required.
-     * Call default signal handler.
-     */
+#ifdef CONFIG_APP_MODBUS_POLLER
+    /* Samples are taken whether or not the device is joined. */
+    modbus_poller_start();
+#endif /* CONFIG_APP_MODBUS_POLLER */
+
+#ifdef CONFIG_APP_RELAY_STATS
+    relay_stats_start();
+#endif /* CONFIG_APP_RELAY_STATS */
+
+#ifdef CONFIG_APP_SIGNAL_STATS
+    ZB_SCHEDULE_APP_ALARM(signal_stats_report, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_SIGNAL_STATS_INTERVAL_S * MSEC_PER_SEC));
+#endif /* CONFIG_APP_SIGNAL_STATS */
+}
+
+static void default_signal_handler(zb_bufid_t bufid) {
     ZB_ERROR_CHECK(zigbee_default_signal_handler(bufid));
+}
 
+/**@brief Called when the device joined, failed to join or left the network. */
+static void network_state_update(zb_bufid_t bufid) {
     zb_zdo_app_signal_hdr_t* p_sg_p = NULL;
     zb_zdo_app_signal_type_t sig    = zb_get_app_signal(bufid, &p_sg_p);
     zb_ret_t                 status = ZB_GET_APP_SIGNAL_STATUS(bufid);
 
-    static bool started = false;
-    switch (sig) {
-    case ZB_BDB_SIGNAL_DEVICE_REBOOT:
-    /* fall-through */
-    case ZB_BDB_SIGNAL_STEERING:
-        if (status == RET_OK) {
-            network_led_state = true;
-        } else {
-            network_led_state = false;
-        }
-        break;
+    /* Update network status LED. */
+    zigbee_led_status_update(bufid, ZIGBEE_NETWORK_STATE_LED);
 
-    case ZB_ZDO_SIGNAL_LEAVE:
-        network_led_state = false;
-        break;
+    network_led_state = (sig != ZB_ZDO_SIGNAL_LEAVE && status == RET_OK);
+    if (network_led_state) {
+        boot_timing_mark(BOOT_PHASE_JOINED);
 
-    default:
-        break;
+        /* Scanned first if the network has to be searched again. */
+        modbus_config_set_channel(zb_get_current_channel());
     }
 
-    static bool prev = false;
+#ifdef CONFIG_APP_MODBUS_SERVER
+    modbus_server_set_network_state(network_led_state);
+#endif /* CONFIG_APP_MODBUS_SERVER */
+
+#ifdef CONFIG_APP_SAMPLE_LOG
+    sample_log_set_network_state(network_led_state);
+#endif /* CONFIG_APP_SAMPLE_LOG */
+}
 
-    prev = network_led_state;
+/* Called in order, each for its signal only. */
+static const struct signal_handler signal_handlers[] = {
+    SIGNAL_HANDLER(ZB_ZDO_SIGNAL_SKIP_STARTUP, stack_started),
+#ifdef CONFIG_ZIGBEE_FOTA
+    SIGNAL_HANDLER(SIGNAL_DISPATCH_ANY, zigbee_fota_signal_handler),
+#endif /* CONFIG_ZIGBEE_FOTA */
+    SIGNAL_HANDLER(SIGNAL_DISPATCH_ANY, default_signal_handler),
+    SIGNAL_HANDLER(ZB_BDB_SIGNAL_DEVICE_REBOOT, network_state_update),
+    SIGNAL_HANDLER(ZB_BDB_SIGNAL_STEERING, network_state_update),
+    SIGNAL_HANDLER(ZB_ZDO_SIGNAL_LEAVE, network_state_update),
+};
 
-    /* All callbacks should either reuse or free passed buffers.
-     * If bufid == 0, the buffer is invalid (not passed).
-     */
-    if (bufid) {
-        zb_buf_free(bufid);
-    }
+static struct signal_handler_stats signal_stats[ARRAY_SIZE(signal_handlers)];
+
+/**@brief Zigbee stack event handler.
+ *
+ * @param[in]   bufid   Reference to the Zigbee stack buffer
+ *                      used to pass signal.
+ */
+void zboss_signal_handler(zb_bufid_t bufid) {
+    signal_dispatch(signal_handlers, signal_stats, ARRAY_SIZE(signal_handlers), bufid);
+}
+
+#ifdef CONFIG_APP_SIGNAL_STATS
+/**@brief Log the time spent in the signal handlers, outside of the signal handlers. */
+static void signal_stats_report(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    signal_dispatch_report(signal_handlers, signal_stats, ARRAY_SIZE(signal_handlers));
+    ZB_SCHEDULE_APP_ALARM(signal_stats_report, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_SIGNAL_STATS_INTERVAL_S * MSEC_PER_SEC));
 }
+#endif /* CONFIG_APP_SIGNAL_STATS */
 
 #ifdef CONFIG_ZIGBEE_FOTA
 static void confirm_image(void) {
@@ -346,13 +446,45 @@ static void confirm_image(void) {
     }
 }
 
+static int     ota_last_progress = -1;
+static int64_t ota_start_time;
+
+/* The FOTA library has no option for the Maximum Data Size of the Image Block Requests, it is kept in the client data attribute. */
+static void ota_block_size_set(void) {
+    zb_zcl_attr_t*                        attr = zb_zcl_get_attr_desc_a(CONFIG_ZIGBEE_FOTA_ENDPOINT, ZB_ZCL_CLUSTER_ID_OTA_UPGRADE, ZB_ZCL_CLUSTER_CLIENT_ROLE, ZB_ZCL_ATTR_OTA_UPGRADE_CLIENT_DATA_ID);
+    zb_zcl_ota_upgrade_client_variable_t* client;
+
+    if (attr == NULL) {
+        LOG_WRN("OTA client data attribute not found, default block size");
+        return;
+    }
+
+    client = (zb_zcl_ota_upgrade_client_variable_t*)attr->data_p;
+    LOG_INF("OTA block size %u bytes (library default %u)", CONFIG_APP_FOTA_BLOCK_SIZE, client->max_data_size);
+    client->max_data_size = CONFIG_APP_FOTA_BLOCK_SIZE;
+}
+
 static void ota_evt_handler(const struct zigbee_fota_evt* evt) {
     switch (evt->id) {
     case ZIGBEE_FOTA_EVT_PROGRESS:
-        gpio_set_led(OTA_ACTIVITY_LED, evt->dl.progress % 2);
+        /* Emitted for every block: the LED and the log follow whole percents only. */
+        if (evt->dl.progress == ota_last_progress) {
+            break;
+        }
+
+        if (ota_last_progress < 0) {
+            ota_start_time = k_uptime_get();
+        }
+        ota_last_progress = evt->dl.progress;
+
+        gpio_set_led(OTA_ACTIVITY_LED, ota_last_progress % 2);
+        if (ota_last_progress % 10 == 0) {
+            LOG_INF("OTA progress %d%%", ota_last_progress);
+        }
         break;
 
     case ZIGBEE_FOTA_EVT_FINISHED:
+        LOG_INF("OTA image downloaded in %lld s", (k_uptime_get() - ota_start_time) / MSEC_PER_SEC);
         LOG_INF("Reboot application.");
         /* Power on unused sections of RAM to allow MCUboot to use it. */
         if (IS_ENABLED(CONFIG_RAM_POWER_DOWN_LIBRARY)) {
@@ -364,6 +496,8 @@ static void ota_evt_handler(const struct zigbee_fota_evt* evt) {
 
     case ZIGBEE_FOTA_EVT_ERROR:
         LOG_ERR("OTA image transfer failed.");
+        gpio_set_led_off(OTA_ACTIVITY_LED);
+        ota_last_progress = -1;
         break;
 
     default:
@@ -388,19 +522,20 @@ static void zcl_device_cb(zb_bufid_t bufid) {
 #endif
 
 void main(void) {
+    boot_timing_mark(BOOT_PHASE_MAIN);
+
     LOG_INF("Starting ventilation unit...");
 
     /* Initialize */
     configure_gpio();
     register_factory_reset_button(FACTORY_RESET_BUTTON);
 
-#ifdef CONFIG_ZIGBEE_FOTA
-    /* Initialize Zigbee FOTA download service. */
-    zigbee_fota_init(ota_evt_handler);
-
-    /* Mark the current firmware as valid. */
-    confirm_image();
+#ifdef CONFIG_APP_MODBUS_SERVER
+    /* Expose the device state to local Modbus clients. */
+    modbus_server_init();
+#endif /* CONFIG_APP_MODBUS_SERVER */
 
+#ifdef CONFIG_ZIGBEE_FOTA
     /* Register callback for handling ZCL commands. */
     ZB_ZCL_REGISTER_DEVICE_CB(zcl_device_cb);
 #endif /* CONFIG_ZIGBEE_FOTA */
@@ -410,6 +545,25 @@ void main(void) {
 
     app_clusters_attr_init();
 
+    /* Start executing Modbus cluster requests on the bus. */
+    modbus_client_init(dev_ctx.modbus_attr.baudrate);
+
+    /* Restore the stored configuration when the stack loads its NVRAM. */
+    modbus_config_init(&dev_ctx.modbus_attr);
+
+#ifdef CONFIG_APP_MODBUS_SNAPSHOT
+    modbus_snapshot_init();
+#endif /* CONFIG_APP_MODBUS_SNAPSHOT */
+
+#ifdef CONFIG_APP_SAMPLE_LOG
+    /* Recover samples that were not sent before the last reset. */
+    sample_log_init(MODBUS_CLUSTER_ENDPOINT);
+#endif /* CONFIG_APP_SAMPLE_LOG */
+
+#ifdef CONFIG_APP_MODBUS_AGGREGATE
+    modbus_aggregate_init(MODBUS_CLUSTER_ENDPOINT);
+#endif /* CONFIG_APP_MODBUS_AGGREGATE */
+
     /* Register handlers to identify notifications */
     ZB_AF_SET_IDENTIFY_NOTIFICATION_HANDLER(TEST_EP_ENDPOINT, identify_cb);
 
@@ -424,8 +578,20 @@ void main(void) {
 
     // zb_set_installcode_policy(true);
 
+#ifdef CONFIG_APP_CRYPTO_BENCHMARK
+    /* Before the stack uses the ECB peripheral. */
+    crypto_bench_run();
+#endif /* CONFIG_APP_CRYPTO_BENCHMARK */
+
+#ifdef CONFIG_APP_LOG_BENCHMARK
+    log_bench_run();
+#endif /* CONFIG_APP_LOG_BENCHMARK */
+
+    signal_dispatch_init();
+
     /* Start Zigbee default thread */
     zigbee_enable();
+    boot_timing_mark(BOOT_PHASE_STACK_ENABLED);
 
     LOG_INF("Zigbee application template started");
 
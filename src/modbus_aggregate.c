@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "modbus_aggregate.h"
+#include "zb_zcl_modbus.h"
+
+LOG_MODULE_REGISTER(modbus_aggregate, LOG_LEVEL_INF);
+
+#define AGG_U16(value) ((int32_t)(uint16_t)(value))
+#define AGG_I16(value) ((int32_t)(int16_t)(value))
+
+struct aggregate_desc {
+    uint8_t  entry;
+    uint8_t  reg;
+    bool     is_signed;
+    uint32_t window_ms;
+};
+
+/* Running state of the open window, updated in O(1) per sample. */
+struct aggregate_window {
+    uint32_t start_ms;
+    uint32_t first_ms;
+    uint32_t last_ms;
+    int32_t  first;
+    int32_t  last;
+    int32_t  min;
+    int32_t  max;
+    int64_t  sum;
+    uint16_t count;
+};
+
+#define AGGREGATE_DESC(index, entry, reg, window_s, type) [index] = {entry, reg, (AGG_##type(-1) < 0), (window_s) * MSEC_PER_SEC},
+
+static const struct aggregate_desc aggregates[] = {MODBUS_AGGREGATE_LIST(AGGREGATE_DESC)};
+
+#define AGGREGATE_CHECK(index, entry, reg, window_s, type) BUILD_ASSERT((window_s) > 0 && (index) < 16, "Invalid aggregate list entry");
+
+MODBUS_AGGREGATE_LIST(AGGREGATE_CHECK)
+BUILD_ASSERT(ARRAY_SIZE(aggregates) == MODBUS_AGGREGATE_COUNT, "Aggregate indexes must be consecutive");
+
+struct modbus_aggregate_result modbus_aggregate_results[MODBUS_AGGREGATE_COUNT];
+
+static struct aggregate_window windows[MODBUS_AGGREGATE_COUNT];
+static uint8_t                 agg_endpoint;
+
+static void window_reset(struct aggregate_window* win, uint32_t now) {
+    win->start_ms = now;
+    win->count    = 0;
+    win->sum      = 0;
+}
+
+/* Publish the statistics of a closed window and mark them for reporting. */
+static void window_publish(uint8_t index, const struct aggregate_window* win) {
+    struct modbus_aggregate_result* res = &modbus_aggregate_results[index];
+
+    if (win->count == 0) {
+        return;
+    }
+
+    res->min   = win->min;
+    res->max   = win->max;
+    res->mean  = (int32_t)(win->sum * 100 / win->count);
+    res->count = win->count;
+    res->rate  = 0;
+    if (win->last_ms != win->first_ms) {
+        res->rate = (int32_t)((int64_t)(win->last - win->first) * 100 * 60 * MSEC_PER_SEC / (int64_t)(win->last_ms - win->first_ms));
+    }
+
+    for (uint8_t field = 0; field < MODBUS_AGGREGATE_FIELD_COUNT; field++) {
+        zb_zcl_mark_attr_for_reporting(agg_endpoint, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_SERVER_ROLE, MODBUS_AGGREGATE_ATTR_ID(index, field));
+    }
+
+    LOG_DBG("Aggregate %u: min %d max %d mean %d/100 n %u", index, res->min, res->max, res->mean, res->count);
+}
+
+static void window_add(struct aggregate_window* win, int32_t value, uint32_t now) {
+    if (win->count == 0) {
+        win->first    = value;
+        win->first_ms = now;
+        win->min      = value;
+        win->max      = value;
+    }
+
+    win->min     = MIN(win->min, value);
+    win->max     = MAX(win->max, value);
+    win->last    = value;
+    win->last_ms = now;
+
+    win->sum += value;
+    win->count++;
+}
+
+void modbus_aggregate_add(uint8_t entry, const uint16_t* values, uint8_t nb_regs) {
+    uint32_t now = k_uptime_get_32();
+
+    for (uint8_t i = 0; i < ARRAY_SIZE(aggregates); i++) {
+        const struct aggregate_desc* desc = &aggregates[i];
+        struct aggregate_window*     win  = &windows[i];
+        int32_t                      value;
+
+        if (desc->entry != entry || desc->reg >= nb_regs) {
+            continue;
+        }
+
+        /* Windows are closed by the first sample after their end. */
+        if (now - win->start_ms >= desc->window_ms) {
+            window_publish(i, win);
+            window_reset(win, now - (now - win->start_ms) % desc->window_ms);
+        }
+
+        value = desc->is_signed ? AGG_I16(values[desc->reg]) : AGG_U16(values[desc->reg]);
+        if (win->count < UINT16_MAX) {
+            window_add(win, value, now);
+        }
+    }
+}
+
+void modbus_aggregate_init(uint8_t endpoint) {
+    uint32_t now = k_uptime_get_32();
+
+    agg_endpoint = endpoint;
+    for (uint8_t i = 0; i < ARRAY_SIZE(windows); i++) {
+        window_reset(&windows[i], now);
+    }
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/modbus/modbus.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include <zb_nrf_platform.h>
+
+#include "app_log.h"
+#include "modbus_client.h"
+#include "modbus_regmap.h"
+#include "modbus_timing.h"
+
+LOG_MODULE_REGISTER(modbus_client, LOG_LEVEL_INF);
+
+#define MAX_FIFO_SIZE 10
+
+/* Transactions in a row that need a shorter interface timeout before it is lowered */
+#define TIMEOUT_LOWER_AFTER 8
+/* Largest backoff after consecutive timeouts, as a power of two */
+#define BACKOFF_MAX_SHIFT 4
+
+#define MODBUS_CLIENT_STACK_SIZE 1024
+#define MODBUS_CLIENT_PRIORITY   7
+
+K_FIFO_DEFINE(fifo);
+
+static modbus_cmd_resp_queue_data_t items[MAX_FIFO_SIZE];
+static ATOMIC_DEFINE(items_used, MAX_FIFO_SIZE);
+/* Items in the FIFO that have not been taken by the client thread nor cancelled */
+static ATOMIC_DEFINE(items_queued, MAX_FIFO_SIZE);
+
+/* Response time model of a slave, and its availability */
+struct slave_timing {
+    bool                 used;
+    uint8_t              slave_id;
+    uint8_t              misses; /* Consecutive timeouts */
+    struct modbus_timing model;
+    uint32_t             last_used;
+    uint32_t             probe_time; /* Start of the last transaction while offline */
+};
+
+/* Only accessed by the client thread. */
+static struct slave_timing slave_timings[MODBUS_CLIENT_SLAVE_COUNT];
+static uint32_t            client_bps;
+static uint32_t            client_timeout_ms;
+/* Transactions in a row that needed a shorter interface timeout, and the longest of their timeouts */
+static uint8_t  lower_count;
+static uint32_t lower_timeout_ms;
+/* Read by the Modbus server, one aligned word written by the client thread only. */
+static uint32_t reconfigs;
+
+/* Written by the client thread only, one aligned field at a time, and read by the Zigbee stack as attributes. */
+struct modbus_client_slave_stats modbus_client_slave_stats[MODBUS_CLIENT_SLAVE_COUNT];
+
+static int client_iface = -ENODEV;
+/* Baudrate to switch to before the next transaction [bps], 0 if none */
+static atomic_t baud_pending;
+
+static uint32_t baudrate_to_bps(zb_zcl_modbus_baudrate_t baudrate) {
+    switch (baudrate) {
+    case ZB_ZCL_MODBUS_BAUDRATE_9600:
+        return 9600;
+    case ZB_ZCL_MODBUS_BAUDRATE_115200:
+        return 115200;
+    case ZB_ZCL_MODBUS_BAUDRATE_19200:
+    default:
+        return 19200;
+    }
+}
+
+static int client_configure(int iface, uint32_t bps, uint32_t timeout_ms) {
+    struct modbus_iface_param client_param = {
+        .mode       = MODBUS_MODE_RTU,
+        .rx_timeout = timeout_ms * USEC_PER_MSEC,
+        .serial =
+            {
+                .baud   = bps,
+                .parity = UART_CFG_PARITY_NONE,
+            },
+    };
+
+    return modbus_init_client(iface, client_param);
+}
+
+/* Interface timeout covering a bus timeout: the minimum timeout times a power of two, so that slaves with close response times share one. */
+static uint32_t timeout_step(uint32_t timeout_ms) {
+    uint32_t step = CONFIG_APP_MODBUS_TIMEOUT_MIN_MS;
+
+    while (step < timeout_ms) {
+        step <<= 1;
+    }
+
+    return step;
+}
+
+int modbus_client_init(zb_zcl_modbus_baudrate_t baudrate) {
+    int iface = modbus_iface_get_by_name(CONFIG_APP_MODBUS_CLIENT_IFACE);
+    int err;
+
+    if (iface < 0) {
+        LOG_ERR("Failed to get iface index for %s", CONFIG_APP_MODBUS_CLIENT_IFACE);
+        return iface;
+    }
+
+    err = client_configure(iface, baudrate_to_bps(baudrate), timeout_step(CONFIG_APP_MODBUS_TIMEOUT_MAX_MS));
+    if (err) {
+        LOG_ERR("Modbus client init failed (err: %d)", err);
+        return err;
+    }
+
+    client_bps        = baudrate_to_bps(baudrate);
+    client_timeout_ms = timeout_step(CONFIG_APP_MODBUS_TIMEOUT_MAX_MS);
+    client_iface      = iface;
+    return 0;
+}
+
+int modbus_client_set_baudrate(zb_zcl_modbus_baudrate_t baudrate) {
+    if (client_iface < 0) {
+        return -ENODEV;
+    }
+
+    atomic_set(&baud_pending, (atomic_val_t)baudrate_to_bps(baudrate));
+    return 0;
+}
+
+modbus_cmd_resp_queue_data_t* modbus_client_alloc(void) {
+    for (size_t i = 0; i < ARRAY_SIZE(items); i++) {
+        if (!atomic_test_and_set_bit(items_used, i)) {
+            memset(&items[i], 0, sizeof(items[i]));
+            return &items[i];
+        }
+    }
+
+    return NULL;
+}
+
+void modbus_client_free(modbus_cmd_resp_queue_data_t* item) {
+    atomic_clear_bit(items_used, item - items);
+}
+
+modbus_cmd_resp_queue_data_t* modbus_client_get(zb_uint8_t idx) {
+    __ASSERT(idx < ARRAY_SIZE(items), "Invalid queue item index");
+
+    return &items[idx];
+}
+
+int modbus_client_submit(modbus_cmd_resp_queue_data_t* item) {
+    if (client_iface < 0) {
+        return -ENODEV;
+    }
+
+    atomic_set_bit(items_queued, item - items);
+    k_fifo_put(&fifo, item);
+    return 0;
+}
+
+int modbus_client_cancel(modbus_client_match_t match, const void* ctx) {
+    int count = 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(items); i++) {
+        /* Whoever clears the queued bit first, this function or the client thread, owns the item. */
+        if (atomic_test_bit(items_queued, i) && match(&items[i], ctx) && atomic_test_and_clear_bit(items_queued, i)) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Timing entry of a slave, or the least recently used entry reset for it. */
+static struct slave_timing* slave_timing_get(uint8_t slave_id) {
+    struct slave_timing*              victim = &slave_timings[0];
+    struct modbus_client_slave_stats* stats;
+
+    for (size_t i = 0; i < ARRAY_SIZE(slave_timings); i++) {
+        struct slave_timing* entry = &slave_timings[i];
+
+        if (entry->used && entry->slave_id == slave_id) {
+            return entry;
+        }
+        if (!entry->used || (victim->used && (int32_t)(entry->last_used - victim->last_used) < 0)) {
+            victim = entry;
+        }
+    }
+
+    stats = &modbus_client_slave_stats[victim - slave_timings];
+    memset(victim, 0, sizeof(*victim));
+    memset(stats, 0, sizeof(*stats));
+
+    victim->used      = true;
+    victim->slave_id  = slave_id;
+    stats->slave_id   = slave_id;
+    stats->timeout_ms = CONFIG_APP_MODBUS_TIMEOUT_MAX_MS;
+
+    return victim;
+}
+
+static bool slave_offline(const struct slave_timing* timing) {
+    return timing->misses >= CONFIG_APP_MODBUS_SLAVE_OFFLINE_TIMEOUTS;
+}
+
+/* Bus timeout of a transaction to a slave, whose frames take line_ms on the line.
+ * It is doubled after each timeout, but an offline slave is probed with the estimate so that its return is seen early.
+ */
+static uint32_t slave_timeout(const struct slave_timing* timing, uint32_t line_ms) {
+    uint8_t backoff = slave_offline(timing) ? 0 : MIN(timing->misses, BACKOFF_MAX_SHIFT);
+
+    return modbus_timing_timeout(&timing->model, backoff, line_ms, CONFIG_APP_MODBUS_TIMEOUT_MIN_MS, CONFIG_APP_MODBUS_TIMEOUT_MAX_MS);
+}
+
+static void slave_timing_update(struct slave_timing* timing, int err, uint32_t elapsed_ms, uint32_t line_ms) {
+    struct modbus_client_slave_stats* stats = &modbus_client_slave_stats[timing - slave_timings];
+
+    timing->last_used = k_uptime_get_32();
+
+    if (err == -ETIMEDOUT) {
+        stats->timeouts++;
+        if (timing->misses < UINT8_MAX) {
+            timing->misses++;
+        }
+        if (timing->misses == CONFIG_APP_MODBUS_SLAVE_OFFLINE_TIMEOUTS) {
+            LOG_WRN("Slave %u offline", timing->slave_id);
+            timing->probe_time = timing->last_used;
+            stats->state       = MODBUS_CLIENT_SLAVE_OFFLINE;
+        }
+        stats->timeout_ms = (uint16_t)slave_timeout(timing, 0);
+        return;
+    }
+    if (err < 0) {
+        /* Not an answer of the slave. */
+        return;
+    }
+
+    if (slave_offline(timing)) {
+        LOG_INF("Slave %u online", timing->slave_id);
+    }
+    timing->misses = 0;
+    modbus_timing_sample(&timing->model, elapsed_ms, line_ms);
+
+    stats->answers++;
+    stats->state      = MODBUS_CLIENT_SLAVE_ONLINE;
+    stats->srtt_ms    = (uint16_t)MIN(timing->model.srtt8 / 8, UINT16_MAX);
+    stats->rttvar_ms  = (uint16_t)MIN(timing->model.rttvar4 / 4, UINT16_MAX);
+    stats->timeout_ms = (uint16_t)slave_timeout(timing, 0);
+}
+
+/* Baudrate of the next transaction: the pending one if any, which is taken. */
+static uint32_t client_next_bps(void) {
+    uint32_t bps = (uint32_t)atomic_clear(&baud_pending);
+
+    return (bps != 0) ? bps : client_bps;
+}
+
+/* Apply a baudrate and an interface timeout covering the bus timeout of the next transaction, between transactions only.
+ * Reconfiguring disables and initializes the UART again, so the interface timeout is raised at once but only lowered after a run
+ * of transactions that all needed less. Until then, a transaction to a fast slave that does not answer waits longer.
+ */
+static void client_reconfigure(uint32_t bps, uint32_t timeout_ms) {
+    timeout_ms = timeout_step(timeout_ms);
+    if (timeout_ms >= client_timeout_ms) {
+        lower_count      = 0;
+        lower_timeout_ms = 0;
+    } else if (++lower_count < TIMEOUT_LOWER_AFTER) {
+        lower_timeout_ms = MAX(lower_timeout_ms, timeout_ms);
+        timeout_ms       = client_timeout_ms;
+    } else {
+        timeout_ms       = MAX(lower_timeout_ms, timeout_ms);
+        lower_count      = 0;
+        lower_timeout_ms = 0;
+    }
+
+    if (bps == client_bps && timeout_ms == client_timeout_ms) {
+        return;
+    }
+
+    modbus_disable(client_iface);
+    if (client_configure(client_iface, bps, timeout_ms) != 0) {
+        LOG_ERR("Failed to configure %u bps, timeout %u ms", bps, timeout_ms);
+        return;
+    }
+
+    if (bps != client_bps) {
+        LOG_INF("Switched to %u bps", bps);
+    }
+    LOG_DBG("Interface timeout %u ms", timeout_ms);
+    client_bps        = bps;
+    client_timeout_ms = timeout_ms;
+    reconfigs++;
+}
+
+uint32_t modbus_client_get_reconfigs(void) {
+    return *(volatile uint32_t*)&reconfigs;
+}
+
+static bool fc_supported(uint8_t fc) {
+    return fc == MODBUS_FC_READ_HOLDING_REGS || fc == MODBUS_FC_READ_INPUT_REGS || fc == MODBUS_FC_WRITE_HOLDING_REG || fc == MODBUS_FC_WRITE_HOLDING_REGS;
+}
+
+static int modbus_client_execute(modbus_cmd_resp_queue_data_t* item) {
+    zb_zcl_modbus_data_packet_resp_t* pkt  = &item->resp;
+    uint16_t*                         data = (item->regs != NULL) ? item->regs : pkt->data;
+
+    switch (pkt->fc) {
+    case MODBUS_FC_READ_HOLDING_REGS:
+        return modbus_read_holding_regs(client_iface, pkt->slave_id, pkt->addr, data, pkt->nb_regs);
+    case MODBUS_FC_READ_INPUT_REGS:
+        return modbus_read_input_regs(client_iface, pkt->slave_id, pkt->addr, data, pkt->nb_regs);
+    case MODBUS_FC_WRITE_HOLDING_REG:
+        return modbus_write_holding_reg(client_iface, pkt->slave_id, pkt->addr, data[0]);
+    case MODBUS_FC_WRITE_HOLDING_REGS:
+        return modbus_write_holding_regs(client_iface, pkt->slave_id, pkt->addr, data, pkt->nb_regs);
+    default:
+        return ZB_ZCL_MODBUS_EXCP_CODE(ZB_ZCL_MODBUS_EXCP_ILLEGAL_FUNC);
+    }
+}
+
+/* Execute a transaction, with a bus timeout adapted to the slave.
+ * Transactions to an offline slave are answered with a gateway exception without touching the bus.
+ */
+static int modbus_client_run(modbus_cmd_resp_queue_data_t* item) {
+    struct slave_timing* timing = slave_timing_get(item->resp.slave_id);
+    uint32_t             start  = k_uptime_get_32();
+    uint32_t             bps;
+    uint32_t             line_ms;
+    uint32_t             sent;
+    int                  err;
+
+    if (!fc_supported(item->resp.fc)) {
+        return ZB_ZCL_MODBUS_EXCP_CODE(ZB_ZCL_MODBUS_EXCP_ILLEGAL_FUNC);
+    }
+
+    if (item->deadline != 0 && (int32_t)(item->deadline - start) <= 0) {
+        /* Nobody waits for the answer anymore, leave the bus to the next request. */
+        return -ETIME;
+    }
+
+    /* Fail fast for an offline slave, apart from a probe now and then. */
+    if (slave_offline(timing)) {
+        if (start - timing->probe_time < CONFIG_APP_MODBUS_SLAVE_PROBE_INTERVAL_S * MSEC_PER_SEC) {
+            return ZB_ZCL_MODBUS_EXCP_CODE(ZB_ZCL_MODBUS_EXCP_GATE_TARGET_FAILED_TO_RESPOND);
+        }
+        timing->probe_time = start;
+    }
+
+    bps     = client_next_bps();
+    line_ms = modbus_timing_line_ms(item->resp.fc, item->resp.nb_regs, bps);
+    client_reconfigure(bps, slave_timeout(timing, line_ms));
+
+    /* Measured from here, so that reconfiguring the interface is not taken for response time. */
+    sent = k_uptime_get_32();
+    err  = modbus_client_execute(item);
+    slave_timing_update(timing, err, k_uptime_get_32() - sent, line_ms);
+
+    return err;
+}
+
+static void modbus_client_thread(void) {
+    while (1) {
+        modbus_cmd_resp_queue_data_t* item = k_fifo_get(&fifo, K_FOREVER);
+
+        if (!atomic_test_and_clear_bit(items_queued, item - items)) {
+            item->resp.err = -ECANCELED;
+        } else {
+            item->resp.err = (int16_t)modbus_client_run(item);
+        }
+
+        if (item->resp.err == -ECANCELED || item->resp.err == -ETIME) {
+            LOG_DBG("Slave %d fc %d addr %d dropped (err: %d)", item->resp.slave_id, item->resp.fc, item->resp.addr, item->resp.err);
+        } else if (item->resp.err) {
+            APP_LOG_RATELIMIT(LOG_WRN, "Slave %d fc %d addr %d failed (err: %d)", item->resp.slave_id, item->resp.fc, item->resp.addr, item->resp.err);
+        }
+
+        /* Hand the result back to the Zigbee stack context. */
+        while (zigbee_schedule_callback((zb_callback_t)item->cb, (zb_uint8_t)(item - items)) != RET_OK) {
+            k_msleep(1);
+        }
+    }
+}
+
+K_THREAD_DEFINE(modbus_client_tid, MODBUS_CLIENT_STACK_SIZE, modbus_client_thread, NULL, NULL, NULL, MODBUS_CLIENT_PRIORITY, 0, 0);
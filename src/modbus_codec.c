@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "modbus_codec.h"
+#include "varint.h"
+
+int modbus_codec_encode(const uint16_t* values, const uint16_t* baseline, uint8_t nb_regs, uint8_t* out, size_t size) {
+    uint8_t tmp[VARINT_MAX_LEN];
+    size_t  len = MODBUS_CODEC_BITMAP_LEN(nb_regs);
+
+    if (size < len) {
+        return -ENOSPC;
+    }
+
+    memset(out, 0, len);
+
+    for (uint8_t i = 0; i < nb_regs; i++) {
+        uint16_t base = (baseline != NULL) ? baseline[i] : 0;
+        size_t   n;
+
+        if (values[i] == base) {
+            continue;
+        }
+
+        /* Differences wrap at 16 bits, so they never take more than 3 bytes. */
+        n = varint_put(tmp, zigzag_encode((int16_t)(values[i] - base)));
+        if (len + n > size) {
+            return -ENOSPC;
+        }
+
+        out[i / 8] |= (uint8_t)(1 << (i % 8));
+        memcpy(&out[len], tmp, n);
+        len += n;
+    }
+
+    return (int)len;
+}
+
+int modbus_codec_decode(const uint8_t* in, size_t len, const uint16_t* baseline, uint8_t nb_regs, uint16_t* values) {
+    size_t pos = MODBUS_CODEC_BITMAP_LEN(nb_regs);
+
+    if (len < pos) {
+        return -EINVAL;
+    }
+
+    for (uint8_t i = 0; i < nb_regs; i++) {
+        uint16_t base = (baseline != NULL) ? baseline[i] : 0;
+        uint32_t diff;
+        size_t   n;
+
+        if (!(in[i / 8] & (1 << (i % 8)))) {
+            values[i] = base;
+            continue;
+        }
+
+        n = varint_get(&in[pos], len - pos, &diff);
+        if (n == 0) {
+            return -EINVAL;
+        }
+        pos += n;
+
+        values[i] = (uint16_t)(base + zigzag_decode(diff));
+    }
+
+    return (int)pos;
+}
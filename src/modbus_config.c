@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "modbus_client.h"
+#include "modbus_config.h"
+#include "rules.h"
+
+LOG_MODULE_REGISTER(modbus_config, LOG_LEVEL_INF);
+
+#define MODBUS_CONFIG_VERSION 1
+
+/* Size of the stack buffer used to restore the rules program */
+#define RULES_READ_CHUNK 32
+
+/* Dataset header, followed by rules_len bytes of rules program. */
+typedef ZB_PACKED_PRE struct modbus_config_nvram_s {
+    zb_uint8_t  version;
+    zb_uint8_t  baudrate;
+    zb_uint8_t  channel;
+    zb_uint16_t request_timeout;
+    zb_uint16_t rules_len;
+} ZB_PACKED_STRUCT modbus_config_nvram_t;
+
+static zb_zcl_modbus_attrs_t* config_attrs;
+static zb_uint8_t             config_channel;
+static bool                   write_pending;
+
+static zb_uint16_t rules_len(const zb_uint8_t** program) {
+#ifdef CONFIG_APP_RULES
+    zb_uint16_t len;
+
+    *program = rules_get(&len);
+    return len;
+#else
+    *program = NULL;
+    return 0;
+#endif /* CONFIG_APP_RULES */
+}
+
+static zb_uint16_t config_get_size(void) {
+    const zb_uint8_t* program;
+
+    return (zb_uint16_t)(sizeof(modbus_config_nvram_t) + rules_len(&program));
+}
+
+/* Called by the stack whenever the dataset is written, including when NVRAM pages are migrated. */
+static zb_ret_t config_write(zb_uint8_t page, zb_uint32_t pos) {
+    modbus_config_nvram_t hdr;
+    const zb_uint8_t*     program;
+    zb_ret_t              ret;
+
+    hdr.version         = MODBUS_CONFIG_VERSION;
+    hdr.baudrate        = config_attrs->baudrate;
+    hdr.channel         = config_channel;
+    hdr.request_timeout = config_attrs->request_timeout;
+    hdr.rules_len       = rules_len(&program);
+
+    ret = zb_nvram_write_data(page, pos, (zb_uint8_t*)&hdr, sizeof(hdr));
+    if (ret == RET_OK && hdr.rules_len > 0) {
+        ret = zb_nvram_write_data(page, pos + sizeof(hdr), (zb_uint8_t*)program, hdr.rules_len);
+    }
+
+    return ret;
+}
+
+/* Scan the channel of the last network first when steering, the others only if it is not found there. */
+static void config_restore_channel(void) {
+    zb_uint32_t mask = zb_get_bdb_primary_channel_set();
+
+    if (config_channel < 32 && (mask & BIT(config_channel)) && mask != BIT(config_channel)) {
+        zb_set_bdb_primary_channel_set(BIT(config_channel));
+        zb_set_bdb_secondary_channel_set(mask & ~BIT(config_channel));
+    }
+}
+
+/* Called by the stack when the dataset is loaded on start. */
+static void config_read(zb_uint8_t page, zb_uint32_t pos, zb_uint16_t payload_length) {
+    modbus_config_nvram_t hdr;
+
+    if (payload_length < sizeof(hdr) || zb_nvram_read_data(page, pos, (zb_uint8_t*)&hdr, sizeof(hdr)) != RET_OK) {
+        LOG_WRN("Invalid configuration dataset, using defaults");
+        return;
+    }
+
+    if (hdr.version != MODBUS_CONFIG_VERSION || payload_length != sizeof(hdr) + hdr.rules_len) {
+        LOG_WRN("Configuration dataset version %u not supported, using defaults", hdr.version);
+        return;
+    }
+
+    if (hdr.baudrate <= ZB_ZCL_MODBUS_BAUDRATE_MAX_VALUE) {
+        config_attrs->baudrate = hdr.baudrate;
+        modbus_client_set_baudrate(hdr.baudrate);
+    }
+
+    config_attrs->request_timeout = hdr.request_timeout;
+
+    config_channel = hdr.channel;
+    config_restore_channel();
+
+#ifdef CONFIG_APP_RULES
+    /* Loaded the same way as a download, chunk by chunk. */
+    for (zb_uint16_t offset = 0; offset < hdr.rules_len;) {
+        zb_uint8_t chunk[RULES_READ_CHUNK];
+        zb_uint8_t len = (zb_uint8_t)MIN(sizeof(chunk), hdr.rules_len - offset);
+
+        if (zb_nvram_read_data(page, pos + sizeof(hdr) + offset, chunk, len) != RET_OK || rules_download(offset, hdr.rules_len, chunk, len) != 0) {
+            LOG_WRN("Stored rules not loaded");
+            break;
+        }
+        offset += len;
+    }
+#endif /* CONFIG_APP_RULES */
+
+    LOG_INF("Configuration restored: baudrate %u, request timeout %u ms, channel %u, rules %u bytes", config_attrs->baudrate, hdr.request_timeout, hdr.channel, hdr.rules_len);
+}
+
+static void config_flush(zb_uint8_t param) {
+    zb_ret_t ret;
+
+    ZVUNUSED(param);
+
+    write_pending = false;
+    ret           = zb_nvram_write_dataset(ZB_NVRAM_APP_DATA1);
+    if (ret != RET_OK) {
+        LOG_ERR("Failed to store configuration (ret: %d)", ret);
+    }
+}
+
+void modbus_config_changed(void) {
+    if (!write_pending) {
+        write_pending = true;
+        ZB_SCHEDULE_APP_ALARM(config_flush, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_MODBUS_CONFIG_WRITE_DELAY_S * MSEC_PER_SEC));
+    }
+}
+
+void modbus_config_set_channel(zb_uint8_t channel) {
+    if (channel != config_channel) {
+        config_channel = channel;
+        modbus_config_changed();
+    }
+}
+
+void modbus_config_init(zb_zcl_modbus_attrs_t* attrs) {
+    config_attrs = attrs;
+
+    zb_nvram_register_app1_read_cb(config_read);
+    zb_nvram_register_app1_write_cb(config_write, config_get_size);
+}
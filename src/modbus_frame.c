@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+
+#include "modbus_frame.h"
+#include "modbus_regmap.h"
+
+int modbus_frame_string(const uint8_t* buf, size_t len, size_t max_len, const uint8_t** str) {
+    if (len == 0 || (size_t)buf[0] + 1 > len) {
+        return -EINVAL;
+    }
+    if (buf[0] > max_len) {
+        return -EMSGSIZE;
+    }
+
+    *str = &buf[1];
+    return buf[0];
+}
+
+int modbus_frame_parse_request(const uint8_t* data, size_t len, uint8_t max_regs, struct modbus_frame_request* req) {
+    size_t expected = MODBUS_FRAME_REQ_HDR_LEN;
+
+    if (len < MODBUS_FRAME_REQ_HDR_LEN) {
+        return -EINVAL;
+    }
+
+    req->fc           = data[0];
+    req->slave_id     = data[1];
+    req->addr         = modbus_frame_get_le16(&data[2]);
+    req->nb_regs      = data[4];
+    req->has_deadline = false;
+    req->deadline_ms  = 0;
+    req->values       = NULL;
+
+    if (req->nb_regs == 0 || req->nb_regs > max_regs) {
+        return -EINVAL;
+    }
+
+    if (req->fc == MODBUS_FC_WRITE_HOLDING_REG || req->fc == MODBUS_FC_WRITE_HOLDING_REGS) {
+        if (req->fc == MODBUS_FC_WRITE_HOLDING_REG && req->nb_regs != 1) {
+            return -EINVAL;
+        }
+        req->values = &data[MODBUS_FRAME_REQ_HDR_LEN];
+        expected += 2 * (size_t)req->nb_regs;
+    }
+
+    if (len == expected + MODBUS_FRAME_DEADLINE_LEN) {
+        req->has_deadline = true;
+        req->deadline_ms  = modbus_frame_get_le16(&data[expected]);
+    } else if (len != expected) {
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+int modbus_frame_parse_response(const uint8_t* data, size_t len, struct modbus_frame_response* resp) {
+    if (len < MODBUS_FRAME_RESP_HDR_LEN) {
+        return -EINVAL;
+    }
+
+    resp->fc       = data[0];
+    resp->slave_id = data[1];
+    resp->addr     = modbus_frame_get_le16(&data[2]);
+    resp->err      = (int16_t)modbus_frame_get_le16(&data[4]);
+    resp->nb_regs  = data[6];
+    resp->data     = &data[MODBUS_FRAME_RESP_HDR_LEN];
+    resp->len      = len - MODBUS_FRAME_RESP_HDR_LEN;
+
+    return 0;
+}
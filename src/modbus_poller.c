@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "app_log.h"
+#include "modbus_aggregate.h"
+#include "modbus_client.h"
+#include "modbus_poller.h"
+#include "modbus_regmap.h"
+#include "modbus_regmap_defs.h"
+#include "rules.h"
+#include "sample_log.h"
+
+LOG_MODULE_REGISTER(modbus_poller, LOG_LEVEL_INF);
+
+struct poll_entry {
+    uint8_t  slave_id;
+    uint8_t  fc;
+    uint16_t addr;
+    uint8_t  nb_regs;
+};
+
+#define POLL_ENTRY(slave, fc, addr, nb_regs) {slave, MODBUS_FC_##fc, addr, nb_regs},
+
+static const struct poll_entry poll_list[] = {MODBUS_POLL_LIST(POLL_ENTRY)};
+
+#define POLL_CHECK(slave, fc, addr, nb_regs) BUILD_ASSERT((nb_regs) <= SAMPLE_LOG_MAX_REGS, "Too many registers in poll list entry");
+
+MODBUS_POLL_LIST(POLL_CHECK)
+BUILD_ASSERT(ARRAY_SIZE(poll_list) <= SAMPLE_LOG_MAX_ENTRIES, "Too many poll list entries");
+
+static bool poll_running;
+
+static int poll_find(const zb_zcl_modbus_data_packet_resp_t* resp) {
+    for (size_t i = 0; i < ARRAY_SIZE(poll_list); i++) {
+        if (poll_list[i].slave_id == resp->slave_id && poll_list[i].fc == resp->fc && poll_list[i].addr == resp->addr && poll_list[i].nb_regs == resp->nb_regs) {
+            return (int)i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/**@brief Called in the Zigbee stack context when a poll read is finished.
+ *
+ * @param  idx  Index of the Modbus client queue item.
+ */
+static void modbus_poll_done(zb_uint8_t idx) {
+    modbus_cmd_resp_queue_data_t* item  = modbus_client_get(idx);
+    int                           entry = poll_find(&item->resp);
+
+    if (item->resp.err == 0 && entry >= 0) {
+#ifdef CONFIG_APP_SAMPLE_LOG
+        sample_log_add((uint8_t)entry, item->resp.data, item->resp.nb_regs);
+#endif /* CONFIG_APP_SAMPLE_LOG */
+#ifdef CONFIG_APP_MODBUS_AGGREGATE
+        modbus_aggregate_add((uint8_t)entry, item->resp.data, item->resp.nb_regs);
+#endif /* CONFIG_APP_MODBUS_AGGREGATE */
+#ifdef CONFIG_APP_RULES
+        rules_poll_result((uint8_t)entry, item->resp.data, item->resp.nb_regs);
+#endif /* CONFIG_APP_RULES */
+    }
+
+    modbus_client_free(item);
+}
+
+/**@brief Queue a read of every poll list entry.
+ *
+ * @param  bufid  Unused parameter, required by ZBOSS scheduler API.
+ */
+static void modbus_poll(zb_bufid_t bufid) {
+    ZVUNUSED(bufid);
+
+    for (size_t i = 0; i < ARRAY_SIZE(poll_list); i++) {
+        modbus_cmd_resp_queue_data_t* item = modbus_client_alloc();
+
+        if (item == NULL) {
+            APP_LOG_RATELIMIT(LOG_WRN, "Queue full, poll entry %d skipped", (int)i);
+            continue;
+        }
+
+        item->cb            = modbus_poll_done;
+        item->resp.slave_id = poll_list[i].slave_id;
+        item->resp.fc       = poll_list[i].fc;
+        item->resp.addr     = poll_list[i].addr;
+        item->resp.nb_regs  = poll_list[i].nb_regs;
+
+        if (modbus_client_submit(item) != 0) {
+            modbus_client_free(item);
+        }
+    }
+
+    ZB_SCHEDULE_APP_ALARM(modbus_poll, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_MODBUS_POLL_INTERVAL_S * MSEC_PER_SEC));
+}
+
+void modbus_poller_start(void) {
+    if (!poll_running) {
+        poll_running = true;
+        ZB_SCHEDULE_APP_CALLBACK(modbus_poll, 0);
+    }
+}
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+
+#include "modbus_regmap.h"
+#include "modbus_regmap_defs.h"
+
+struct modbus_slave {
+    uint8_t              slave_id;
+    struct modbus_regmap map;
+};
+
+#define REGMAP_ENTRY(space, addr, type, order, scale, unit, access)                                                                                                                                                                                      \
+    {addr, MODBUS_REG_SPACE_##space, MODBUS_REG_TYPE_##type, MODBUS_WORD_ORDER_##order, scale, MODBUS_UNIT_##unit, MODBUS_REG_ACCESS_##access},
+
+#define REGMAP_DEFINE(type) static const struct modbus_reg_desc regmap_##type[] = {MODBUS_REGMAP_##type(REGMAP_ENTRY)};
+
+MODBUS_REGMAP_TYPES(REGMAP_DEFINE)
+
+#define SLAVE_ENTRY(id, type) {id, {regmap_##type, ARRAY_SIZE(regmap_##type)}},
+
+static const struct modbus_slave slaves[] = {MODBUS_SLAVES(SLAVE_ENTRY)};
+
+/* 10^n for the decimal exponents used when converting float registers. */
+static const float pow10_table[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f};
+
+static int fc_to_space(uint8_t fc, uint8_t* access) {
+    switch (fc) {
+    case MODBUS_FC_READ_HOLDING_REGS:
+        *access = MODBUS_REG_ACCESS_R;
+        return MODBUS_REG_SPACE_HOLDING;
+    case MODBUS_FC_READ_INPUT_REGS:
+        *access = MODBUS_REG_ACCESS_R;
+        return MODBUS_REG_SPACE_INPUT;
+    case MODBUS_FC_WRITE_HOLDING_REG:
+    case MODBUS_FC_WRITE_HOLDING_REGS:
+        *access = MODBUS_REG_ACCESS_W;
+        return MODBUS_REG_SPACE_HOLDING;
+    default:
+        return -EINVAL;
+    }
+}
+
+static int reg_cmp(const struct modbus_reg_desc* reg, uint8_t space, uint16_t addr) {
+    if (reg->space != space) {
+        return (int)reg->space - (int)space;
+    }
+    return (int)reg->addr - (int)addr;
+}
+
+/* Binary search for the entry starting exactly at addr. */
+static int regmap_find(const struct modbus_regmap* map, uint8_t space, uint16_t addr) {
+    int lo = 0;
+    int hi = (int)map->count - 1;
+
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = reg_cmp(&map->regs[mid], space, addr);
+
+        if (cmp == 0) {
+            return mid;
+        } else if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return -EINVAL;
+}
+
+const struct modbus_regmap* modbus_regmap_get(uint8_t slave_id) {
+    for (size_t i = 0; i < ARRAY_SIZE(slaves); i++) {
+        if (slaves[i].slave_id == slave_id) {
+            return &slaves[i].map;
+        }
+    }
+
+    return NULL;
+}
+
+int modbus_regmap_validate(const struct modbus_regmap* map, uint8_t fc, uint16_t addr, uint16_t nb_regs) {
+    uint8_t  access;
+    int      space = fc_to_space(fc, &access);
+    int      idx;
+    int      values = 0;
+    uint32_t next   = addr;
+    uint32_t end    = (uint32_t)addr + nb_regs;
+
+    if (space < 0 || nb_regs == 0) {
+        return -EINVAL;
+    }
+
+    idx = regmap_find(map, (uint8_t)space, addr);
+    if (idx < 0) {
+        return -EINVAL;
+    }
+
+    while (next < end) {
+        const struct modbus_reg_desc* reg;
+
+        if (idx >= map->count) {
+            return -EINVAL;
+        }
+
+        reg = &map->regs[idx];
+        if (reg->space != space || reg->addr != next || !(reg->access & access)) {
+            return -EINVAL;
+        }
+
+        next += MODBUS_REG_TYPE_WORDS(reg->type);
+        values++;
+        idx++;
+    }
+
+    /* The range must not end in the middle of a 32-bit value. */
+    return (next == end) ? values : -EINVAL;
+}
+
+static int32_t decode_float(uint32_t bits, int8_t scale) {
+    float value;
+
+    memcpy(&value, &bits, sizeof(value));
+
+    if (scale < 0 && -scale < (int)ARRAY_SIZE(pow10_table)) {
+        value *= pow10_table[-scale];
+    } else if (scale > 0 && scale < (int)ARRAY_SIZE(pow10_table)) {
+        value /= pow10_table[scale];
+    }
+
+    if (!isfinite(value) || value >= 2147483647.0f || value <= -2147483648.0f) {
+        return value < 0 ? INT32_MIN : INT32_MAX;
+    }
+
+    return (int32_t)lroundf(value);
+}
+
+int modbus_regmap_decode(const struct modbus_regmap* map, uint8_t fc, uint16_t addr, const uint16_t* words, uint16_t nb_regs, struct modbus_reg_value* values, size_t max) {
+    uint8_t access;
+    int     space = fc_to_space(fc, &access);
+    int     idx;
+    size_t  count = 0;
+    size_t  pos   = 0;
+
+    if (space < 0) {
+        return -EINVAL;
+    }
+
+    idx = regmap_find(map, (uint8_t)space, addr);
+    if (idx < 0) {
+        return -EINVAL;
+    }
+
+    while (pos < nb_regs && idx < map->count && count < max) {
+        const struct modbus_reg_desc* reg = &map->regs[idx++];
+        struct modbus_reg_value*      out = &values[count++];
+        uint32_t                      raw32;
+
+        out->scale = reg->scale;
+        out->type  = reg->type;
+        out->unit  = reg->unit;
+
+        if (MODBUS_REG_TYPE_WORDS(reg->type) == 2) {
+            if (pos + 1 >= nb_regs) {
+                return -EINVAL;
+            }
+            if (reg->word_order == MODBUS_WORD_ORDER_HL) {
+                raw32 = ((uint32_t)words[pos] << 16) | words[pos + 1];
+            } else {
+                raw32 = ((uint32_t)words[pos + 1] << 16) | words[pos];
+            }
+            pos += 2;
+        } else {
+            raw32 = words[pos];
+            pos += 1;
+        }
+
+        switch (reg->type) {
+        case MODBUS_REG_TYPE_I16:
+            out->value = (int16_t)raw32;
+            break;
+        case MODBUS_REG_TYPE_FLOAT32:
+            out->value = decode_float(raw32, reg->scale);
+            break;
+        case MODBUS_REG_TYPE_U32:
+        case MODBUS_REG_TYPE_I32:
+        case MODBUS_REG_TYPE_U16:
+        case MODBUS_REG_TYPE_BITFIELD:
+        default:
+            out->value = (int32_t)raw32;
+            break;
+        }
+    }
+
+    return (int)count;
+}
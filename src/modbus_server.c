@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stddef.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/modbus/modbus.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "boot_timing.h"
+#include "gpio.h"
+#include "modbus_client.h"
+#include "modbus_server.h"
+#include "relay_stats.h"
+#include "zb_zcl_modbus.h"
+
+LOG_MODULE_REGISTER(modbus_server, LOG_LEVEL_INF);
+
+/* Values exposed while no link quality data is available. */
+#define LINK_LQI_UNKNOWN  0
+#define LINK_RSSI_UNKNOWN 127
+
+typedef uint16_t (*reg_read_t)(uint16_t arg);
+typedef uint32_t (*reg_read32_t)(uint16_t arg);
+
+/* A 32-bit value is exposed as two registers, high word first. */
+struct reg_desc {
+    reg_read_t   read;
+    reg_read32_t read32;
+    uint16_t     arg;
+    bool         hi;
+};
+
+/* Values sampled in the Zigbee stack context, read from the Modbus server work. */
+static atomic_t network_state;
+static atomic_t link_lqi;
+static atomic_t link_rssi;
+static bool     refresh_running;
+
+/* Low word of the 32-bit value whose high word was just read, served to the read of the next register so that both words come from one sample. */
+static struct {
+    bool     valid;
+    uint16_t addr;
+    uint16_t value;
+} latch;
+
+static uint16_t reg_network_state(uint16_t arg) {
+    ARG_UNUSED(arg);
+    return (uint16_t)atomic_get(&network_state);
+}
+
+static uint16_t reg_lqi(uint16_t arg) {
+    ARG_UNUSED(arg);
+    return (uint16_t)atomic_get(&link_lqi);
+}
+
+static uint16_t reg_rssi(uint16_t arg) {
+    ARG_UNUSED(arg);
+    return (uint16_t)(int16_t)atomic_get(&link_rssi);
+}
+
+static uint16_t reg_hall_sensor(uint16_t arg) {
+    ARG_UNUSED(arg);
+    return (uint16_t)(gpio_get_buttons() & HALL_IN_MSK);
+}
+
+static uint32_t reg_diag(uint16_t offset) {
+    const uint8_t* diag = (const uint8_t*)zb_zcl_modbus_get_diag();
+
+    return *(const volatile uint32_t*)(diag + offset);
+}
+
+static uint32_t reg_boot(uint16_t phase) {
+    return boot_timing_get((enum boot_phase)phase);
+}
+
+static uint32_t reg_reconfigs(uint16_t arg) {
+    ARG_UNUSED(arg);
+    return modbus_client_get_reconfigs();
+}
+
+#define REGS32(name, fn, arg)  [MODBUS_SERVER_REG_##name##_HI] = {NULL, fn, arg, true}, [MODBUS_SERVER_REG_##name##_LO] = {NULL, fn, arg, false}
+#define BOOT_REGS(name)        REGS32(BOOT_##name, reg_boot, BOOT_PHASE_##name)
+#define DIAG_REGS(name, field) REGS32(name, reg_diag, offsetof(zb_zcl_modbus_diag_t, field))
+
+#ifdef CONFIG_APP_RELAY_STATS
+static uint32_t reg_relay(uint16_t stat) {
+    return relay_stats_get((enum relay_stat)stat);
+}
+
+#define RELAY_REGS(name) REGS32(name, reg_relay, RELAY_STAT_##name)
+#endif /* CONFIG_APP_RELAY_STATS */
+
+/* Indexed by register address, so a lookup is a single bounds check. */
+static const struct reg_desc reg_map[MODBUS_SERVER_REG_COUNT] = {
+    [MODBUS_SERVER_REG_NETWORK_STATE] = {reg_network_state, NULL, 0, false},
+    [MODBUS_SERVER_REG_LQI]           = {reg_lqi, NULL, 0, false},
+    [MODBUS_SERVER_REG_RSSI]          = {reg_rssi, NULL, 0, false},
+    [MODBUS_SERVER_REG_HALL_SENSOR]   = {reg_hall_sensor, NULL, 0, false},
+    DIAG_REGS(CMD_RECEIVED, cmd_received),
+    DIAG_REGS(CMD_REJECTED, cmd_rejected),
+    DIAG_REGS(RESP_SENT, resp_sent),
+    DIAG_REGS(BUS_ERRORS, bus_errors),
+    DIAG_REGS(CMD_DUPLICATES, cmd_duplicates),
+    BOOT_REGS(JOINED),
+    BOOT_REGS(FIRST_RESPONSE),
+#ifdef CONFIG_APP_RELAY_STATS
+    RELAY_REGS(RELAYED),
+    RELAY_REGS(BUF_ALLOC_FAIL),
+    RELAY_REGS(BUF_LOW_S),
+    RELAY_REGS(NWK_RETRY_OVERFLOW),
+    RELAY_REGS(BCAST_TABLE_FULL),
+    RELAY_REGS(MAC_TX_FAIL),
+    RELAY_REGS(MAC_RX_DROP),
+#endif /* CONFIG_APP_RELAY_STATS */
+    DIAG_REGS(CMD_EXPIRED, cmd_expired),
+    DIAG_REGS(CMD_CANCELLED, cmd_cancelled),
+    REGS32(BUS_RECONFIGS, reg_reconfigs, 0),
+};
+
+/* Registers of a request are read in ascending order from the Modbus server work, so the low word of a 32-bit value is read right after its high word. */
+static int reg_rd(uint16_t addr, uint16_t* reg) {
+    const struct reg_desc* desc;
+    bool                   latched;
+
+    if (addr >= ARRAY_SIZE(reg_map) || (reg_map[addr].read == NULL && reg_map[addr].read32 == NULL)) {
+        latch.valid = false;
+        return -ENOTSUP;
+    }
+
+    desc        = &reg_map[addr];
+    latched     = latch.valid && latch.addr == addr;
+    latch.valid = false;
+
+    if (desc->read != NULL) {
+        *reg = desc->read(desc->arg);
+    } else if (desc->hi) {
+        uint32_t value = desc->read32(desc->arg);
+
+        *reg        = (uint16_t)(value >> 16);
+        latch.valid = true;
+        latch.addr  = addr + 1;
+        latch.value = (uint16_t)(value & 0xFFFF);
+    } else {
+        *reg = latched ? latch.value : (uint16_t)(desc->read32(desc->arg) & 0xFFFF);
+    }
+
+    return 0;
+}
+
+static int holding_reg_wr(uint16_t addr, uint16_t reg) {
+    ARG_UNUSED(addr);
+    ARG_UNUSED(reg);
+
+    return -ENOTSUP;
+}
+
+static struct modbus_user_callbacks mbs_cbs = {
+    .input_reg_rd   = reg_rd,
+    .holding_reg_rd = reg_rd,
+    .holding_reg_wr = holding_reg_wr,
+};
+
+static const struct modbus_iface_param server_param = {
+    .mode = MODBUS_MODE_RTU,
+    .server =
+        {
+            .user_cb = &mbs_cbs,
+            .unit_id = CONFIG_APP_MODBUS_SERVER_UNIT_ID,
+        },
+    .serial =
+        {
+            .baud   = CONFIG_APP_MODBUS_SERVER_BAUDRATE,
+            .parity = UART_CFG_PARITY_NONE,
+        },
+};
+
+/**@brief Sample the link quality to the coordinator.
+ *
+ * @param  bufid  Unused parameter, required by ZBOSS scheduler API.
+ */
+static void modbus_server_refresh(zb_bufid_t bufid) {
+    zb_uint8_t lqi  = LINK_LQI_UNKNOWN;
+    zb_int8_t  rssi = LINK_RSSI_UNKNOWN;
+
+    ZVUNUSED(bufid);
+
+    if (zb_zdo_get_diag_data(0x0000, &lqi, &rssi) != RET_OK) {
+        lqi  = LINK_LQI_UNKNOWN;
+        rssi = LINK_RSSI_UNKNOWN;
+    }
+
+    atomic_set(&link_lqi, lqi);
+    atomic_set(&link_rssi, rssi);
+
+    ZB_SCHEDULE_APP_ALARM(modbus_server_refresh, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_MODBUS_SERVER_REFRESH_INTERVAL_MS));
+}
+
+void modbus_server_set_network_state(bool joined) {
+    atomic_set(&network_state, joined ? 1 : 0);
+
+    if (joined && !refresh_running) {
+        refresh_running = true;
+        ZB_SCHEDULE_APP_CALLBACK(modbus_server_refresh, 0);
+    }
+}
+
+int modbus_server_init(void) {
+    int iface = modbus_iface_get_by_name(CONFIG_APP_MODBUS_SERVER_IFACE);
+    int err;
+
+    if (iface < 0) {
+        LOG_ERR("Failed to get iface index for %s", CONFIG_APP_MODBUS_SERVER_IFACE);
+        return iface;
+    }
+
+    atomic_set(&link_lqi, LINK_LQI_UNKNOWN);
+    atomic_set(&link_rssi, LINK_RSSI_UNKNOWN);
+
+    err = modbus_init_server(iface, server_param);
+    if (err) {
+        LOG_ERR("Modbus server init failed (err: %d)", err);
+        return err;
+    }
+
+    LOG_INF("Modbus server started, unit id %d", CONFIG_APP_MODBUS_SERVER_UNIT_ID);
+    return 0;
+}
@@ -0,0 +1,491 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "modbus_client.h"
+#include "modbus_frame.h"
+#include "modbus_regmap.h"
+#include "modbus_snapshot.h"
+
+LOG_MODULE_REGISTER(modbus_snapshot, LOG_LEVEL_INF);
+
+/* Address and number of registers before the values of a range */
+#define RANGE_HDR_LEN 3
+
+#define CRC_SEED 0xFFFF
+
+enum snapshot_phase
+{
+    PHASE_IDLE,
+    PHASE_READ,   /* Capture: reading a range */
+    PHASE_WRITE,  /* Restore: writing a range */
+    PHASE_VERIFY, /* Restore: reading a range back */
+    PHASE_RESULT, /* Sending the result to the requester */
+};
+
+/* Dataset header, followed by len bytes of snapshot. */
+typedef ZB_PACKED_PRE struct modbus_snapshot_nvram_s {
+    zb_uint16_t len;
+} ZB_PACKED_STRUCT modbus_snapshot_nvram_t;
+
+static struct {
+    uint8_t              phase;
+    uint8_t              op;
+    zb_zcl_modbus_addr_t addr;
+    uint8_t              slave_id;
+    uint16_t             entry;      /* Capture: next register map entry */
+    uint16_t             pos;        /* Restore: next range in the snapshot */
+    uint16_t             range_addr; /* Range on the bus */
+    uint8_t              range_len;
+    uint16_t             nb_regs;
+    int16_t              err;
+    uint16_t             fail_addr;
+} job;
+
+/* Stored snapshot, and the one being captured or imported. */
+static uint8_t  snapshot[CONFIG_APP_MODBUS_SNAPSHOT_MAX_SIZE];
+static uint16_t snapshot_len;
+static uint8_t  staging[CONFIG_APP_MODBUS_SNAPSHOT_MAX_SIZE];
+static uint16_t staging_len;
+static uint16_t staging_total;
+
+static uint16_t write_regs[MODBUS_SNAPSHOT_RANGE_MAX];
+static uint16_t read_regs[MODBUS_SNAPSHOT_RANGE_MAX];
+
+/* Export waiting for a buffer, one at a time */
+static bool                 export_pending;
+static zb_zcl_modbus_addr_t export_addr;
+static uint16_t             export_offset;
+
+static void job_submit(zb_uint8_t param);
+
+static bool reg_writable(const struct modbus_reg_desc* reg) {
+    return reg->space == MODBUS_REG_SPACE_HOLDING && (reg->access & MODBUS_REG_ACCESS_RW) == MODBUS_REG_ACCESS_RW;
+}
+
+/* Check the header, the ranges and the CRC of a snapshot. */
+static bool snapshot_validate(const uint8_t* buf, uint16_t len) {
+    uint32_t nb_regs = 0;
+    uint16_t pos     = MODBUS_SNAPSHOT_HDR_LEN;
+
+    if (len < MODBUS_SNAPSHOT_HDR_LEN || buf[0] != MODBUS_SNAPSHOT_VERSION) {
+        return false;
+    }
+
+    while (pos < len) {
+        uint8_t count;
+
+        if (pos + RANGE_HDR_LEN > len) {
+            return false;
+        }
+        count = buf[pos + 2];
+        if (count == 0 || count > MODBUS_SNAPSHOT_RANGE_MAX || pos + RANGE_HDR_LEN + 2 * count > len) {
+            return false;
+        }
+        nb_regs += count;
+        pos += RANGE_HDR_LEN + 2 * count;
+    }
+
+    return nb_regs > 0 && nb_regs == modbus_frame_get_le16(&buf[2]) && crc16_ccitt(CRC_SEED, &buf[MODBUS_SNAPSHOT_HDR_LEN], len - MODBUS_SNAPSHOT_HDR_LEN) == modbus_frame_get_le16(&buf[4]);
+}
+
+static zb_uint16_t snapshot_get_size(void) {
+    return (zb_uint16_t)(sizeof(modbus_snapshot_nvram_t) + snapshot_len);
+}
+
+/* Called by the stack whenever the dataset is written, including when NVRAM pages are migrated. */
+static zb_ret_t snapshot_write(zb_uint8_t page, zb_uint32_t pos) {
+    modbus_snapshot_nvram_t hdr;
+    zb_ret_t                ret;
+
+    hdr.len = snapshot_len;
+
+    ret = zb_nvram_write_data(page, pos, (zb_uint8_t*)&hdr, sizeof(hdr));
+    if (ret == RET_OK && hdr.len > 0) {
+        ret = zb_nvram_write_data(page, pos + sizeof(hdr), snapshot, hdr.len);
+    }
+
+    return ret;
+}
+
+/* Called by the stack when the dataset is loaded on start. */
+static void snapshot_read(zb_uint8_t page, zb_uint32_t pos, zb_uint16_t payload_length) {
+    modbus_snapshot_nvram_t hdr;
+
+    if (payload_length < sizeof(hdr) || zb_nvram_read_data(page, pos, (zb_uint8_t*)&hdr, sizeof(hdr)) != RET_OK || payload_length != sizeof(hdr) + hdr.len || hdr.len > sizeof(snapshot)) {
+        LOG_WRN("Invalid snapshot dataset");
+        return;
+    }
+
+    if (hdr.len > 0 && (zb_nvram_read_data(page, pos + sizeof(hdr), snapshot, hdr.len) != RET_OK || !snapshot_validate(snapshot, hdr.len))) {
+        LOG_WRN("Stored snapshot not loaded");
+        return;
+    }
+
+    snapshot_len = hdr.len;
+    LOG_INF("Snapshot restored: %u bytes", snapshot_len);
+}
+
+static void snapshot_store(void) {
+    zb_ret_t ret = zb_nvram_write_dataset(ZB_NVRAM_APP_DATA2);
+
+    if (ret != RET_OK) {
+        LOG_ERR("Failed to store snapshot (ret: %d)", ret);
+    }
+}
+
+static zb_uint8_t* put_resp_hdr(zb_bufid_t bufid, zb_uint8_t seq_number, zb_uint8_t op, int16_t err, zb_uint16_t offset) {
+    zb_uint8_t* ptr = ZB_ZCL_START_PACKET(bufid);
+
+    ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(ptr);
+    ZB_ZCL_CONSTRUCT_COMMAND_HEADER(ptr, seq_number, ZB_ZCL_CMD_MODBUS_SNAPSHOT_RESP_ID);
+    ptr[0] = op;
+    modbus_frame_put_le16(&ptr[1], (uint16_t)err);
+    modbus_frame_put_le16(&ptr[3], offset);
+    modbus_frame_put_le16(&ptr[5], snapshot_len);
+
+    return ptr + ZB_ZCL_MODBUS_SNAPSHOT_RESP_HDR_LEN;
+}
+
+static void job_result_tx(zb_bufid_t bufid, zb_uint16_t param) {
+    zb_uint8_t* ptr;
+
+    ZVUNUSED(param);
+
+    ptr = put_resp_hdr(bufid, job.addr.seq_number, job.op, job.err, job.fail_addr);
+    ZB_ZCL_FINISH_PACKET(bufid, ptr)
+    zb_zcl_modbus_send_fragmented(bufid, &job.addr);
+
+    job.phase = PHASE_IDLE;
+}
+
+static void job_result_send(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    if (zb_buf_get_out_delayed_ext(job_result_tx, 0, ZB_ZCL_MODBUS_ZCL_HDR_LEN + ZB_ZCL_MODBUS_SNAPSHOT_RESP_HDR_LEN) != RET_OK) {
+        ZB_SCHEDULE_APP_ALARM(job_result_send, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_ZCL_MODBUS_RETRY_DELAY_MS));
+    }
+}
+
+static void job_end(int err, uint16_t fail_addr) {
+    if (err) {
+        LOG_WRN("Snapshot %s of slave %u failed at register 0x%04x (err: %d)", (job.op == ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE) ? "capture" : "restore", job.slave_id, fail_addr, err);
+    } else {
+        LOG_INF("Snapshot %s of slave %u complete: %u registers", (job.op == ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE) ? "capture" : "restore", job.slave_id, job.nb_regs);
+    }
+
+    job.phase     = PHASE_RESULT;
+    job.err       = (int16_t)err;
+    job.fail_addr = err ? fail_addr : 0;
+    job_result_send(0);
+}
+
+/* Select the next range of consecutive writable registers of the register map, returns false past the last one. */
+static bool capture_next_range(const struct modbus_regmap* map) {
+    uint16_t i = job.entry;
+
+    while (i < map->count && !reg_writable(&map->regs[i])) {
+        i++;
+    }
+    if (i == map->count) {
+        return false;
+    }
+
+    job.range_addr = map->regs[i].addr;
+    job.range_len  = 0;
+    while (i < map->count && reg_writable(&map->regs[i]) && map->regs[i].addr == job.range_addr + job.range_len && job.range_len + MODBUS_REG_TYPE_WORDS(map->regs[i].type) <= MODBUS_SNAPSHOT_RANGE_MAX) {
+        job.range_len += MODBUS_REG_TYPE_WORDS(map->regs[i].type);
+        i++;
+    }
+    job.entry = i;
+
+    return true;
+}
+
+static int capture_append(void) {
+    uint16_t len = RANGE_HDR_LEN + 2 * job.range_len;
+
+    if (staging_len + len > sizeof(staging)) {
+        return -EFBIG;
+    }
+
+    modbus_frame_put_le16(&staging[staging_len], job.range_addr);
+    staging[staging_len + 2] = job.range_len;
+    for (uint8_t i = 0; i < job.range_len; i++) {
+        modbus_frame_put_le16(&staging[staging_len + RANGE_HDR_LEN + 2 * i], read_regs[i]);
+    }
+    staging_len += len;
+    job.nb_regs += job.range_len;
+
+    return 0;
+}
+
+static void capture_finish(void) {
+    staging[0] = MODBUS_SNAPSHOT_VERSION;
+    staging[1] = job.slave_id;
+    modbus_frame_put_le16(&staging[2], job.nb_regs);
+    modbus_frame_put_le16(&staging[4], crc16_ccitt(CRC_SEED, &staging[MODBUS_SNAPSHOT_HDR_LEN], staging_len - MODBUS_SNAPSHOT_HDR_LEN));
+
+    memcpy(snapshot, staging, staging_len);
+    snapshot_len = staging_len;
+    staging_len  = 0;
+    snapshot_store();
+
+    job_end(0, 0);
+}
+
+/* Load the range of the snapshot at job.pos into the write buffer. */
+static void restore_load_range(void) {
+    const uint8_t* range = &snapshot[job.pos];
+
+    job.range_addr = modbus_frame_get_le16(&range[0]);
+    job.range_len  = range[2];
+    for (uint8_t i = 0; i < job.range_len; i++) {
+        write_regs[i] = modbus_frame_get_le16(&range[RANGE_HDR_LEN + 2 * i]);
+    }
+    job.pos += RANGE_HDR_LEN + 2 * job.range_len;
+}
+
+/**@brief Called in the Zigbee stack context when a snapshot transaction is finished.
+ *
+ * @param  idx  Index of the Modbus client queue item.
+ */
+static void job_done(zb_uint8_t idx) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_get(idx);
+    int                           err  = item->resp.err;
+    int                           ret;
+
+    modbus_client_free(item);
+
+    if (err) {
+        job_end(err, job.range_addr);
+        return;
+    }
+
+    switch (job.phase) {
+    case PHASE_READ:
+        ret = capture_append();
+        if (ret) {
+            job_end(ret, job.range_addr);
+        } else if (capture_next_range(modbus_regmap_get(job.slave_id))) {
+            job_submit(0);
+        } else {
+            capture_finish();
+        }
+        break;
+
+    case PHASE_WRITE:
+        job.phase = PHASE_VERIFY;
+        job_submit(0);
+        break;
+
+    case PHASE_VERIFY:
+        for (uint8_t i = 0; i < job.range_len; i++) {
+            if (read_regs[i] != write_regs[i]) {
+                job_end(-EIO, job.range_addr + i);
+                return;
+            }
+        }
+        job.nb_regs += job.range_len;
+        if (job.pos < snapshot_len) {
+            restore_load_range();
+            job.phase = PHASE_WRITE;
+            job_submit(0);
+        } else {
+            job_end(0, 0);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+/* Queue the transaction of the current phase on the current range. */
+static void job_submit(zb_uint8_t param) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_alloc();
+
+    ZVUNUSED(param);
+
+    if (item == NULL) {
+        ZB_SCHEDULE_APP_ALARM(job_submit, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_ZCL_MODBUS_RETRY_DELAY_MS));
+        return;
+    }
+
+    item->cb            = job_done;
+    item->resp.slave_id = job.slave_id;
+    item->resp.addr     = job.range_addr;
+    item->resp.nb_regs  = job.range_len;
+    if (job.phase == PHASE_WRITE) {
+        item->resp.fc = MODBUS_FC_WRITE_HOLDING_REGS;
+        item->regs    = write_regs;
+    } else {
+        item->resp.fc = MODBUS_FC_READ_HOLDING_REGS;
+        item->regs    = read_regs;
+    }
+
+    if (modbus_client_submit(item) != 0) {
+        modbus_client_free(item);
+        job_end(-ENODEV, job.range_addr);
+    }
+}
+
+static void job_start(const zb_zcl_modbus_addr_t* addr, zb_uint8_t op, zb_uint8_t slave_id) {
+    job.op       = op;
+    job.addr     = *addr;
+    job.slave_id = slave_id;
+    job.nb_regs  = 0;
+    job.err      = 0;
+}
+
+int modbus_snapshot_capture(const zb_zcl_modbus_addr_t* addr, zb_uint8_t slave_id) {
+    const struct modbus_regmap* map = modbus_regmap_get(slave_id);
+
+    if (job.phase != PHASE_IDLE) {
+        return -EBUSY;
+    }
+    if (map == NULL) {
+        return -ENOENT;
+    }
+
+    job_start(addr, ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE, slave_id);
+    job.entry = 0;
+    if (!capture_next_range(map)) {
+        return -ENOENT;
+    }
+
+    /* An import in progress is dropped, the header is filled in at the end. */
+    staging_len = MODBUS_SNAPSHOT_HDR_LEN;
+    job.phase   = PHASE_READ;
+    job_submit(0);
+
+    return 0;
+}
+
+int modbus_snapshot_restore(const zb_zcl_modbus_addr_t* addr, zb_uint8_t slave_id) {
+    const struct modbus_regmap* map = modbus_regmap_get(slave_id);
+
+    if (job.phase != PHASE_IDLE) {
+        return -EBUSY;
+    }
+    if (snapshot_len == 0) {
+        return -ENOENT;
+    }
+
+    /* Reject a snapshot of another slave type before anything is written. */
+    for (uint16_t pos = MODBUS_SNAPSHOT_HDR_LEN; map != NULL && pos < snapshot_len; pos += RANGE_HDR_LEN + 2 * snapshot[pos + 2]) {
+        if (modbus_regmap_validate(map, MODBUS_FC_WRITE_HOLDING_REGS, modbus_frame_get_le16(&snapshot[pos]), snapshot[pos + 2]) < 0) {
+            return -EINVAL;
+        }
+    }
+
+    job_start(addr, ZB_ZCL_MODBUS_SNAPSHOT_RESTORE, slave_id);
+    job.pos = MODBUS_SNAPSHOT_HDR_LEN;
+    restore_load_range();
+    job.phase = PHASE_WRITE;
+    job_submit(0);
+
+    return 0;
+}
+
+static void export_tx(zb_bufid_t bufid, zb_uint16_t param) {
+    zb_uint16_t len;
+    zb_uint8_t* ptr;
+
+    ZVUNUSED(param);
+
+    export_pending = false;
+    if (export_offset >= snapshot_len) {
+        /* The snapshot was replaced by a shorter one in the meantime. */
+        zb_buf_free(bufid);
+        return;
+    }
+
+    len = MIN(CONFIG_APP_MODBUS_SNAPSHOT_EXPORT_CHUNK, snapshot_len - export_offset);
+    ptr = put_resp_hdr(bufid, export_addr.seq_number, ZB_ZCL_MODBUS_SNAPSHOT_EXPORT, 0, export_offset);
+    ZB_ZCL_PACKET_PUT_DATA_N(ptr, &snapshot[export_offset], len);
+    ZB_ZCL_FINISH_PACKET(bufid, ptr)
+    zb_zcl_modbus_send_fragmented(bufid, &export_addr);
+}
+
+int modbus_snapshot_export(const zb_zcl_modbus_addr_t* addr, zb_uint16_t offset) {
+    if (export_pending) {
+        return -EBUSY;
+    }
+    if (snapshot_len == 0) {
+        return -ENOENT;
+    }
+    if (offset >= snapshot_len) {
+        return -EINVAL;
+    }
+
+    if (zb_buf_get_out_delayed_ext(export_tx, 0, ZB_ZCL_MODBUS_ZCL_HDR_LEN + ZB_ZCL_MODBUS_SNAPSHOT_RESP_HDR_LEN + CONFIG_APP_MODBUS_SNAPSHOT_EXPORT_CHUNK) != RET_OK) {
+        return -EBUSY;
+    }
+
+    export_pending = true;
+    export_addr    = *addr;
+    export_offset  = offset;
+    return 0;
+}
+
+int modbus_snapshot_import(zb_uint16_t offset, zb_uint16_t total, const zb_uint8_t* data, zb_uint16_t len) {
+    if (job.phase != PHASE_IDLE) {
+        return -EBUSY;
+    }
+    if (total > sizeof(staging)) {
+        return -EFBIG;
+    }
+
+    if (total == 0) {
+        snapshot_len = 0;
+        staging_len  = 0;
+        snapshot_store();
+        LOG_INF("Snapshot removed");
+        return 0;
+    }
+
+    /* A chunk at offset 0 restarts the import. */
+    if (offset == 0) {
+        staging_len   = 0;
+        staging_total = total;
+    }
+    if (offset != staging_len || total != staging_total || (uint32_t)offset + len > total) {
+        return -EINVAL;
+    }
+
+    memcpy(&staging[offset], data, len);
+    staging_len += len;
+
+    if (staging_len < total) {
+        return 0;
+    }
+
+    staging_len = 0;
+    if (!snapshot_validate(staging, total)) {
+        return -EINVAL;
+    }
+
+    memcpy(snapshot, staging, total);
+    snapshot_len = total;
+    snapshot_store();
+
+    LOG_INF("Snapshot imported: %u bytes", snapshot_len);
+    return 0;
+}
+
+void modbus_snapshot_init(void) {
+    zb_nvram_register_app2_read_cb(snapshot_read);
+    zb_nvram_register_app2_write_cb(snapshot_write, snapshot_get_size);
+}
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "modbus_client.h"
+#include "modbus_frame.h"
+#include "modbus_regmap.h"
+#include "modbus_stream.h"
+
+LOG_MODULE_REGISTER(modbus_stream, LOG_LEVEL_INF);
+
+#define CHUNK_REGS CONFIG_APP_MODBUS_STREAM_CHUNK_REGS
+#define WINDOW     CONFIG_APP_MODBUS_STREAM_WINDOW
+
+#define DATA_FRAME_LEN (ZB_ZCL_MODBUS_ZCL_HDR_LEN + ZB_ZCL_MODBUS_STREAM_DATA_HDR_LEN + 2 * CHUNK_REGS)
+
+/* Repeated acknowledgements of the same register before the chunks after it are sent again */
+#define DUP_ACK_THRESHOLD 2
+
+/* Chunk read from the bus and kept until it is acknowledged */
+struct stream_chunk {
+    int16_t  err;
+    uint8_t  nb_regs;
+    uint16_t regs[CHUNK_REGS];
+};
+
+static struct {
+    bool                 active;
+    zb_zcl_modbus_addr_t addr;
+    uint8_t              fc;
+    uint8_t              slave_id;
+    uint8_t              window;
+    uint8_t              retries;
+    uint8_t              dup_acks;  /* Repeated acknowledgements of acked */
+    bool                 rewound;   /* Sent again from acked since it was acknowledged, at most once */
+    uint16_t             serial;    /* Incremented per transfer, completions of a replaced transfer are dropped */
+    uint32_t             start;     /* Register range, end excluded */
+    uint32_t             end;
+    uint32_t             acked;     /* First register not acknowledged */
+    uint32_t             read_next; /* First register not read */
+    uint32_t             tx_next;   /* First register not sent, goes back to acked to send chunks again */
+    uint32_t             sent_max;  /* First register never sent */
+    bool                 failed;    /* A chunk ended with an error, nothing is read after it */
+} stream;
+
+/* A bus read or a buffer request in flight, and the transfer it belongs to. They survive the transfer being replaced. */
+static bool     reading;
+static uint16_t read_serial;
+static bool     sending;
+
+static struct stream_chunk chunks[WINDOW];
+
+static void stream_pump(void);
+
+static struct stream_chunk* chunk_at(uint32_t reg) {
+    return &chunks[((reg - stream.start) / CHUNK_REGS) % WINDOW];
+}
+
+static uint8_t chunk_len(uint32_t reg) {
+    return (uint8_t)MIN(CHUNK_REGS, stream.end - reg);
+}
+
+static void stream_retry(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    stream_pump();
+}
+
+static void stream_timeout(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    if (!stream.active) {
+        return;
+    }
+
+    /* Only a silence with chunks outstanding counts, not a slow bus. */
+    if (stream.tx_next > stream.acked) {
+        if (++stream.retries > CONFIG_APP_MODBUS_STREAM_RETRIES) {
+            LOG_WRN("Stream to 0x%04x aborted at register %u", stream.addr.src_addr, stream.acked);
+            stream.active = false;
+            return;
+        }
+        /* Go back to the first chunk not acknowledged. */
+        stream.tx_next = stream.acked;
+        stream.rewound = true;
+    }
+
+    ZB_SCHEDULE_APP_ALARM(stream_timeout, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_MODBUS_STREAM_ACK_TIMEOUT_MS));
+    stream_pump();
+}
+
+static void stream_timer_restart(void) {
+    ZB_SCHEDULE_APP_ALARM_CANCEL(stream_timeout, ZB_ALARM_ANY_PARAM);
+    ZB_SCHEDULE_APP_ALARM(stream_timeout, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_MODBUS_STREAM_ACK_TIMEOUT_MS));
+}
+
+static void stream_stop(void) {
+    stream.active = false;
+    ZB_SCHEDULE_APP_ALARM_CANCEL(stream_timeout, ZB_ALARM_ANY_PARAM);
+    ZB_SCHEDULE_APP_ALARM_CANCEL(stream_retry, ZB_ALARM_ANY_PARAM);
+}
+
+static void stream_read_done(zb_uint8_t idx) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_get(idx);
+
+    reading = false;
+    if (stream.active && read_serial == stream.serial) {
+        struct stream_chunk* chunk = chunk_at(stream.read_next);
+
+        chunk->err       = item->resp.err;
+        chunk->nb_regs   = (item->resp.err == 0) ? item->resp.nb_regs : 0;
+        stream.failed    = (item->resp.err != 0);
+        stream.read_next += chunk_len(stream.read_next);
+    }
+
+    modbus_client_free(item);
+    stream_pump();
+}
+
+/* Read the next chunk, as long as it does not overwrite a chunk that is not acknowledged. */
+static void stream_read(void) {
+    modbus_cmd_resp_queue_data_t* item;
+    struct stream_chunk*          chunk;
+
+    if (reading || stream.failed || stream.read_next >= stream.end || stream.read_next >= stream.acked + (uint32_t)stream.window * CHUNK_REGS) {
+        return;
+    }
+
+    item = modbus_client_alloc();
+    if (item == NULL) {
+        ZB_SCHEDULE_APP_ALARM(stream_retry, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_ZCL_MODBUS_RETRY_DELAY_MS));
+        return;
+    }
+
+    chunk               = chunk_at(stream.read_next);
+    item->cb            = stream_read_done;
+    item->regs          = chunk->regs;
+    item->resp.fc       = stream.fc;
+    item->resp.slave_id = stream.slave_id;
+    item->resp.addr     = (uint16_t)stream.read_next;
+    item->resp.nb_regs  = chunk_len(stream.read_next);
+
+    if (modbus_client_submit(item) != 0) {
+        modbus_client_free(item);
+        chunk->err       = -ENODEV;
+        chunk->nb_regs   = 0;
+        stream.failed    = true;
+        stream.read_next += chunk_len(stream.read_next);
+        return;
+    }
+
+    reading     = true;
+    read_serial = stream.serial;
+}
+
+static void stream_tx(zb_bufid_t bufid, zb_uint16_t serial) {
+    struct stream_chunk* chunk;
+    zb_uint8_t*          ptr;
+
+    sending = false;
+    if (!stream.active || serial != stream.serial || stream.tx_next >= stream.read_next) {
+        zb_buf_free(bufid);
+        stream_pump();
+        return;
+    }
+
+    chunk = chunk_at(stream.tx_next);
+    ptr   = ZB_ZCL_START_PACKET(bufid);
+    ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(ptr);
+    ZB_ZCL_CONSTRUCT_COMMAND_HEADER(ptr, ZB_ZCL_GET_SEQ_NUM(), ZB_ZCL_CMD_MODBUS_STREAM_DATA_ID);
+    *ptr++ = stream.addr.seq_number;
+    *ptr++ = stream.fc;
+    *ptr++ = stream.slave_id;
+    modbus_frame_put_le16(&ptr[0], (zb_uint16_t)stream.tx_next);
+    modbus_frame_put_le16(&ptr[2], (zb_uint16_t)chunk->err);
+    ptr    += 4;
+    *ptr++ = chunk->nb_regs;
+    for (uint8_t i = 0; i < chunk->nb_regs; i++) {
+        modbus_frame_put_le16(ptr, chunk->regs[i]);
+        ptr += 2;
+    }
+    ZB_ZCL_FINISH_PACKET(bufid, ptr)
+    zb_zcl_modbus_send_fragmented(bufid, &stream.addr);
+
+    /* The chunk of a failed read is the last one sent. */
+    if (chunk->err != 0) {
+        LOG_WRN("Stream to 0x%04x failed at register %u (err: %d)", stream.addr.src_addr, stream.tx_next, chunk->err);
+        stream_stop();
+        return;
+    }
+    stream.tx_next  += chunk_len(stream.tx_next);
+    stream.sent_max = MAX(stream.sent_max, stream.tx_next);
+
+    stream_timer_restart();
+    stream_pump();
+}
+
+static void stream_send(void) {
+    if (sending || stream.tx_next >= stream.read_next) {
+        return;
+    }
+
+    if (zb_buf_get_out_delayed_ext(stream_tx, stream.serial, DATA_FRAME_LEN) != RET_OK) {
+        ZB_SCHEDULE_APP_ALARM(stream_retry, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_ZCL_MODBUS_RETRY_DELAY_MS));
+        return;
+    }
+    sending = true;
+}
+
+static void stream_pump(void) {
+    if (stream.active) {
+        stream_read();
+        stream_send();
+    }
+}
+
+static bool stream_owner(const zb_zcl_modbus_addr_t* addr) {
+    return stream.addr.src_addr == addr->src_addr && stream.addr.src_endpoint == addr->src_endpoint;
+}
+
+int modbus_stream_start(const zb_zcl_modbus_addr_t* addr, zb_uint8_t fc, zb_uint8_t slave_id, zb_uint16_t start, zb_uint16_t count, zb_uint8_t window) {
+    const struct modbus_regmap* map = modbus_regmap_get(slave_id);
+
+    if (stream.active && !stream_owner(addr)) {
+        return -EBUSY;
+    }
+    /* The range may not reach 0xFFFF, so that its end fits in an acknowledgement. */
+    if ((fc != MODBUS_FC_READ_HOLDING_REGS && fc != MODBUS_FC_READ_INPUT_REGS) || count == 0 || (uint32_t)start + count > UINT16_MAX || window == 0) {
+        return -EINVAL;
+    }
+    if (map != NULL && modbus_regmap_validate(map, fc, start, count) < 0) {
+        return -EINVAL;
+    }
+
+    stream_stop();
+    stream.active    = true;
+    stream.addr      = *addr;
+    stream.fc        = fc;
+    stream.slave_id  = slave_id;
+    stream.window    = MIN(window, WINDOW);
+    stream.retries   = 0;
+    stream.dup_acks  = 0;
+    stream.rewound   = false;
+    stream.start     = start;
+    stream.end       = (uint32_t)start + count;
+    stream.acked     = start;
+    stream.read_next = start;
+    stream.tx_next   = start;
+    stream.sent_max  = start;
+    stream.failed    = false;
+    stream.serial++;
+
+    LOG_INF("Stream of %u registers of slave %u to 0x%04x", count, slave_id, addr->src_addr);
+
+    stream_timer_restart();
+    stream_pump();
+    return 0;
+}
+
+int modbus_stream_ack(const zb_zcl_modbus_addr_t* addr, zb_uint8_t transfer_id, zb_uint16_t next) {
+    if (!stream.active || !stream_owner(addr) || transfer_id != stream.addr.seq_number) {
+        return -ENOENT;
+    }
+    /* Chunks sent before a go-back may still be acknowledged. */
+    if (next < stream.acked || next > stream.sent_max || (next != stream.end && (next - stream.start) % CHUNK_REGS != 0)) {
+        return -EINVAL;
+    }
+
+    if (next == stream.acked) {
+        /* Repeated acknowledgement: the chunk after it was lost, unless it answers chunks already sent again. */
+        if (!stream.rewound && ++stream.dup_acks >= DUP_ACK_THRESHOLD) {
+            stream.tx_next = stream.acked;
+            stream.rewound = true;
+        }
+    } else {
+        stream.acked    = next;
+        stream.tx_next  = MAX(stream.tx_next, next);
+        stream.retries  = 0;
+        stream.dup_acks = 0;
+        stream.rewound  = false;
+    }
+
+    if (stream.acked == stream.end) {
+        LOG_INF("Stream to 0x%04x complete", stream.addr.src_addr);
+        stream_stop();
+        return 0;
+    }
+
+    stream_timer_restart();
+    stream_pump();
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <stdlib.h>
+
+#include "modbus_regmap.h"
+#include "modbus_timing.h"
+
+/* Request and response frames of a transaction [bytes]: slave ID, function code, data and CRC */
+static uint32_t frame_bytes(uint8_t fc, uint16_t nb_regs) {
+    switch (fc) {
+    case MODBUS_FC_READ_HOLDING_REGS:
+    case MODBUS_FC_READ_INPUT_REGS:
+        return 8 + 5 + 2 * (uint32_t)nb_regs;
+    case MODBUS_FC_WRITE_HOLDING_REGS:
+        return 9 + 2 * (uint32_t)nb_regs + 8;
+    case MODBUS_FC_WRITE_HOLDING_REG:
+    default:
+        return 8 + 8;
+    }
+}
+
+uint32_t modbus_timing_line_ms(uint8_t fc, uint16_t nb_regs, uint32_t bps) {
+    /* In half characters, for the silent interval of 3.5 characters after each frame */
+    uint32_t halves = 2 * frame_bytes(fc, nb_regs) + 2 * 7;
+
+    return (halves * MODBUS_TIMING_CHAR_BITS * 1000 + 2 * bps - 1) / (2 * bps);
+}
+
+void modbus_timing_sample(struct modbus_timing* timing, uint32_t elapsed_ms, uint32_t line_ms) {
+    uint32_t rtt = (elapsed_ms > line_ms) ? elapsed_ms - line_ms : 0;
+
+    if (!timing->answered) {
+        timing->srtt8    = rtt * 8;
+        timing->rttvar4  = rtt * 2;
+        timing->answered = true;
+    } else {
+        timing->rttvar4 += (uint32_t)abs((int32_t)rtt - (int32_t)(timing->srtt8 / 8)) - timing->rttvar4 / 4;
+        timing->srtt8 += rtt - timing->srtt8 / 8;
+    }
+}
+
+uint32_t modbus_timing_timeout(const struct modbus_timing* timing, uint8_t backoff, uint32_t line_ms, uint32_t min_ms, uint32_t max_ms) {
+    uint32_t timeout = max_ms;
+
+    if (timing->answered) {
+        timeout = timing->srtt8 / 8 + timing->rttvar4;
+        timeout = (timeout < min_ms) ? min_ms : (timeout > max_ms) ? max_ms : timeout;
+    }
+    timeout <<= backoff;
+
+    return ((timeout < max_ms) ? timeout : max_ms) + line_ms;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+
+#include <zboss_api.h>
+
+#include "relay_stats.h"
+
+LOG_MODULE_REGISTER(relay_stats, LOG_LEVEL_INF);
+
+static atomic_t stats[RELAY_STAT_COUNT];
+static bool     running;
+static uint32_t tick_count;
+static uint32_t drops_reported;
+
+static uint32_t drops_total(void) {
+    return relay_stats_get(RELAY_STAT_BUF_ALLOC_FAIL) + relay_stats_get(RELAY_STAT_NWK_RETRY_OVERFLOW) + relay_stats_get(RELAY_STAT_BCAST_TABLE_FULL) + relay_stats_get(RELAY_STAT_MAC_RX_DROP);
+}
+
+static void relay_stats_diag_cb(zb_uint8_t param) {
+    const zdo_diagnostics_full_stats_t* diag = zb_buf_begin(param);
+    uint32_t                            drops;
+
+    if (diag->status == RET_OK) {
+        atomic_set(&stats[RELAY_STAT_RELAYED], diag->zdo_stats.relayed_ucast);
+        atomic_set(&stats[RELAY_STAT_BUF_ALLOC_FAIL], diag->zdo_stats.packet_buffer_allocate_failures);
+        atomic_set(&stats[RELAY_STAT_NWK_RETRY_OVERFLOW], diag->zdo_stats.nwk_retry_overflow);
+        atomic_set(&stats[RELAY_STAT_BCAST_TABLE_FULL], diag->zdo_stats.nwk_bcast_table_full);
+        atomic_set(&stats[RELAY_STAT_MAC_TX_FAIL], diag->mac_stats.mac_tx_ucast_failures);
+        atomic_set(&stats[RELAY_STAT_MAC_RX_DROP], diag->mac_stats.mac_validate_drop_cnt + diag->mac_stats.phy_to_mac_que_lim_reached);
+
+        /* Only report when frames were lost since the last report. */
+        drops = drops_total();
+        if (drops != drops_reported) {
+            drops_reported = drops;
+            LOG_WRN("Relay drops: buffers %u (low %u s), retry queue %u, broadcast table %u, MAC RX %u", relay_stats_get(RELAY_STAT_BUF_ALLOC_FAIL), relay_stats_get(RELAY_STAT_BUF_LOW_S), relay_stats_get(RELAY_STAT_NWK_RETRY_OVERFLOW), relay_stats_get(RELAY_STAT_BCAST_TABLE_FULL), relay_stats_get(RELAY_STAT_MAC_RX_DROP));
+        }
+    }
+
+    zb_buf_free(param);
+}
+
+static void relay_stats_tick(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    if (zb_buf_memory_low()) {
+        atomic_inc(&stats[RELAY_STAT_BUF_LOW_S]);
+    }
+
+    if (++tick_count >= CONFIG_APP_RELAY_STATS_INTERVAL_S) {
+        tick_count = 0;
+        if (zdo_diagnostics_get_stats(relay_stats_diag_cb, ZB_PIB_ATTRIBUTE_IEEE_DIAGNOSTIC_INFO) != RET_OK) {
+            LOG_DBG("Diagnostics request not sent");
+        }
+    }
+
+    ZB_SCHEDULE_APP_ALARM(relay_stats_tick, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(MSEC_PER_SEC));
+}
+
+void relay_stats_start(void) {
+    if (!running) {
+        running = true;
+        relay_stats_tick(0);
+    }
+}
+
+uint32_t relay_stats_get(enum relay_stat stat) {
+    return stat < RELAY_STAT_COUNT ? (uint32_t)atomic_get(&stats[stat]) : 0;
+}
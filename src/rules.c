@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "app_log.h"
+#include "modbus_client.h"
+#include "modbus_regmap.h"
+#include "rules.h"
+#include "sample_log.h"
+
+LOG_MODULE_REGISTER(rules, LOG_LEVEL_INF);
+
+#define RULE_HDR_LEN 2
+
+struct rules_op_desc {
+    uint8_t args; /* Operand length */
+    uint8_t pops; /* Values taken from the stack */
+    uint8_t push; /* Values pushed on the stack */
+};
+
+static const struct rules_op_desc ops[RULES_OP_COUNT] = {
+    [RULES_OP_END] = {0, 0, 0},
+    [RULES_OP_PUSH8] = {1, 0, 1},
+    [RULES_OP_PUSH16] = {2, 0, 1},
+    [RULES_OP_BUTTON] = {1, 0, 1},
+    [RULES_OP_REG] = {2, 0, 1},
+    [RULES_OP_REG_S] = {2, 0, 1},
+    [RULES_OP_LOAD] = {1, 0, 1},
+    [RULES_OP_STORE] = {1, 1, 0},
+    [RULES_OP_DUP] = {0, 1, 2},
+    [RULES_OP_DROP] = {0, 1, 0},
+    [RULES_OP_ADD] = {0, 2, 1},
+    [RULES_OP_SUB] = {0, 2, 1},
+    [RULES_OP_LT] = {0, 2, 1},
+    [RULES_OP_GT] = {0, 2, 1},
+    [RULES_OP_EQ] = {0, 2, 1},
+    [RULES_OP_AND] = {0, 2, 1},
+    [RULES_OP_OR] = {0, 2, 1},
+    [RULES_OP_NOT] = {0, 1, 1},
+    [RULES_OP_JZ] = {1, 1, 0},
+    [RULES_OP_JMP] = {1, 0, 0},
+    [RULES_OP_WRITE] = {3, 1, 0},
+};
+
+/* Running program, and the one being downloaded. */
+static uint8_t  program[CONFIG_APP_RULES_MAX_SIZE];
+static uint16_t program_len;
+static uint8_t  staging[CONFIG_APP_RULES_MAX_SIZE];
+static uint16_t staging_len;
+static uint16_t staging_total;
+
+static int32_t  vars[RULES_VAR_COUNT];
+static uint8_t  buttons;
+static uint16_t reg_values[SAMPLE_LOG_MAX_ENTRIES][SAMPLE_LOG_MAX_REGS];
+
+static uint16_t get_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+/* Check that every instruction is known, its operands are within its rule and jumps land on an instruction or the end. */
+static bool rule_validate(const uint8_t* code, uint8_t len) {
+    uint8_t  starts[(UINT8_MAX + 1) / 8] = {0};
+    uint16_t pc                          = 0;
+
+    while (pc < len) {
+        uint8_t op = code[pc];
+
+        if (op >= RULES_OP_COUNT || pc + 1 + ops[op].args > len) {
+            return false;
+        }
+        if ((op == RULES_OP_LOAD || op == RULES_OP_STORE) && code[pc + 1] >= RULES_VAR_COUNT) {
+            return false;
+        }
+        if ((op == RULES_OP_REG || op == RULES_OP_REG_S) && (code[pc + 1] >= SAMPLE_LOG_MAX_ENTRIES || code[pc + 2] >= SAMPLE_LOG_MAX_REGS)) {
+            return false;
+        }
+        starts[pc / 8] |= BIT(pc % 8);
+        pc += 1 + ops[op].args;
+    }
+
+    for (pc = 0; pc < len; pc += 1 + ops[code[pc]].args) {
+        uint16_t target;
+
+        if (code[pc] != RULES_OP_JZ && code[pc] != RULES_OP_JMP) {
+            continue;
+        }
+        target = pc + 2 + code[pc + 1];
+        if (target != len && (target > len || !(starts[target / 8] & BIT(target % 8)))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool program_validate(const uint8_t* prog, uint16_t len) {
+    uint16_t pos = 0;
+
+    while (pos < len) {
+        if (pos + RULE_HDR_LEN > len || pos + RULE_HDR_LEN + prog[pos + 1] > len) {
+            return false;
+        }
+        if (!rule_validate(&prog[pos + RULE_HDR_LEN], prog[pos + 1])) {
+            return false;
+        }
+        pos += RULE_HDR_LEN + prog[pos + 1];
+    }
+
+    return true;
+}
+
+/**@brief Called in the Zigbee stack context when a rule write is finished.
+ *
+ * @param  idx  Index of the Modbus client queue item.
+ */
+static void rules_write_done(zb_uint8_t idx) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_get(idx);
+
+    if (item->resp.err != 0) {
+        APP_LOG_RATELIMIT(LOG_WRN, "Rule write to %u:0x%04x failed (err: %d)", item->resp.slave_id, item->resp.addr, item->resp.err);
+    }
+
+    modbus_client_free(item);
+}
+
+static void rules_write(uint8_t slave_id, uint16_t addr, int32_t value) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_alloc();
+
+    if (item == NULL) {
+        APP_LOG_RATELIMIT(LOG_WRN, "Queue full, rule write to %u:0x%04x dropped", slave_id, addr);
+        return;
+    }
+
+    item->cb            = rules_write_done;
+    item->resp.slave_id = slave_id;
+    item->resp.fc       = MODBUS_FC_WRITE_HOLDING_REG;
+    item->resp.addr     = addr;
+    item->resp.nb_regs  = 1;
+    item->resp.data[0]  = (uint16_t)value;
+
+    if (modbus_client_submit(item) != 0) {
+        modbus_client_free(item);
+    }
+}
+
+/* Run the code of a validated rule. Returns false if it was stopped on a stack error. */
+static bool rule_run(const uint8_t* code, uint8_t len) {
+    int32_t  stack[RULES_STACK_DEPTH];
+    int32_t  a  = 0;
+    int32_t  b  = 0;
+    uint8_t  sp = 0;
+    uint16_t pc = 0;
+
+    while (pc < len) {
+        const uint8_t* arg = &code[pc + 1];
+        uint8_t        op  = code[pc];
+
+        if (sp < ops[op].pops || sp - ops[op].pops + ops[op].push > RULES_STACK_DEPTH) {
+            return false;
+        }
+
+        pc += 1 + ops[op].args;
+        sp -= ops[op].pops;
+        if (ops[op].pops > 0) {
+            a = stack[sp];
+        }
+        if (ops[op].pops > 1) {
+            b = stack[sp + 1];
+        }
+
+        switch (op) {
+        case RULES_OP_END:
+            return true;
+        case RULES_OP_PUSH8:
+            stack[sp++] = (int8_t)arg[0];
+            break;
+        case RULES_OP_PUSH16:
+            stack[sp++] = (int16_t)get_u16(arg);
+            break;
+        case RULES_OP_BUTTON:
+            stack[sp++] = (buttons >> (arg[0] & 7)) & 1;
+            break;
+        case RULES_OP_REG:
+            stack[sp++] = reg_values[arg[0]][arg[1]];
+            break;
+        case RULES_OP_REG_S:
+            stack[sp++] = (int16_t)reg_values[arg[0]][arg[1]];
+            break;
+        case RULES_OP_LOAD:
+            stack[sp++] = vars[arg[0]];
+            break;
+        case RULES_OP_STORE:
+            vars[arg[0]] = a;
+            break;
+        case RULES_OP_DUP:
+            stack[sp++] = a;
+            stack[sp++] = a;
+            break;
+        case RULES_OP_DROP:
+            break;
+        case RULES_OP_ADD:
+            stack[sp++] = a + b;
+            break;
+        case RULES_OP_SUB:
+            stack[sp++] = a - b;
+            break;
+        case RULES_OP_LT:
+            stack[sp++] = a < b;
+            break;
+        case RULES_OP_GT:
+            stack[sp++] = a > b;
+            break;
+        case RULES_OP_EQ:
+            stack[sp++] = a == b;
+            break;
+        case RULES_OP_AND:
+            stack[sp++] = a && b;
+            break;
+        case RULES_OP_OR:
+            stack[sp++] = a || b;
+            break;
+        case RULES_OP_NOT:
+            stack[sp++] = !a;
+            break;
+        case RULES_OP_JZ:
+            if (a == 0) {
+                pc += arg[0];
+            }
+            break;
+        case RULES_OP_JMP:
+            pc += arg[0];
+            break;
+        case RULES_OP_WRITE:
+            rules_write(arg[0], get_u16(&arg[1]), a);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return true;
+}
+
+static void rules_run(uint8_t trigger) {
+    uint16_t pos = 0;
+
+    while (pos < program_len) {
+        uint8_t len = program[pos + 1];
+
+        if (program[pos] == trigger && !rule_run(&program[pos + RULE_HDR_LEN], len)) {
+            APP_LOG_RATELIMIT(LOG_WRN, "Rule at %u stopped on a stack error", pos);
+        }
+        pos += RULE_HDR_LEN + len;
+    }
+}
+
+int rules_download(uint16_t offset, uint16_t total, const uint8_t* data, uint8_t len) {
+    if (total > sizeof(program)) {
+        return -EFBIG;
+    }
+
+    if (total == 0) {
+        program_len = 0;
+        staging_len = 0;
+        LOG_INF("Rules removed");
+        return 0;
+    }
+
+    /* A chunk at offset 0 restarts the download. */
+    if (offset == 0) {
+        staging_len   = 0;
+        staging_total = total;
+    }
+    if (offset != staging_len || total != staging_total || offset + len > total) {
+        return -EINVAL;
+    }
+
+    memcpy(&staging[offset], data, len);
+    staging_len += len;
+
+    if (staging_len < total) {
+        return 0;
+    }
+
+    staging_len = 0;
+    if (!program_validate(staging, total)) {
+        return -EINVAL;
+    }
+
+    memcpy(program, staging, total);
+    program_len = total;
+    memset(vars, 0, sizeof(vars));
+
+    LOG_INF("Rules loaded: %u bytes", program_len);
+    return 0;
+}
+
+const uint8_t* rules_get(uint16_t* len) {
+    *len = program_len;
+    return program;
+}
+
+void rules_buttons_changed(uint8_t button_state) {
+    buttons = button_state;
+    rules_run(RULES_TRIGGER_BUTTONS);
+}
+
+void rules_poll_result(uint8_t entry, const uint16_t* values, uint8_t nb_regs) {
+    if (entry >= SAMPLE_LOG_MAX_ENTRIES || nb_regs > SAMPLE_LOG_MAX_REGS) {
+        return;
+    }
+
+    memcpy(reg_values[entry], values, nb_regs * sizeof(values[0]));
+    rules_run(entry);
+}
@@ -0,0 +1,387 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <string.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/util.h>
+
+#include <zboss_api.h>
+
+#include "sample_log.h"
+#include "varint.h"
+#include "zb_zcl_modbus.h"
+
+LOG_MODULE_REGISTER(sample_log, LOG_LEVEL_INF);
+
+#define SAMPLE_LOG_MAGIC   0x534C4F47
+#define SAMPLE_LOG_VERSION 1
+
+#define SAMPLE_LOG_MAX_SECTORS 8
+
+/* A batch and its frame header fit in one Modbus cluster data packet. */
+#define SAMPLE_LOG_BATCH_SIZE (ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - SAMPLE_LOG_FRAME_HDR_LEN)
+
+#define SAMPLE_LOG_MAX_RECORD_LEN (VARINT_MAX_LEN + 2 + SAMPLE_LOG_MAX_REGS * 3)
+
+/* Entry appended when the backlog has been sent, shorter than any batch: the entries before it are not sent again after a reset. */
+#define SAMPLE_LOG_CURSOR_LEN 1
+
+static struct fcb         fcb;
+static struct flash_sector sectors[SAMPLE_LOG_MAX_SECTORS];
+
+static uint8_t  log_endpoint;
+static uint8_t  boot_id;
+static bool     joined;
+static bool     draining;
+static uint32_t backlog;
+/* Last entry sent from flash, fe_sector is NULL if none */
+static struct fcb_entry drain_loc;
+/* A cursor entry follows drain_loc */
+static bool drain_saved;
+
+static uint8_t  batch[ROUND_UP(SAMPLE_LOG_BATCH_SIZE, 8)];
+static uint8_t  batch_len;
+static uint32_t batch_last_time;
+static uint16_t batch_prev[SAMPLE_LOG_MAX_ENTRIES][SAMPLE_LOG_MAX_REGS];
+
+/* Batch waiting for a buffer, tx_len is 0 if none */
+static uint8_t tx_frame[SAMPLE_LOG_BATCH_SIZE];
+static uint8_t tx_len;
+
+static void sample_log_drain(zb_uint8_t param);
+
+static uint32_t uptime_s(void) {
+    return (uint32_t)(k_uptime_get() / MSEC_PER_SEC);
+}
+
+static void put_u32(uint8_t* out, uint32_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+    out[2] = (uint8_t)(value >> 16);
+    out[3] = (uint8_t)(value >> 24);
+}
+
+/* Count the batches after loc and get the boot counter of the last one. */
+static uint32_t log_count(struct fcb_entry loc, uint8_t* last_boot) {
+    uint32_t count = 0;
+
+    while (fcb_getnext(&fcb, &loc) == 0) {
+        if (loc.fe_data_len == SAMPLE_LOG_CURSOR_LEN) {
+            continue;
+        }
+        if (last_boot != NULL) {
+            flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), last_boot, 1);
+        }
+        count++;
+    }
+
+    return count;
+}
+
+/* Find the last cursor entry, fe_sector is NULL if none. */
+static struct fcb_entry log_find_cursor(void) {
+    struct fcb_entry loc    = {0};
+    struct fcb_entry cursor = {0};
+
+    while (fcb_getnext(&fcb, &loc) == 0) {
+        if (loc.fe_data_len == SAMPLE_LOG_CURSOR_LEN) {
+            cursor = loc;
+        }
+    }
+
+    return cursor;
+}
+
+/* The log is full: drop the oldest sector, with the batches in it that were not sent. */
+static void log_make_room(void) {
+    bool drain_lost = (drain_loc.fe_sector == NULL || drain_loc.fe_sector == fcb.f_oldest);
+
+    if (backlog != 0 && drain_lost) {
+        LOG_WRN("Sample log full, dropping oldest samples");
+    }
+    fcb_rotate(&fcb);
+
+    if (drain_lost) {
+        memset(&drain_loc, 0, sizeof(drain_loc));
+        drain_saved = false;
+        backlog     = log_count(drain_loc, NULL);
+    }
+}
+
+static int log_write(const uint8_t* data, uint8_t len, struct fcb_entry* loc) {
+    int err;
+
+    err = fcb_append(&fcb, len, loc);
+    if (err == -ENOSPC) {
+        log_make_room();
+        err = fcb_append(&fcb, len, loc);
+    }
+    if (err) {
+        return err;
+    }
+
+    /* The flash is written in whole write blocks, data is the padded batch buffer. */
+    err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(*loc), data, ROUND_UP(len, fcb.f_align));
+    if (err) {
+        return err;
+    }
+
+    return fcb_append_finish(&fcb, loc);
+}
+
+static int log_append(const uint8_t* data, uint8_t len) {
+    struct fcb_entry loc;
+    int              err;
+
+    err = log_write(data, len, &loc);
+    if (err) {
+        return err;
+    }
+
+    backlog++;
+    return 0;
+}
+
+static void sample_log_tx(zb_bufid_t bufid) {
+    zb_uint8_t* cmd_ptr = ZB_ZCL_START_PACKET(bufid);
+    zb_uint8_t  hdr[SAMPLE_LOG_FRAME_HDR_LEN];
+
+    hdr[0] = boot_id;
+    put_u32(&hdr[1], uptime_s());
+
+    ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(cmd_ptr);
+    ZB_ZCL_CONSTRUCT_COMMAND_HEADER(cmd_ptr, ZB_ZCL_GET_SEQ_NUM(), ZB_ZCL_CMD_MODBUS_SAMPLE_LOG_ID);
+    ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, sizeof(hdr) + tx_len);
+    ZB_ZCL_PACKET_PUT_DATA_N(cmd_ptr, hdr, sizeof(hdr));
+    ZB_ZCL_PACKET_PUT_DATA_N(cmd_ptr, tx_frame, tx_len);
+    ZB_ZCL_FINISH_PACKET(bufid, cmd_ptr)
+    /* Sent to the bound collectors. */
+    ZB_ZCL_SEND_COMMAND_SHORT(bufid, 0, ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT, 0, log_endpoint, ZB_AF_HA_PROFILE_ID, ZB_ZCL_CLUSTER_ID_MODBUS, NULL);
+
+    tx_len = 0;
+
+    if (draining) {
+        ZB_SCHEDULE_APP_ALARM(sample_log_drain, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_SAMPLE_LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+/* Everything stored has been sent: append a cursor, so that it is not sent again after a reset. The batches are erased with their sector. */
+static void log_drained(void) {
+    static const uint8_t cursor[ROUND_UP(SAMPLE_LOG_CURSOR_LEN, 8)] = {0};
+    struct fcb_entry     loc;
+    int                  err;
+
+    if (drain_loc.fe_sector == NULL || drain_saved) {
+        return;
+    }
+
+    err = log_write(cursor, SAMPLE_LOG_CURSOR_LEN, &loc);
+    if (err) {
+        LOG_ERR("Failed to store the sample log cursor (err: %d)", err);
+        return;
+    }
+
+    drain_loc   = loc;
+    drain_saved = true;
+}
+
+/* Send the next batch of the backlog, one per drain interval. */
+static void sample_log_drain(zb_uint8_t param) {
+    struct fcb_entry next = drain_loc;
+
+    ZVUNUSED(param);
+
+    if (backlog == 0 && tx_len == 0) {
+        log_drained();
+    }
+
+    if (!joined || backlog == 0 || tx_len != 0) {
+        draining = (joined && backlog != 0);
+        return;
+    }
+
+    do {
+        if (fcb_getnext(&fcb, &next) != 0) {
+            backlog  = 0;
+            draining = false;
+            log_drained();
+            return;
+        }
+    } while (next.fe_data_len == SAMPLE_LOG_CURSOR_LEN);
+
+    if (next.fe_data_len > sizeof(tx_frame) || flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(next), tx_frame, next.fe_data_len) != 0) {
+        LOG_ERR("Skipping unreadable sample log entry");
+        drain_loc   = next;
+        drain_saved = false;
+        backlog--;
+        ZB_SCHEDULE_APP_CALLBACK(sample_log_drain, 0);
+        return;
+    }
+
+    tx_len = (uint8_t)next.fe_data_len;
+    if (zb_buf_get_out_delayed(sample_log_tx) != RET_OK) {
+        tx_len = 0;
+        ZB_SCHEDULE_APP_ALARM(sample_log_drain, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_SAMPLE_LOG_DRAIN_INTERVAL_MS));
+        return;
+    }
+
+    /* The oldest sector has been sent completely, a reset now only sends the batches of the next one again. */
+    if (drain_loc.fe_sector != NULL && drain_loc.fe_sector != next.fe_sector && drain_loc.fe_sector == fcb.f_oldest) {
+        fcb_rotate(&fcb);
+    }
+
+    draining    = true;
+    drain_loc   = next;
+    drain_saved = false;
+    backlog--;
+}
+
+static void drain_start(void) {
+    if (joined && backlog != 0 && !draining) {
+        draining = true;
+        ZB_SCHEDULE_APP_CALLBACK(sample_log_drain, 0);
+    }
+}
+
+/* Send the batch right away if nothing is queued before it, store it otherwise. */
+static void batch_flush(zb_uint8_t param) {
+    int err;
+
+    ZVUNUSED(param);
+    ZB_SCHEDULE_APP_ALARM_CANCEL(batch_flush, ZB_ALARM_ANY_PARAM);
+
+    if (batch_len <= SAMPLE_LOG_BATCH_HDR_LEN) {
+        batch_len = 0;
+        return;
+    }
+
+    if (joined && backlog == 0 && tx_len == 0) {
+        memcpy(tx_frame, batch, batch_len);
+        tx_len = batch_len;
+        if (zb_buf_get_out_delayed(sample_log_tx) == RET_OK) {
+            batch_len = 0;
+            return;
+        }
+        tx_len = 0;
+    }
+
+    err = log_append(batch, batch_len);
+    if (err) {
+        LOG_ERR("Failed to store samples (err: %d)", err);
+    }
+    batch_len = 0;
+
+    drain_start();
+}
+
+static void batch_start(uint32_t now) {
+    batch[0] = boot_id;
+    put_u32(&batch[1], now);
+    batch_len       = SAMPLE_LOG_BATCH_HDR_LEN;
+    batch_last_time = now;
+    memset(batch_prev, 0, sizeof(batch_prev));
+
+    ZB_SCHEDULE_APP_ALARM(batch_flush, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(CONFIG_APP_SAMPLE_LOG_FLUSH_INTERVAL_S * MSEC_PER_SEC));
+}
+
+static uint8_t encode_sample(uint8_t* out, uint32_t now, uint8_t entry, const uint16_t* values, uint8_t nb_regs) {
+    uint8_t len = 0;
+
+    len += varint_put(&out[len], now - batch_last_time);
+    out[len++] = entry;
+    out[len++] = nb_regs;
+    for (uint8_t i = 0; i < nb_regs; i++) {
+        len += varint_put(&out[len], zigzag_encode((int32_t)values[i] - (int32_t)batch_prev[entry][i]));
+    }
+
+    return len;
+}
+
+void sample_log_add(uint8_t entry, const uint16_t* values, uint8_t nb_regs) {
+    uint8_t  record[SAMPLE_LOG_MAX_RECORD_LEN];
+    uint8_t  len;
+    uint32_t now = uptime_s();
+
+    if (entry >= SAMPLE_LOG_MAX_ENTRIES || nb_regs > SAMPLE_LOG_MAX_REGS) {
+        return;
+    }
+
+    if (batch_len == 0) {
+        batch_start(now);
+    }
+
+    len = encode_sample(record, now, entry, values, nb_regs);
+    if (batch_len + len > SAMPLE_LOG_BATCH_SIZE) {
+        batch_flush(0);
+        batch_start(now);
+        len = encode_sample(record, now, entry, values, nb_regs);
+    }
+
+    memcpy(&batch[batch_len], record, len);
+    batch_len += len;
+    batch_last_time = now;
+    memcpy(batch_prev[entry], values, nb_regs * sizeof(values[0]));
+}
+
+void sample_log_set_network_state(bool state) {
+    joined = state;
+    drain_start();
+}
+
+int sample_log_init(uint8_t endpoint) {
+    struct fcb_entry first      = {0};
+    uint32_t         sector_cnt = ARRAY_SIZE(sectors);
+    uint8_t          last_boot  = 0;
+    int              err;
+
+    err = flash_area_get_sectors(FIXED_PARTITION_ID(sample_log), &sector_cnt, sectors);
+    if (err) {
+        LOG_ERR("Failed to get sample log sectors (err: %d)", err);
+        return err;
+    }
+
+    fcb.f_magic       = SAMPLE_LOG_MAGIC;
+    fcb.f_version     = SAMPLE_LOG_VERSION;
+    fcb.f_sector_cnt  = (uint8_t)sector_cnt;
+    fcb.f_scratch_cnt = 0;
+    fcb.f_sectors     = sectors;
+
+    err = fcb_init(FIXED_PARTITION_ID(sample_log), &fcb);
+    if (err) {
+        /* Not a log of this version, start over. */
+        const struct flash_area* fa;
+
+        LOG_WRN("Erasing sample log (err: %d)", err);
+        err = flash_area_open(FIXED_PARTITION_ID(sample_log), &fa);
+        if (err == 0) {
+            err = flash_area_erase(fa, 0, fa->fa_size);
+            flash_area_close(fa);
+        }
+        if (err == 0) {
+            err = fcb_init(FIXED_PARTITION_ID(sample_log), &fcb);
+        }
+        if (err) {
+            LOG_ERR("Sample log init failed (err: %d)", err);
+            return err;
+        }
+    }
+
+    log_count(first, &last_boot);
+
+    /* Batches before the last cursor were sent, only a reset during a drain sends some again. */
+    drain_loc    = log_find_cursor();
+    drain_saved  = (drain_loc.fe_sector != NULL);
+    backlog      = log_count(drain_loc, NULL);
+    boot_id      = last_boot + 1;
+    log_endpoint = endpoint;
+
+    LOG_INF("Sample log: %u batches pending, boot %u", backlog, boot_id);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/timing/timing.h>
+
+#include "signal_dispatch.h"
+
+LOG_MODULE_REGISTER(signal_dispatch, LOG_LEVEL_INF);
+
+void signal_dispatch_init(void) {
+#ifdef CONFIG_APP_SIGNAL_STATS
+    /* The system clock counts in RTC ticks of about 30 us, longer than most handlers. */
+    timing_init();
+    timing_start();
+#endif /* CONFIG_APP_SIGNAL_STATS */
+}
+
+void signal_dispatch(const struct signal_handler* handlers, struct signal_handler_stats* stats, size_t count, zb_bufid_t bufid) {
+    zb_zdo_app_signal_hdr_t* sg_p = NULL;
+    zb_zdo_app_signal_type_t sig;
+
+    /* If bufid == 0, the buffer is invalid (not passed). */
+    if (!bufid) {
+        return;
+    }
+
+    sig = zb_get_app_signal(bufid, &sg_p);
+
+    for (size_t i = 0; i < count; i++) {
+#ifdef CONFIG_APP_SIGNAL_STATS
+        timing_t start;
+        timing_t end;
+        uint64_t ns;
+#endif /* CONFIG_APP_SIGNAL_STATS */
+
+        if (handlers[i].signal != sig && handlers[i].signal != SIGNAL_DISPATCH_ANY) {
+            continue;
+        }
+
+#ifdef CONFIG_APP_SIGNAL_STATS
+        start = timing_counter_get();
+        handlers[i].handler(bufid);
+        end = timing_counter_get();
+        ns  = timing_cycles_to_ns(timing_cycles_get(&start, &end));
+
+        stats[i].calls++;
+        stats[i].total_ns += ns;
+        stats[i].max_ns = MAX(stats[i].max_ns, (uint32_t)MIN(ns, UINT32_MAX));
+#else
+        handlers[i].handler(bufid);
+#endif /* CONFIG_APP_SIGNAL_STATS */
+    }
+
+    /* All callbacks should either reuse or free passed buffers. */
+    zb_buf_free(bufid);
+}
+
+void signal_dispatch_report(const struct signal_handler* handlers, struct signal_handler_stats* stats, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (stats[i].calls == stats[i].calls_reported) {
+            continue;
+        }
+
+        stats[i].calls_reported = stats[i].calls;
+        LOG_INF("%s: %u calls, mean %u ns, max %u ns", handlers[i].name, stats[i].calls, (uint32_t)(stats[i].total_ns / stats[i].calls), stats[i].max_ns);
+    }
+}
@@ -51,24 +51,107 @@
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
+#include <zboss_api.h>
+
+#include "app_log.h"
+#include "boot_timing.h"
+#include "modbus_client.h"
+#include "modbus_codec.h"
+#include "modbus_frame.h"
+#include "modbus_regmap.h"
 #include "zb_zcl_modbus.h"
 
+#include "modbus_config.h"
+
+#ifdef CONFIG_APP_RULES
+#include "rules.h"
+#endif /* CONFIG_APP_RULES */
+
+#ifdef CONFIG_APP_MODBUS_STREAM
+#include "modbus_stream.h"
+#endif /* CONFIG_APP_MODBUS_STREAM */
+
+#ifdef CONFIG_APP_MODBUS_SNAPSHOT
+#include "modbus_snapshot.h"
+#endif /* CONFIG_APP_MODBUS_SNAPSHOT */
+
 #ifndef min
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
 LOG_MODULE_REGISTER(zcl_modbus, LOG_LEVEL_INF);
 
-K_FIFO_DEFINE(fifo);
+/* Number of recent requests remembered to detect APS retries and reroutes */
+#define DEDUP_CACHE_SIZE 8
+/* How long the response of a completed request is replayed to duplicates */
+#define DEDUP_TTL_MS 3000
+/* Number of register ranges for which the values last sent compressed are remembered */
+#define BASELINE_CACHE_SIZE 4
 
-#define SEND_TIMEOUT  1000
-#define MAX_FIFO_SIZE 10
+BUILD_ASSERT(MODBUS_CODEC_FRAME_LEN == ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN - ZB_ZCL_MODBUS_COMPRESSED_TAGS_LEN, "Codec frame length does not match the read compressed response");
 
 zb_uint8_t gs_modbus_server_received_commands[] = {ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_RECEIVED_CMD_LIST};
 
-zb_discover_cmd_list_t gs_modbus_client_cmd_list = {0, NULL, sizeof(gs_modbus_server_received_commands), gs_modbus_server_received_commands};
+zb_uint8_t gs_modbus_server_generated_commands[] = {ZB_ZCL_CLUSTER_ID_MODBUS_SERVER_ROLE_GENERATED_CMD_LIST};
+
+zb_discover_cmd_list_t gs_modbus_client_cmd_list = {sizeof(gs_modbus_server_generated_commands), gs_modbus_server_generated_commands, sizeof(gs_modbus_server_received_commands), gs_modbus_server_received_commands};
+
+zb_discover_cmd_list_t gs_modbus_server_cmd_list = {sizeof(gs_modbus_server_received_commands), gs_modbus_server_received_commands, sizeof(gs_modbus_server_generated_commands), gs_modbus_server_generated_commands};
+
+static zb_zcl_modbus_diag_t gs_modbus_diag;
+
+typedef enum
+{
+    DEDUP_FREE,
+    DEDUP_PENDING,
+    DEDUP_DONE,
+} dedup_state_t;
+
+/* Request key and, once completed, the encoded response */
+typedef struct {
+    zb_uint8_t  state;
+    zb_uint16_t src_addr;
+    zb_uint8_t  src_endpoint;
+    zb_uint8_t  seq_number;
+    zb_uint8_t  cmd_id;
+    zb_uint8_t  resp_id;
+    zb_uint8_t  len;
+    zb_uint32_t done_time;
+    zb_uint8_t  payload[ZB_ZCL_MB_CMD_MAX_STRING_LENGTH];
+} modbus_dedup_entry_t;
+
+static modbus_dedup_entry_t gs_modbus_dedup[DEDUP_CACHE_SIZE];
 
-zb_discover_cmd_list_t gs_modbus_server_cmd_list = {sizeof(gs_modbus_server_received_commands), gs_modbus_server_received_commands, 0, NULL};
+/* Values last sent to a requester for a register range, compressed responses are encoded against them */
+typedef struct {
+    zb_uint8_t  tag;
+    zb_uint16_t src_addr;
+    zb_uint8_t  src_endpoint;
+    zb_uint8_t  slave_id;
+    zb_uint8_t  fc;
+    zb_uint16_t addr;
+    zb_uint8_t  nb_regs;
+    zb_uint32_t last_used;
+    zb_uint16_t values[ZB_ZCL_MODBUS_COMPRESSED_MAX_REGS];
+} modbus_baseline_t;
+
+static modbus_baseline_t gs_modbus_baselines[BASELINE_CACHE_SIZE];
+static zb_uint8_t        gs_modbus_baseline_tag;
+
+/* Group status waiting for its random delay, kept in the parameter area of its buffer */
+typedef struct {
+    zb_zcl_modbus_addr_t addr;
+    zb_uint8_t           len;
+    zb_uint8_t           payload[ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN];
+} modbus_group_status_t;
+
+/* Group command sent by this device and the answers collected so far */
+static struct {
+    zb_bool_t                    active;
+    zb_uint8_t                   seq_number;
+    zb_zcl_modbus_group_cb_t     cb;
+    zb_zcl_modbus_group_result_t result;
+} gs_modbus_group;
 
 static zb_ret_t check_value_modbus_server(zb_uint16_t attr_id, zb_uint8_t endpoint, zb_uint8_t* value);
 static zb_ret_t check_value_modbus_client(zb_uint16_t attr_id, zb_uint8_t endpoint, zb_uint8_t* value);
@@ -76,10 +159,25 @@ static zb_ret_t check_value_modbus_client(zb_uint16_t attr_id, zb_uint8_t endpoi
 zb_bool_t zb_zcl_process_modbus_specific_commands_srv(zb_uint8_t param);
 zb_bool_t zb_zcl_process_modbus_specific_commands_cli(zb_uint8_t param);
 
-void zb_zcl_handleModbusCommand(zb_uint8_t param, modbus_cmd_resp_queue_data_t* fifo_data);
+const zb_zcl_modbus_diag_t* zb_zcl_modbus_get_diag(void) {
+    return &gs_modbus_diag;
+}
+
+/* Apply a written baudrate to the bus, and store it or a written request timeout. */
+static void write_attr_hook_modbus_server(zb_uint8_t endpoint, zb_uint16_t attr_id, zb_uint8_t* new_value, zb_uint16_t manuf_code) {
+    ZVUNUSED(endpoint);
+    ZVUNUSED(manuf_code);
+
+    if (attr_id == ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID) {
+        modbus_client_set_baudrate((zb_zcl_modbus_baudrate_t)*new_value);
+        modbus_config_changed();
+    } else if (attr_id == ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID) {
+        modbus_config_changed();
+    }
+}
 
 void zb_zcl_modbus_init_server() {
-    zb_zcl_add_cluster_handlers(ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_SERVER_ROLE, check_value_modbus_server, (zb_zcl_cluster_write_attr_hook_t)NULL, zb_zcl_process_modbus_specific_commands_srv);
+    zb_zcl_add_cluster_handlers(ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_SERVER_ROLE, check_value_modbus_server, write_attr_hook_modbus_server, zb_zcl_process_modbus_specific_commands_srv);
 }
 
 void zb_zcl_modbus_init_client() {
@@ -97,6 +195,11 @@ static zb_ret_t check_value_modbus_server(zb_uint16_t attr_id, zb_uint8_t endpoi
             ret = RET_ERROR;
         }
         break;
+    case ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID:
+        if (*value > ZB_ZCL_MODBUS_BAUDRATE_MAX_VALUE) {
+            ret = RET_ERROR;
+        }
+        break;
     default:
         ret = RET_OK;
         break;
@@ -124,24 +227,637 @@ static zb_ret_t check_value_modbus_client(zb_uint16_t attr_id, zb_uint8_t endpoi
     return ret;
 }
 
-static void json_cmd_handler(zb_uint8_t param, zb_zcl_modbus_addr_t* addr) {
-    zb_zcl_parse_status_t status;
+static zb_bool_t is_read_fc(zb_uint8_t fc) {
+    return (zb_bool_t)(fc == MODBUS_FC_READ_HOLDING_REGS || fc == MODBUS_FC_READ_INPUT_REGS);
+}
+
+/* String of a command payload, checked against the received frame, see modbus_frame.h.
+ * Returns its length, or a negative error code.
+ */
+static int modbus_get_string(zb_bufid_t param, const zb_uint8_t** str) {
+    return modbus_frame_string(zb_buf_begin(param), zb_buf_len(param), ZB_ZCL_MB_CMD_MAX_STRING_LENGTH, str);
+}
+
+/* Data packet: fc, slave_id, addr (LE), nb_regs, then nb_regs words (LE) for writes, then an optional deadline (LE).
+ * The deadline, if present, is stored in timeout_ms.
+ */
+static zb_ret_t parse_data_packet(const zb_uint8_t* data, zb_uint8_t len, zb_zcl_modbus_data_packet_resp_t* pkt, zb_uint16_t* timeout_ms) {
+    struct modbus_frame_request req;
+
+    if (modbus_frame_parse_request(data, len, MAX_NUM_REGISTERS, &req) != 0) {
+        return RET_INVALID_PARAMETER;
+    }
+
+    ZB_BZERO(pkt, sizeof(*pkt));
+    pkt->fc       = req.fc;
+    pkt->slave_id = req.slave_id;
+    pkt->addr     = req.addr;
+    pkt->nb_regs  = req.nb_regs;
+
+    if (req.has_deadline) {
+        *timeout_ms = req.deadline_ms;
+    }
+
+    for (zb_uint8_t i = 0; i < pkt->nb_regs && req.values != NULL; i++) {
+        pkt->data[i] = modbus_frame_get_le16(&req.values[2 * i]);
+    }
+
+    return RET_OK;
+}
+
+static zb_uint8_t put_data_packet_hdr(const zb_zcl_modbus_data_packet_resp_t* pkt, zb_uint8_t* out) {
+    out[0] = pkt->fc;
+    out[1] = pkt->slave_id;
+    out[2] = (zb_uint8_t)(pkt->addr & 0xFF);
+    out[3] = (zb_uint8_t)(pkt->addr >> 8);
+    out[4] = (zb_uint8_t)((zb_uint16_t)pkt->err & 0xFF);
+    out[5] = (zb_uint8_t)((zb_uint16_t)pkt->err >> 8);
+    out[6] = pkt->nb_regs;
+
+    return ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN;
+}
+
+static zb_uint8_t put_data_packet(const zb_zcl_modbus_data_packet_resp_t* pkt, zb_uint8_t* out) {
+    zb_uint8_t len = put_data_packet_hdr(pkt, out);
+
+    if (pkt->err == 0 && is_read_fc(pkt->fc)) {
+        for (zb_uint8_t i = 0; i < pkt->nb_regs; i++) {
+            out[len++] = (zb_uint8_t)(pkt->data[i] & 0xFF);
+            out[len++] = (zb_uint8_t)(pkt->data[i] >> 8);
+        }
+    }
+
+    return len;
+}
+
+static zb_uint8_t put_decoded_packet(zb_zcl_modbus_data_packet_resp_t* pkt, zb_uint8_t* out) {
+    struct modbus_reg_value     values[ZB_ZCL_MODBUS_DECODED_MAX_VALUES];
+    const struct modbus_regmap* map   = modbus_regmap_get(pkt->slave_id);
+    int                         count = 0;
+    zb_uint8_t                  len;
+
+    if (pkt->err == 0) {
+        count = modbus_regmap_decode(map, pkt->fc, pkt->addr, pkt->data, pkt->nb_regs, values, ARRAY_SIZE(values));
+        if (count < 0) {
+            pkt->err = ZB_ZCL_MODBUS_EXCP_CODE(ZB_ZCL_MODBUS_EXCP_ILLEGAL_DATA_ADDR);
+            count    = 0;
+        }
+    }
+
+    len        = put_data_packet_hdr(pkt, out);
+    out[len++] = (zb_uint8_t)count;
+
+    for (int i = 0; i < count; i++) {
+        out[len++] = values[i].type;
+        out[len++] = values[i].unit;
+        out[len++] = (zb_uint8_t)values[i].scale;
+        out[len++] = (zb_uint8_t)((zb_uint32_t)values[i].value & 0xFF);
+        out[len++] = (zb_uint8_t)(((zb_uint32_t)values[i].value >> 8) & 0xFF);
+        out[len++] = (zb_uint8_t)(((zb_uint32_t)values[i].value >> 16) & 0xFF);
+        out[len++] = (zb_uint8_t)((zb_uint32_t)values[i].value >> 24);
+    }
+
+    return len;
+}
+
+/* Baseline of the register range for this requester, or the least recently used entry to replace. */
+static modbus_baseline_t* baseline_get(const zb_zcl_modbus_addr_t* addr, const zb_zcl_modbus_data_packet_resp_t* pkt) {
+    modbus_baseline_t* victim = &gs_modbus_baselines[0];
+
+    for (zb_uint8_t i = 0; i < ARRAY_SIZE(gs_modbus_baselines); i++) {
+        modbus_baseline_t* entry = &gs_modbus_baselines[i];
+
+        if (entry->tag != 0 && entry->src_addr == addr->src_addr && entry->src_endpoint == addr->src_endpoint && entry->slave_id == pkt->slave_id && entry->fc == pkt->fc && entry->addr == pkt->addr && entry->nb_regs == pkt->nb_regs) {
+            return entry;
+        }
+        if (entry->tag == 0 || (victim->tag != 0 && (zb_int32_t)(entry->last_used - victim->last_used) < 0)) {
+            victim = entry;
+        }
+    }
+
+    victim->tag          = 0;
+    victim->src_addr     = addr->src_addr;
+    victim->src_endpoint = addr->src_endpoint;
+    victim->slave_id     = pkt->slave_id;
+    victim->fc           = pkt->fc;
+    victim->addr         = pkt->addr;
+    victim->nb_regs      = pkt->nb_regs;
+
+    return victim;
+}
+
+/* Encode the values against the baseline the requester holds, if the server still has the same one. */
+static zb_uint8_t put_compressed_packet(const zb_zcl_modbus_addr_t* addr, zb_zcl_modbus_data_packet_resp_t* pkt, zb_uint8_t* out) {
+    zb_uint8_t         len  = ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN + ZB_ZCL_MODBUS_COMPRESSED_TAGS_LEN;
+    modbus_baseline_t* base = NULL;
+    const zb_uint16_t* ref  = NULL;
+    int                enc  = 0;
+
+    if (pkt->err == 0) {
+        base = baseline_get(addr, pkt);
+        if (base->tag != 0 && base->tag == addr->base_tag) {
+            ref = base->values;
+        }
+
+        enc = modbus_codec_encode(pkt->data, ref, pkt->nb_regs, &out[len], ZB_ZCL_MB_CMD_MAX_STRING_LENGTH - len);
+        if (enc < 0) {
+            /* Not reachable with up to ZB_ZCL_MODBUS_COMPRESSED_MAX_REGS registers. */
+            pkt->err = ZB_ZCL_MODBUS_EXCP_CODE(ZB_ZCL_MODBUS_EXCP_SERVER_DEV_FAIL);
+        }
+    }
+
+    put_data_packet_hdr(pkt, out);
+
+    if (pkt->err != 0) {
+        out[ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN]     = 0;
+        out[ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN + 1] = 0;
+        return len;
+    }
+
+    if (++gs_modbus_baseline_tag == 0) {
+        gs_modbus_baseline_tag = 1;
+    }
+
+    out[ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN]     = (ref != NULL) ? base->tag : 0;
+    out[ZB_ZCL_MODBUS_DATA_PACKET_HDR_LEN + 1] = gs_modbus_baseline_tag;
+
+    base->tag       = gs_modbus_baseline_tag;
+    base->last_used = k_uptime_get_32();
+    ZB_MEMCPY(base->values, pkt->data, pkt->nb_regs * sizeof(pkt->data[0]));
+
+    return len + (zb_uint8_t)enc;
+}
+
+static zb_bool_t dedup_match(const modbus_dedup_entry_t* entry, const zb_zcl_modbus_addr_t* addr) {
+    return (zb_bool_t)(entry->state != DEDUP_FREE && entry->src_addr == addr->src_addr && entry->src_endpoint == addr->src_endpoint && entry->seq_number == addr->seq_number && entry->cmd_id == addr->cmd_id);
+}
+
+static modbus_dedup_entry_t* dedup_find(const zb_zcl_modbus_addr_t* addr) {
+    zb_uint32_t now = k_uptime_get_32();
+
+    for (zb_uint8_t i = 0; i < ARRAY_SIZE(gs_modbus_dedup); i++) {
+        modbus_dedup_entry_t* entry = &gs_modbus_dedup[i];
+
+        if (entry->state == DEDUP_DONE && now - entry->done_time > DEDUP_TTL_MS) {
+            entry->state = DEDUP_FREE;
+        }
+        if (dedup_match(entry, addr)) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Remember a new request, reusing a free entry or the oldest completed one. */
+static void dedup_insert(const zb_zcl_modbus_addr_t* addr) {
+    modbus_dedup_entry_t* entry = NULL;
+
+    for (zb_uint8_t i = 0; i < ARRAY_SIZE(gs_modbus_dedup); i++) {
+        modbus_dedup_entry_t* cur = &gs_modbus_dedup[i];
+
+        if (cur->state == DEDUP_FREE) {
+            entry = cur;
+            break;
+        }
+        if (cur->state == DEDUP_DONE && (entry == NULL || (zb_int32_t)(cur->done_time - entry->done_time) < 0)) {
+            entry = cur;
+        }
+    }
+
+    if (entry == NULL) {
+        /* All entries are in flight, the request is not tracked. */
+        return;
+    }
+
+    entry->state        = DEDUP_PENDING;
+    entry->src_addr     = addr->src_addr;
+    entry->src_endpoint = addr->src_endpoint;
+    entry->seq_number   = addr->seq_number;
+    entry->cmd_id       = addr->cmd_id;
+}
+
+static void modbus_send_payload(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr, zb_uint8_t resp_id, const zb_uint8_t* payload, zb_uint8_t len) {
+    zb_uint8_t* cmd_ptr = ZB_ZCL_START_PACKET(bufid);
+
+    ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_RES_FRAME_CONTROL(cmd_ptr);
+    ZB_ZCL_CONSTRUCT_COMMAND_HEADER(cmd_ptr, addr->seq_number, resp_id);
+    ZB_ZCL_PACKET_PUT_DATA8(cmd_ptr, len);
+    ZB_ZCL_PACKET_PUT_DATA_N(cmd_ptr, payload, len);
+    ZB_ZCL_FINISH_PACKET(bufid, cmd_ptr)
+    ZB_ZCL_SEND_COMMAND_SHORT(bufid, addr->src_addr, ZB_APS_ADDR_MODE_16_ENDP_PRESENT, addr->src_endpoint, addr->dst_endpoint, addr->profile_id, ZB_ZCL_CLUSTER_ID_MODBUS, NULL);
+
+    gs_modbus_diag.resp_sent++;
+    boot_timing_mark(BOOT_PHASE_FIRST_RESPONSE);
+}
+
+void zb_zcl_modbus_send_fragmented(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr) {
+    zb_apsde_data_req_t* req = ZB_BUF_GET_PARAM(bufid, zb_apsde_data_req_t);
+
+    ZB_BZERO(req, sizeof(*req));
+    req->dst_addr.addr_short = addr->src_addr;
+    req->addr_mode           = ZB_APS_ADDR_MODE_16_ENDP_PRESENT;
+    req->dst_endpoint        = addr->src_endpoint;
+    req->src_endpoint        = addr->dst_endpoint;
+    req->profileid           = addr->profile_id;
+    req->clusterid           = ZB_ZCL_CLUSTER_ID_MODBUS;
+    req->tx_options          = ZB_APSDE_TX_OPT_ACK_TX | ZB_APSDE_TX_OPT_FRAG_PERMITTED;
+    ZB_SCHEDULE_CALLBACK(zb_apsde_data_request, bufid);
+
+    gs_modbus_diag.resp_sent++;
+}
+
+static void modbus_group_status_send(zb_bufid_t bufid) {
+    modbus_group_status_t status = *ZB_BUF_GET_PARAM(bufid, modbus_group_status_t);
+
+    modbus_send_payload(bufid, &status.addr, ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID, status.payload, status.len);
+}
+
+/* Group members answer after a random delay so that their answers do not collide at the originator. */
+static void modbus_reply(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr, zb_uint8_t resp_id, const zb_uint8_t* payload, zb_uint8_t len) {
+    modbus_group_status_t* status;
+
+    if (resp_id != ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID) {
+        modbus_send_payload(bufid, addr, resp_id, payload, len);
+        return;
+    }
+
+    status       = ZB_BUF_GET_PARAM(bufid, modbus_group_status_t);
+    status->addr = *addr;
+    status->len  = len;
+    ZB_MEMCPY(status->payload, payload, len);
+
+    ZB_SCHEDULE_APP_ALARM(modbus_group_status_send, bufid, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_RANDOM_VALUE(ZB_ZCL_MODBUS_GROUP_JITTER_MS)));
+}
+
+/* Send the result of a request back to its originator, reusing the request buffer.
+ * Bus results are kept in the dedup cache so that duplicates can be answered from it.
+ */
+static void modbus_send_resp(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr, zb_zcl_modbus_data_packet_resp_t* pkt, zb_bool_t cache) {
+    zb_uint8_t            payload[ZB_ZCL_MB_CMD_MAX_STRING_LENGTH];
+    zb_uint8_t            len;
+    zb_uint8_t            resp_id;
+    modbus_dedup_entry_t* entry = dedup_find(addr);
+
+    if (addr->cmd_id == ZB_ZCL_CMD_MODBUS_READ_DECODED_REQ_ID) {
+        resp_id = ZB_ZCL_CMD_MODBUS_READ_DECODED_RESP_ID;
+        len     = put_decoded_packet(pkt, payload);
+    } else if (addr->cmd_id == ZB_ZCL_CMD_MODBUS_GROUP_COMMAND_REQ_ID) {
+        resp_id = ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID;
+        len     = put_data_packet_hdr(pkt, payload);
+    } else if (addr->cmd_id == ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID) {
+        resp_id = ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_RESP_ID;
+        len     = put_compressed_packet(addr, pkt, payload);
+    } else {
+        resp_id = ZB_ZCL_CMD_MODBUS_JSON_COMMAND_RESP_ID;
+        len     = put_data_packet(pkt, payload);
+    }
+
+    if (entry != NULL) {
+        if (cache) {
+            entry->state     = DEDUP_DONE;
+            entry->done_time = k_uptime_get_32();
+            entry->resp_id   = resp_id;
+            entry->len       = len;
+            ZB_MEMCPY(entry->payload, payload, len);
+        } else {
+            entry->state = DEDUP_FREE;
+        }
+    }
+
+    modbus_reply(bufid, addr, resp_id, payload, len);
+}
+
+/**@brief Called in the Zigbee stack context when a bus transaction is finished.
+ *
+ * @param  idx  Index of the Modbus client queue item.
+ */
+static void modbus_cmd_done(zb_uint8_t idx) {
+    modbus_cmd_resp_queue_data_t* item = modbus_client_get(idx);
+    modbus_dedup_entry_t*         entry;
+
+    if (item->resp.err == -ECANCELED) {
+        /* The sender does not want the answer, forget the request so that it can be sent again. */
+        entry = dedup_find(&item->addr);
+        if (entry != NULL) {
+            entry->state = DEDUP_FREE;
+        }
+        zb_buf_free(item->bufid);
+    } else {
+        if (item->resp.err == -ETIME) {
+            gs_modbus_diag.cmd_expired++;
+        } else if (item->resp.err != 0) {
+            gs_modbus_diag.bus_errors++;
+        }
+        modbus_send_resp(item->bufid, &item->addr, &item->resp, ZB_TRUE);
+    }
+
+    modbus_client_free(item);
+}
+
+/* Reply with an exception without touching the bus. */
+static void modbus_reject(zb_bufid_t bufid, const zb_zcl_modbus_addr_t* addr, zb_zcl_modbus_data_packet_resp_t* pkt, zb_zcl_modbus_exception_t excp) {
+    TRACE_MSG(TRACE_ZCL1, "modbus request rejected, exception %i", (FMT__H, excp));
+
+    pkt->err = ZB_ZCL_MODBUS_EXCP_CODE(excp);
+    gs_modbus_diag.cmd_rejected++;
+    modbus_send_resp(bufid, addr, pkt, ZB_FALSE);
+}
+
+/* Validate a request against the register map of its slave and queue it for the bus. */
+static void modbus_cmd_submit(zb_uint8_t param, const zb_zcl_modbus_addr_t* addr, zb_zcl_modbus_data_packet_resp_t* pkt) {
+    const struct modbus_regmap*   map = modbus_regmap_get(pkt->slave_id);
+    modbus_cmd_resp_queue_data_t* item;
+    int                           values = 0;
+
+    if (map != NULL) {
+        values = modbus_regmap_validate(map, pkt->fc, pkt->addr, pkt->nb_regs);
+        if (values < 0) {
+            modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_ILLEGAL_DATA_ADDR);
+            return;
+        }
+    }
+
+    if (addr->cmd_id == ZB_ZCL_CMD_MODBUS_READ_DECODED_REQ_ID) {
+        if (map == NULL || !is_read_fc(pkt->fc)) {
+            modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_ILLEGAL_DATA_ADDR);
+            return;
+        }
+        if (values > ZB_ZCL_MODBUS_DECODED_MAX_VALUES) {
+            modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_ILLEGAL_DATA_VALUE);
+            return;
+        }
+    }
+
+    if (addr->cmd_id == ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID) {
+        if (!is_read_fc(pkt->fc)) {
+            modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_ILLEGAL_FUNC);
+            return;
+        }
+        if (pkt->nb_regs > ZB_ZCL_MODBUS_COMPRESSED_MAX_REGS) {
+            modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_ILLEGAL_DATA_VALUE);
+            return;
+        }
+    }
+
+    item = modbus_client_alloc();
+    if (item == NULL) {
+        modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_SERVER_DEV_BUSY);
+        return;
+    }
+
+    item->cb    = modbus_cmd_done;
+    item->bufid = param;
+    item->addr  = *addr;
+    item->resp  = *pkt;
+    if (addr->timeout_ms != 0) {
+        item->deadline = k_uptime_get_32() + addr->timeout_ms;
+    }
+
+    if (modbus_client_submit(item) != 0) {
+        modbus_client_free(item);
+        modbus_reject(param, addr, pkt, ZB_ZCL_MODBUS_EXCP_SERVER_DEV_FAIL);
+    }
+}
+
+/* Handles the json, read decoded, group and read compressed commands, which share the request format.
+ * Returns ZB_ZCL_STATUS_SUCCESS if the buffer has been taken over.
+ */
+static zb_zcl_status_t json_cmd_handler(zb_uint8_t param, zb_zcl_modbus_addr_t* addr) {
+    zb_zcl_modbus_data_packet_resp_t pkt;
+    const zb_uint8_t*                data;
+    int                              len;
+    modbus_dedup_entry_t*            dup;
 
     TRACE_MSG(TRACE_ZCL1, "> json_cmd_handler param %i", (FMT__H, param));
 
-    if (status == ZB_ZCL_PARSE_STATUS_SUCCESS) {
-        LOG_INF("Received");
+    dup = dedup_find(addr);
+    if (dup != NULL) {
+        gs_modbus_diag.cmd_duplicates++;
+        if (dup->state == DEDUP_DONE) {
+            /* Completed recently: replay the response instead of going back to the bus. */
+            modbus_reply(param, addr, dup->resp_id, dup->payload, dup->len);
+        } else {
+            /* Still in flight: the pending transaction answers this request too. */
+            zb_buf_free(param);
+        }
+        TRACE_MSG(TRACE_ZCL1, "< json_cmd_handler: duplicate", (FMT__0));
+        return ZB_ZCL_STATUS_SUCCESS;
+    }
+
+    len = modbus_get_string(param, &data);
+
+    if (len > 0 && addr->cmd_id == ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID) {
+        /* The baseline tag follows the data packet. */
+        addr->base_tag = data[--len];
+    }
+
+    if (len < 0 || parse_data_packet(data, (zb_uint8_t)len, &pkt, &addr->timeout_ms) != RET_OK) {
+        TRACE_MSG(TRACE_ZCL1, "< json_cmd_handler: malformed", (FMT__0));
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
     }
 
+    dedup_insert(addr);
+    modbus_cmd_submit(param, addr, &pkt);
+
     TRACE_MSG(TRACE_ZCL1, "< json_cmd_handler", (FMT__0));
+    return ZB_ZCL_STATUS_SUCCESS;
+}
+
+/* Requests of a sender to cancel, all of them if no sequence numbers are given */
+typedef struct {
+    const zb_zcl_modbus_addr_t* addr;
+    const zb_uint8_t*           seq_numbers;
+    zb_uint8_t                  count;
+} modbus_cancel_ctx_t;
+
+static bool modbus_cancel_match(const modbus_cmd_resp_queue_data_t* item, const void* ctx) {
+    const modbus_cancel_ctx_t* cancel = ctx;
+
+    /* Poller and rules transactions are not Modbus cluster requests. */
+    if (item->cb != (void*)modbus_cmd_done || item->addr.src_addr != cancel->addr->src_addr || item->addr.src_endpoint != cancel->addr->src_endpoint) {
+        return false;
+    }
+    if (cancel->count == 0) {
+        return true;
+    }
+
+    for (zb_uint8_t i = 0; i < cancel->count; i++) {
+        if (cancel->seq_numbers[i] == item->addr.seq_number) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Remove queued requests of the sender, answered with a default response. */
+static zb_zcl_status_t cancel_handler(zb_uint8_t param, const zb_zcl_modbus_addr_t* addr) {
+    const zb_uint8_t*   data;
+    modbus_cancel_ctx_t ctx;
+    int                 len;
+    int                 count;
+
+    len = modbus_get_string(param, &data);
+    if (len < 0) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    ctx.addr        = addr;
+    ctx.seq_numbers = data;
+    ctx.count       = (zb_uint8_t)len;
+
+    count = modbus_client_cancel(modbus_cancel_match, &ctx);
+    gs_modbus_diag.cmd_cancelled += count;
+    TRACE_MSG(TRACE_ZCL1, "modbus cancel: %d requests", (FMT__D, count));
+
+    return (count > 0) ? ZB_ZCL_STATUS_SUCCESS : ZB_ZCL_STATUS_NOT_FOUND;
+}
+
+#ifdef CONFIG_APP_RULES
+/* Store a chunk of a rules program, answered with a default response. */
+static zb_zcl_status_t rules_download_handler(zb_uint8_t param) {
+    const zb_uint8_t* data;
+    zb_uint16_t       offset;
+    zb_uint16_t       total;
+    zb_uint8_t        len;
+    int               str_len;
+    int               err;
+
+    str_len = modbus_get_string(param, &data);
+    if (str_len < ZB_ZCL_MODBUS_RULES_HDR_LEN) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    offset = modbus_frame_get_le16(&data[0]);
+    total  = modbus_frame_get_le16(&data[2]);
+    len    = (zb_uint8_t)(str_len - ZB_ZCL_MODBUS_RULES_HDR_LEN);
+
+    err = rules_download(offset, total, &data[ZB_ZCL_MODBUS_RULES_HDR_LEN], len);
+    if (err == -EFBIG) {
+        return ZB_ZCL_STATUS_INSUFF_SPACE;
+    }
+    if (err) {
+        return ZB_ZCL_STATUS_INVALID_VALUE;
+    }
+
+    /* The last chunk replaced the running program. */
+    if (offset + len == total) {
+        modbus_config_changed();
+    }
+
+    return ZB_ZCL_STATUS_SUCCESS;
+}
+#endif /* CONFIG_APP_RULES */
+
+#ifdef CONFIG_APP_MODBUS_STREAM
+/* Start a stream transfer, answered with a default response. The data follows in stream data frames. */
+static zb_zcl_status_t stream_read_handler(zb_uint8_t param, const zb_zcl_modbus_addr_t* addr) {
+    const zb_uint8_t* data;
+    int               err;
+
+    if (modbus_get_string(param, &data) != ZB_ZCL_MODBUS_STREAM_READ_LEN) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    err = modbus_stream_start(addr, data[0], data[1], modbus_frame_get_le16(&data[2]), modbus_frame_get_le16(&data[4]), data[6]);
+    if (err == -EBUSY) {
+        return ZB_ZCL_STATUS_FAIL;
+    }
+    if (err) {
+        return ZB_ZCL_STATUS_INVALID_VALUE;
+    }
+
+    return ZB_ZCL_STATUS_SUCCESS;
+}
+
+/* Acknowledge the registers of a stream transfer received, answered with a default response. */
+static zb_zcl_status_t stream_ack_handler(zb_uint8_t param, const zb_zcl_modbus_addr_t* addr) {
+    const zb_uint8_t* data;
+    int               err;
+
+    if (modbus_get_string(param, &data) != ZB_ZCL_MODBUS_STREAM_ACK_LEN) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    err = modbus_stream_ack(addr, data[0], modbus_frame_get_le16(&data[1]));
+    if (err == -ENOENT) {
+        return ZB_ZCL_STATUS_NOT_FOUND;
+    }
+    if (err) {
+        return ZB_ZCL_STATUS_INVALID_VALUE;
+    }
+
+    return ZB_ZCL_STATUS_SUCCESS;
+}
+#endif /* CONFIG_APP_MODBUS_STREAM */
+
+#ifdef CONFIG_APP_MODBUS_SNAPSHOT
+/* Run a snapshot operation. An accepted export is answered with a snapshot response and sets *sent,
+ * everything else with a default response.
+ */
+static zb_zcl_status_t snapshot_handler(zb_uint8_t param, const zb_zcl_modbus_addr_t* addr, bool* sent) {
+    const zb_uint8_t* data;
+    int               len;
+    zb_uint16_t       chunk_len;
+    int               err;
+
+    *sent = false;
+    len   = modbus_get_string(param, &data);
+    if (len < 1) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    switch (data[0]) {
+    case ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE:
+    case ZB_ZCL_MODBUS_SNAPSHOT_RESTORE:
+        if (len != 2) {
+            return ZB_ZCL_STATUS_MALFORMED_CMD;
+        }
+        err = (data[0] == ZB_ZCL_MODBUS_SNAPSHOT_CAPTURE) ? modbus_snapshot_capture(addr, data[1]) : modbus_snapshot_restore(addr, data[1]);
+        break;
+    case ZB_ZCL_MODBUS_SNAPSHOT_EXPORT:
+        if (len != 3) {
+            return ZB_ZCL_STATUS_MALFORMED_CMD;
+        }
+        err   = modbus_snapshot_export(addr, modbus_frame_get_le16(&data[1]));
+        *sent = (err == 0);
+        break;
+    case ZB_ZCL_MODBUS_SNAPSHOT_IMPORT:
+        if (len < ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN) {
+            return ZB_ZCL_STATUS_MALFORMED_CMD;
+        }
+        /* After a bare header, the chunk follows the string, in a frame that may be APS fragmented. */
+        chunk_len = (len == ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN) ? (zb_uint16_t)(zb_buf_len(param) - 1 - len) : (zb_uint16_t)(len - ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN);
+        err       = modbus_snapshot_import(modbus_frame_get_le16(&data[1]), modbus_frame_get_le16(&data[3]), &data[ZB_ZCL_MODBUS_SNAPSHOT_IMPORT_HDR_LEN], chunk_len);
+        break;
+    default:
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    switch (err) {
+    case 0:
+        return ZB_ZCL_STATUS_SUCCESS;
+    case -EBUSY:
+        return ZB_ZCL_STATUS_FAIL;
+    case -ENOENT:
+        return ZB_ZCL_STATUS_NOT_FOUND;
+    case -EFBIG:
+        return ZB_ZCL_STATUS_INSUFF_SPACE;
+    default:
+        return ZB_ZCL_STATUS_INVALID_VALUE;
+    }
 }
+#endif /* CONFIG_APP_MODBUS_SNAPSHOT */
 
 zb_bool_t zb_zcl_process_modbus_specific_commands(zb_uint8_t param) {
     zb_zcl_attr_t*           baudrate_desc;
+    zb_zcl_attr_t*           timeout_desc;
     zb_zcl_modbus_baudrate_t baudrate;
     zb_bool_t                processed = ZB_TRUE;
     zb_zcl_parsed_hdr_t      cmd_info;
     zb_zcl_modbus_addr_t     main_addr;
+    zb_zcl_status_t          status;
 
     ZB_ZCL_COPY_PARSED_HEADER(param, &cmd_info);
 
@@ -157,6 +873,8 @@ zb_bool_t zb_zcl_process_modbus_specific_commands(zb_uint8_t param) {
     main_addr.seq_number               = cmd_info.seq_number;
     main_addr.disable_default_response = (zb_bool_t)cmd_info.disable_default_response;
     main_addr.profile_id               = cmd_info.profile_id;
+    main_addr.base_tag                 = 0;
+    main_addr.timeout_ms               = 0;
 
     baudrate_desc = zb_zcl_get_attr_desc_a(main_addr.dst_endpoint, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_ATTR_MODBUS_BAUDRATE_ID);
 
@@ -166,16 +884,94 @@ zb_bool_t zb_zcl_process_modbus_specific_commands(zb_uint8_t param) {
 
     TRACE_MSG(TRACE_ZCL1, "baudrate is %i", (FMT__H, baudrate));
 
+    /* Requests without a deadline field expire after the request timeout. */
+    timeout_desc = zb_zcl_get_attr_desc_a(main_addr.dst_endpoint, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_SERVER_ROLE, ZB_ZCL_ATTR_MODBUS_REQUEST_TIMEOUT_ID);
+    if (timeout_desc != NULL) {
+        main_addr.timeout_ms = ZB_ZCL_GET_ATTRIBUTE_VAL_16(timeout_desc);
+    }
+
     switch (main_addr.cmd_id) {
     case ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID:
-        json_cmd_handler(param, &main_addr);
+    case ZB_ZCL_CMD_MODBUS_READ_DECODED_REQ_ID:
+    case ZB_ZCL_CMD_MODBUS_GROUP_COMMAND_REQ_ID:
+    case ZB_ZCL_CMD_MODBUS_READ_COMPRESSED_REQ_ID:
+        status = json_cmd_handler(param, &main_addr);
+        if (status != ZB_ZCL_STATUS_SUCCESS) {
+            gs_modbus_diag.cmd_rejected++;
+            ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+            return ZB_TRUE;
+        }
         TRACE_MSG(TRACE_ZCL3, "Processed json command", (FMT__0));
         break;
 
+    case ZB_ZCL_CMD_MODBUS_CANCEL_REQ_ID:
+        status = cancel_handler(param, &main_addr);
+        if (status == ZB_ZCL_STATUS_MALFORMED_CMD) {
+            gs_modbus_diag.cmd_rejected++;
+        } else {
+            gs_modbus_diag.cmd_received++;
+        }
+        ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+        return ZB_TRUE;
+
+#ifdef CONFIG_APP_RULES
+    case ZB_ZCL_CMD_MODBUS_RULES_DOWNLOAD_REQ_ID:
+        status = rules_download_handler(param);
+        if (status != ZB_ZCL_STATUS_SUCCESS) {
+            gs_modbus_diag.cmd_rejected++;
+        } else {
+            gs_modbus_diag.cmd_received++;
+        }
+        ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+        return ZB_TRUE;
+#endif /* CONFIG_APP_RULES */
+
+#ifdef CONFIG_APP_MODBUS_STREAM
+    case ZB_ZCL_CMD_MODBUS_STREAM_READ_REQ_ID:
+    case ZB_ZCL_CMD_MODBUS_STREAM_ACK_REQ_ID:
+        if (main_addr.cmd_id == ZB_ZCL_CMD_MODBUS_STREAM_READ_REQ_ID) {
+            status = stream_read_handler(param, &main_addr);
+        } else {
+            status = stream_ack_handler(param, &main_addr);
+        }
+        if (status == ZB_ZCL_STATUS_MALFORMED_CMD) {
+            gs_modbus_diag.cmd_rejected++;
+        } else {
+            gs_modbus_diag.cmd_received++;
+        }
+        ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+        return ZB_TRUE;
+#endif /* CONFIG_APP_MODBUS_STREAM */
+
+#ifdef CONFIG_APP_MODBUS_SNAPSHOT
+    case ZB_ZCL_CMD_MODBUS_SNAPSHOT_REQ_ID: {
+        bool sent;
+
+        status = snapshot_handler(param, &main_addr, &sent);
+        if (status == ZB_ZCL_STATUS_MALFORMED_CMD) {
+            gs_modbus_diag.cmd_rejected++;
+        } else {
+            gs_modbus_diag.cmd_received++;
+        }
+        if (sent) {
+            zb_buf_free(param);
+        } else {
+            ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+        }
+        return ZB_TRUE;
+    }
+#endif /* CONFIG_APP_MODBUS_SNAPSHOT */
+
     default:
         processed = ZB_FALSE;
         break;
     }
+
+    if (processed) {
+        gs_modbus_diag.cmd_received++;
+    } else {
+        gs_modbus_diag.cmd_rejected++;
+    }
     LOG_DBG("received cmd with id: %i", main_addr.cmd_id);
 
     TRACE_MSG(TRACE_ZCL1, "< zb_zcl_process_modbus_specific_commands: processed %d", (FMT__D, processed));
@@ -191,33 +987,271 @@ zb_bool_t zb_zcl_process_modbus_specific_commands_srv(zb_uint8_t param) {
     return zb_zcl_process_modbus_specific_commands(param);
 }
 
+/* Report the group command in progress, when all expected members answered or its window expired. */
+static void modbus_group_complete(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    if (!gs_modbus_group.active) {
+        return;
+    }
+
+    ZB_SCHEDULE_APP_ALARM_CANCEL(modbus_group_complete, ZB_ALARM_ANY_PARAM);
+    gs_modbus_group.active = ZB_FALSE;
+
+    TRACE_MSG(TRACE_ZCL1, "modbus group command done, %hd answers, %hd failed", (FMT__H_H, gs_modbus_group.result.received, gs_modbus_group.result.failed));
+
+    if (gs_modbus_group.cb != NULL) {
+        gs_modbus_group.cb(&gs_modbus_group.result);
+    }
+}
+
+/* Collect the answer of a group member. Returns ZB_ZCL_STATUS_SUCCESS if the buffer has been taken over. */
+static zb_zcl_status_t group_status_handler(zb_uint8_t param, const zb_zcl_parsed_hdr_t* cmd_info) {
+    struct modbus_frame_response  resp;
+    zb_zcl_modbus_group_result_t* result   = &gs_modbus_group.result;
+    zb_uint16_t                   src_addr = ZB_ZCL_PARSED_HDR_SHORT_DATA(cmd_info).source.u.short_addr;
+    const zb_uint8_t*             data;
+    int                           len;
+
+    len = modbus_get_string(param, &data);
+    if (len < 0 || modbus_frame_parse_response(data, (size_t)len, &resp) != 0 || resp.len != 0) {
+        return ZB_ZCL_STATUS_MALFORMED_CMD;
+    }
+
+    if (!gs_modbus_group.active || cmd_info->seq_number != gs_modbus_group.seq_number) {
+        /* Late answer, or an answer to an earlier group command. */
+        zb_buf_free(param);
+        return ZB_ZCL_STATUS_SUCCESS;
+    }
+
+    for (zb_uint8_t i = 0; i < min(result->received, ARRAY_SIZE(result->members)); i++) {
+        if (result->members[i].short_addr == src_addr) {
+            zb_buf_free(param);
+            return ZB_ZCL_STATUS_SUCCESS;
+        }
+    }
+
+    if (result->received < ARRAY_SIZE(result->members)) {
+        result->members[result->received].short_addr = src_addr;
+        result->members[result->received].err        = resp.err;
+    }
+    result->received++;
+    if (resp.err != 0) {
+        result->failed++;
+    }
+
+    zb_buf_free(param);
+
+    if (result->expected != 0 && result->received >= result->expected) {
+        modbus_group_complete(0);
+    }
+
+    return ZB_ZCL_STATUS_SUCCESS;
+}
+
 zb_bool_t zb_zcl_process_modbus_specific_commands_cli(zb_uint8_t param) {
+    zb_zcl_parsed_hdr_t cmd_info;
+    zb_zcl_status_t     status;
+
     if (ZB_ZCL_GENERAL_GET_CMD_LISTS_PARAM == param) {
         ZCL_CTX().zb_zcl_cluster_cmd_list = &gs_modbus_client_cmd_list;
         return ZB_TRUE;
     }
-    return zb_zcl_process_modbus_specific_commands(param);
+
+    ZB_ZCL_COPY_PARSED_HEADER(param, &cmd_info);
+
+    if (cmd_info.cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_CLI || cmd_info.cmd_id != ZB_ZCL_CMD_MODBUS_GROUP_STATUS_RESP_ID) {
+        return ZB_FALSE;
+    }
+
+    status = group_status_handler(param, &cmd_info);
+    if (status != ZB_ZCL_STATUS_SUCCESS) {
+        ZB_ZCL_PROCESS_COMMAND_FINISH(param, &cmd_info, status);
+    }
+
+    return ZB_TRUE;
+}
+
+/* Number of peers whose Modbus cluster revision is remembered */
+#define REV_CACHE_SIZE 8
+
+typedef struct {
+    zb_bool_t   valid;
+    zb_uint16_t short_addr;
+    zb_uint8_t  endpoint;
+    zb_uint16_t rev;
+    zb_uint32_t last_used;
+} modbus_rev_cache_entry_t;
+
+static modbus_rev_cache_entry_t gs_modbus_rev_cache[REV_CACHE_SIZE];
+static zb_uint32_t              gs_modbus_rev_cache_tick;
+
+/* Pending fan-out of a pre-built request to a list of peers */
+static struct {
+    const zb_zcl_modbus_cmd_template_t* tmpl;
+    const zb_uint16_t*                  dst_addrs;
+    zb_uint8_t                          count;
+    zb_uint8_t                          next;
+    zb_uint8_t                          dst_ep;
+    zb_uint8_t                          ep;
+    zb_uint16_t                         prof_id;
+    zb_callback_t                       done;
+} gs_modbus_fanout;
+
+void zb_zcl_modbus_flush_rev_cache(void) {
+    ZB_BZERO(gs_modbus_rev_cache, sizeof(gs_modbus_rev_cache));
+}
+
+/* Cluster revision of a unicast peer, looked up in the stack only on a cache miss. */
+static zb_uint16_t modbus_get_peer_rev(const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep) {
+    modbus_rev_cache_entry_t* victim = &gs_modbus_rev_cache[0];
+
+    if (dst_addr_mode != ZB_APS_ADDR_MODE_16_ENDP_PRESENT) {
+        return zb_zcl_get_cluster_rev_by_mode(ZB_ZCL_MODBUS_CLUSTER_REVISION_MAX, dst_addr, dst_addr_mode, dst_ep, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_CLIENT_ROLE, ep);
+    }
+
+    for (zb_uint8_t i = 0; i < ARRAY_SIZE(gs_modbus_rev_cache); i++) {
+        modbus_rev_cache_entry_t* entry = &gs_modbus_rev_cache[i];
+
+        if (entry->valid && entry->short_addr == dst_addr->addr_short && entry->endpoint == dst_ep) {
+            entry->last_used = ++gs_modbus_rev_cache_tick;
+            return entry->rev;
+        }
+        if (!entry->valid || (victim->valid && entry->last_used < victim->last_used)) {
+            victim = entry;
+        }
+    }
+
+    victim->valid      = ZB_TRUE;
+    victim->short_addr = dst_addr->addr_short;
+    victim->endpoint   = dst_ep;
+    victim->rev        = zb_zcl_get_cluster_rev_by_mode(ZB_ZCL_MODBUS_CLUSTER_REVISION_MAX, dst_addr, dst_addr_mode, dst_ep, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_CLIENT_ROLE, ep);
+    victim->last_used  = ++gs_modbus_rev_cache_tick;
+
+    return victim->rev;
 }
 
-// TODO finish
-static inline void zb_zcl_modbus_send_json_command_cmd_rev1(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb, zb_uint16_t address,
-                                                            zb_uint8_t data_length, zb_uint8_t slave_id, zb_uint8_t cmd_id) {
-    zb_uint8_t* ptr = ZB_ZCL_START_PACKET_REQ(buffer) ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_REQ_FRAME_CONTROL(ptr, (def_resp)) ZB_ZCL_CONSTRUCT_COMMAND_HEADER_REQ(ptr, ZB_ZCL_GET_SEQ_NUM(), (cmd_id));
+zb_ret_t zb_zcl_modbus_build_cmd_template(zb_zcl_modbus_cmd_template_t* tmpl, const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t cmd_id, zb_uint8_t def_resp) {
+    zb_uint8_t* ptr        = &tmpl->payload[1];
+    zb_uint8_t  data_words = 0;
+
+    if (req->fc == MODBUS_FC_WRITE_HOLDING_REG || req->fc == MODBUS_FC_WRITE_HOLDING_REGS) {
+        data_words = req->nb_regs;
+    }
+
+    if (req->nb_regs == 0 || req->nb_regs > MAX_NUM_REGISTERS || (data_words > 0 && req->data == NULL)) {
+        return RET_INVALID_PARAMETER;
+    }
+
+    *ptr++ = req->fc;
+    *ptr++ = req->slave_id;
+    *ptr++ = (zb_uint8_t)(req->addr & 0xFF);
+    *ptr++ = (zb_uint8_t)(req->addr >> 8);
+    *ptr++ = req->nb_regs;
+    for (zb_uint8_t i = 0; i < data_words; i++) {
+        *ptr++ = (zb_uint8_t)(req->data[i] & 0xFF);
+        *ptr++ = (zb_uint8_t)(req->data[i] >> 8);
+    }
+    if (req->timeout_ms != 0) {
+        *ptr++ = (zb_uint8_t)(req->timeout_ms & 0xFF);
+        *ptr++ = (zb_uint8_t)(req->timeout_ms >> 8);
+    }
+
+    tmpl->payload[0] = (zb_uint8_t)(ptr - &tmpl->payload[1]);
+    tmpl->len        = (zb_uint8_t)(ptr - tmpl->payload);
+    tmpl->cmd_id     = cmd_id;
+    tmpl->def_resp   = def_resp;
 
-    ZB_ZCL_PACKET_PUT_DATA16_VAL(ptr, (address));
-    ZB_ZCL_PACKET_PUT_DATA8(ptr, (data_length));
-    ZB_ZCL_PACKET_PUT_DATA8(ptr, (slave_id));
-    zb_zcl_finish_and_send_packet(buffer, ptr, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, cb);
+    return RET_OK;
 }
 
-// TODO finish
-void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb, zb_uint16_t address,
-                                         zb_uint8_t data_length, zb_uint8_t slave_id, zb_uint8_t cmd_id) {
+static void modbus_send_template(zb_bufid_t buffer, const zb_zcl_modbus_cmd_template_t* tmpl, zb_uint8_t seq_number, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id,
+                                 zb_callback_t cb) {
+    zb_uint8_t* ptr = ZB_ZCL_START_PACKET_REQ(buffer) ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_REQ_FRAME_CONTROL(ptr, (tmpl->def_resp)) ZB_ZCL_CONSTRUCT_COMMAND_HEADER_REQ(ptr, seq_number, (tmpl->cmd_id));
+
+    ZB_ZCL_PACKET_PUT_DATA_N(ptr, tmpl->payload, tmpl->len);
+    zb_zcl_finish_and_send_packet(buffer, ptr, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, ZB_ZCL_CLUSTER_ID_MODBUS, cb);
+}
+
+void zb_zcl_modbus_send_cmd_template(zb_bufid_t buffer, const zb_zcl_modbus_cmd_template_t* tmpl, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_callback_t cb) {
+    modbus_send_template(buffer, tmpl, ZB_ZCL_GET_SEQ_NUM(), dst_addr, dst_addr_mode, dst_ep, ep, prof_id, cb);
+}
+
+static void modbus_fanout_send(zb_bufid_t bufid);
+
+/* The buffer pool running out is expected under fan-out load, try again later. */
+static void modbus_fanout_next(zb_uint8_t param) {
+    ZVUNUSED(param);
+
+    if (zb_buf_get_out_delayed(modbus_fanout_send) != RET_OK) {
+        ZB_SCHEDULE_APP_ALARM(modbus_fanout_next, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(ZB_ZCL_MODBUS_RETRY_DELAY_MS));
+    }
+}
+
+static void modbus_fanout_send(zb_bufid_t bufid) {
+    zb_addr_u     dst_addr;
+    zb_callback_t done;
+
+    dst_addr.addr_short = gs_modbus_fanout.dst_addrs[gs_modbus_fanout.next++];
+    zb_zcl_modbus_send_cmd_template(bufid, gs_modbus_fanout.tmpl, &dst_addr, ZB_APS_ADDR_MODE_16_ENDP_PRESENT, gs_modbus_fanout.dst_ep, gs_modbus_fanout.ep, gs_modbus_fanout.prof_id, NULL);
+
+    if (gs_modbus_fanout.next < gs_modbus_fanout.count) {
+        modbus_fanout_next(0);
+        return;
+    }
+
+    done                  = gs_modbus_fanout.done;
+    gs_modbus_fanout.tmpl = NULL;
+    if (done != NULL) {
+        ZB_SCHEDULE_APP_CALLBACK(done, 0);
+    }
+}
+
+zb_ret_t zb_zcl_modbus_send_cmd_fanout(const zb_zcl_modbus_cmd_template_t* tmpl, const zb_uint16_t* dst_addrs, zb_uint8_t count, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_callback_t done) {
+    if (gs_modbus_fanout.tmpl != NULL) {
+        return RET_BUSY;
+    }
+
+    if (count == 0) {
+        if (done != NULL) {
+            ZB_SCHEDULE_APP_CALLBACK(done, 0);
+        }
+        return RET_OK;
+    }
+
+    gs_modbus_fanout.tmpl      = tmpl;
+    gs_modbus_fanout.dst_addrs = dst_addrs;
+    gs_modbus_fanout.count     = count;
+    gs_modbus_fanout.next      = 0;
+    gs_modbus_fanout.dst_ep    = dst_ep;
+    gs_modbus_fanout.ep        = ep;
+    gs_modbus_fanout.prof_id   = prof_id;
+    gs_modbus_fanout.done      = done;
+
+    modbus_fanout_next(0);
+    return RET_OK;
+}
+
+static inline void zb_zcl_modbus_send_json_command_cmd_rev1(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb,
+                                                            const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t cmd_id) {
+    zb_zcl_modbus_cmd_template_t tmpl;
+
+    if (zb_zcl_modbus_build_cmd_template(&tmpl, req, cmd_id, def_resp) != RET_OK) {
+        LOG_ERR("Invalid Modbus request");
+        zb_buf_free(buffer);
+        return;
+    }
+
+    zb_zcl_modbus_send_cmd_template(buffer, &tmpl, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, cb);
+}
+
+void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb,
+                                         const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t cmd_id) {
     zb_uint16_t rev;
 
     TRACE_MSG(TRACE_ZCL3, "> zb_zcl_modbus_send_json_cmd", (FMT__0));
 
-    rev = zb_zcl_get_cluster_rev_by_mode(ZB_ZCL_MODBUS_CLUSTER_REVISION_MAX, dst_addr, dst_addr_mode, dst_ep, ZB_ZCL_CLUSTER_ID_MODBUS, ZB_ZCL_CLUSTER_CLIENT_ROLE, ep);
+    rev = modbus_get_peer_rev(dst_addr, dst_addr_mode, dst_ep, ep);
 
     TRACE_MSG(TRACE_ZCL3, "rev is %d", (FMT__D, rev));
 
@@ -225,17 +1259,50 @@ void zb_zcl_modbus_send_json_command_cmd(zb_bufid_t buffer, const zb_addr_u* dst
     case ZB_ZCL_CLUSTER_REV_MIN:
         /* FALLTHROUGH */
     default:
-        zb_zcl_modbus_send_json_command_cmd_rev1(buffer, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, def_resp, cb, address, data_length, slave_id, cmd_id);
+        zb_zcl_modbus_send_json_command_cmd_rev1(buffer, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, def_resp, cb, req, cmd_id);
         break;
     }
 
     TRACE_MSG(TRACE_ZCL3, "< zb_zcl_modbus_send_json_cmd", (FMT__0));
 }
 
+zb_ret_t zb_zcl_modbus_send_group_cmd(zb_bufid_t buffer, zb_uint16_t group_addr, zb_uint8_t ep, zb_uint16_t prof_id, const zb_zcl_modbus_data_packet_req_t* req, zb_uint8_t expected, zb_uint16_t window_ms, zb_zcl_modbus_group_cb_t cb) {
+    zb_zcl_modbus_cmd_template_t tmpl;
+    zb_addr_u                    dst_addr;
+    zb_ret_t                     ret;
+
+    if (gs_modbus_group.active) {
+        return RET_BUSY;
+    }
+
+    ret = zb_zcl_modbus_build_cmd_template(&tmpl, req, ZB_ZCL_CMD_MODBUS_GROUP_COMMAND_REQ_ID, ZB_ZCL_DISABLE_DEFAULT_RESPONSE);
+    if (ret != RET_OK) {
+        return ret;
+    }
+
+    if (window_ms == 0) {
+        window_ms = ZB_ZCL_MODBUS_GROUP_WINDOW_DEFAULT_MS;
+    }
+
+    ZB_BZERO(&gs_modbus_group.result, sizeof(gs_modbus_group.result));
+    gs_modbus_group.result.group_addr = group_addr;
+    gs_modbus_group.result.expected   = expected;
+    gs_modbus_group.cb                = cb;
+    gs_modbus_group.seq_number        = ZB_ZCL_GET_SEQ_NUM();
+    gs_modbus_group.active            = ZB_TRUE;
+
+    dst_addr.addr_short = group_addr;
+    modbus_send_template(buffer, &tmpl, gs_modbus_group.seq_number, &dst_addr, ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT, 0, ep, prof_id, NULL);
+
+    ZB_SCHEDULE_APP_ALARM(modbus_group_complete, 0, ZB_MILLISECONDS_TO_BEACON_INTERVAL(window_ms));
+
+    return RET_OK;
+}
+
 void zb_zcl_modbus_test_send_fixed(zb_bufid_t buffer, const zb_addr_u* dst_addr, zb_uint8_t dst_addr_mode, zb_uint8_t dst_ep, zb_uint8_t ep, zb_uint16_t prof_id, zb_uint8_t def_resp, zb_callback_t cb) {
     zb_uint8_t*   ptr    = ZB_ZCL_START_PACKET_REQ(buffer) ZB_ZCL_CONSTRUCT_SPECIFIC_COMMAND_REQ_FRAME_CONTROL(ptr, (def_resp)) ZB_ZCL_CONSTRUCT_COMMAND_HEADER_REQ(ptr, ZB_ZCL_GET_SEQ_NUM(), (ZB_ZCL_CMD_MODBUS_JSON_COMMAND_REQ_ID));
     const uint8_t data[] = {0x03, 0x01, 0x00, 0x00, 0x04};
     ZB_ZCL_PACKET_PUT_DATA8(ptr, (sizeof(data)));
     ZB_ZCL_PACKET_PUT_DATA_N(ptr, data, sizeof(data));
-    zb_zcl_finish_and_send_packet(buffer, ptr, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, cb);
-}
\ No newline at end of file
+    zb_zcl_finish_and_send_packet(buffer, ptr, dst_addr, dst_addr_mode, dst_ep, ep, prof_id, ZB_ZCL_CLUSTER_ID_MODBUS, cb);
+}